@@ -1,7 +1,17 @@
 #include "CameraManager.hpp"
+#include <algorithm>
+#include <TraceRecorder.h>
+#include <BootProfiler.hpp>
 
 const char *CAMERA_MANAGER_TAG = "[CAMERA_MANAGER]";
 
+// no frame for this long and we consider the stream stopped
+static constexpr int64_t STREAMING_IDLE_US = 500000;
+// how long captureLumaGrid() waits for the stream to hand it a frame
+static constexpr int LUMA_REQUEST_TIMEOUT_MS = 200;
+// frames captureLumaGrid() skips through looking for one the filter accepts, covers the longest LED pattern
+static constexpr int LUMA_FILTER_MAX_FRAMES = 16;
+
 CameraManager::CameraManager(std::shared_ptr<ProjectConfig> projectConfig, QueueHandle_t eventQueue)
     : projectConfig(projectConfig), eventQueue(eventQueue) {}
 
@@ -52,6 +62,14 @@ void CameraManager::setupCameraPinout()
   xclk_freq_hz = CONFIG_CAMERA_USB_XCLK_FREQ;
 #endif
 
+  // units differ in how hard they can be clocked, a calibrated value (see calibrate_xclk)
+  // takes precedence over the board defaults
+  if (const auto calibrated_xclk = this->projectConfig->getCameraConfig().xclk_freq_hz; calibrated_xclk > 0)
+  {
+    ESP_LOGI(CAMERA_MANAGER_TAG, "Using calibrated XCLK frequency: %lu Hz", static_cast<unsigned long>(calibrated_xclk));
+    xclk_freq_hz = static_cast<int>(calibrated_xclk);
+  }
+
   config = {
       .pin_pwdn = CONFIG_PWDN_GPIO_NUM,     // CAM_PIN_PWDN,
       .pin_reset = CONFIG_RESET_GPIO_NUM,   // CAM_PIN_RESET,
@@ -130,14 +148,15 @@ void CameraManager::setupCameraSensor()
                                    0);              // 0 = disable , 1 = enable
   camera_sensor->set_aec2(camera_sensor, 0);        // 0 = disable , 1 = enable
   camera_sensor->set_ae_level(camera_sensor, 0);    // -2 to 2
-  camera_sensor->set_aec_value(camera_sensor, 300); // 0 to 1200
+  camera_sensor->set_aec_value(camera_sensor, this->aecValue); // 0 to 1200
+  this->sensorAecValue = this->aecValue;
 
   // controls the gain
   camera_sensor->set_gain_ctrl(camera_sensor, 0); // 0 = disable , 1 = enable
 
   // automatic gain control gain, controls by how much the resulting image
   // should be amplified
-  camera_sensor->set_agc_gain(camera_sensor, 2);                   // 0 to 30
+  camera_sensor->set_agc_gain(camera_sensor, this->agcGain);       // 0 to 30
   camera_sensor->set_gainceiling(camera_sensor, (gainceiling_t)6); // 0 to 6
 
   // black and white pixel correction, averages the white and black spots
@@ -163,6 +182,7 @@ void CameraManager::setupCameraSensor()
 
   // it gets overriden somewhere somehow
   camera_sensor->set_framesize(camera_sensor, FRAMESIZE_240X240);
+  this->applyReadoutMode();
   ESP_LOGI(CAMERA_MANAGER_TAG, "Setting up camera sensor done");
 }
 
@@ -202,7 +222,7 @@ bool CameraManager::setupCamera()
   // Thanks to lick_it, we discovered that OV5640 likes to overheat when
   // running at higher than usual xclk frequencies.
   // Hence, why we're limiting the faster ones for OV2640
-  if (const auto camera_id = temp_sensor->id.PID; camera_id == OV5640_PID)
+  if (const auto camera_id = temp_sensor->id.PID; camera_id == OV5640_PID && config.xclk_freq_hz > OV5640_XCLK_FREQ_HZ)
   {
     config.xclk_freq_hz = OV5640_XCLK_FREQ_HZ;
     esp_camera_deinit();
@@ -211,6 +231,8 @@ bool CameraManager::setupCamera()
 
 #endif
 
+  this->nominalXclkFreqHz = config.xclk_freq_hz;
+  this->highSpeedMode = this->projectConfig->getCameraConfig().high_speed;
   this->setupCameraSensor();
   // this->loadConfigData(); // move this to update method once implemented
   return true;
@@ -232,7 +254,18 @@ int CameraManager::setCameraResolution(const framesize_t frameSize)
 {
   if (camera_sensor->pixformat == PIXFORMAT_JPEG)
   {
-    return camera_sensor->set_framesize(camera_sensor, frameSize);
+    int result;
+    {
+      // the driver rewrites the window and clocks, let it start from the registers it expects
+      std::lock_guard lock(this->timingMutex);
+      this->restoreSensorFrameTiming();
+      result = camera_sensor->set_framesize(camera_sensor, frameSize);
+      this->timingBaseline.valid = false;
+    }
+    this->applyReadoutMode();
+    this->applySensorFrameTiming();
+    this->applyExposure();
+    return result;
   }
   return -1;
 }
@@ -255,4 +288,623 @@ int CameraManager::setVieWindow(int offsetX,
 
   // todo safariMonkey made a PoC, implement it here
   return 0;
-}
\ No newline at end of file
+}
+
+camera_fb_t *CameraManager::acquireFrame()
+{
+  camera_fb_t *fb = this->acquireRawFrame();
+  if (fb == nullptr)
+    return nullptr;
+
+  this->trackFrame(fb);
+
+  // someone is waiting in captureLumaGrid(), hand them this frame rather than letting them take one from us.
+  // the DC-only decode costs a millisecond or two and only happens at the rate frames are asked for
+  if (this->lumaRequester.load() != nullptr && (!this->lumaFrameFilter || this->lumaFrameFilter(fb)))
+  {
+    if (TaskHandle_t requester = this->lumaRequester.exchange(nullptr))
+    {
+      this->lumaRequestResult = this->decodeLumaGrid(fb, *this->lumaRequestGrid);
+      xTaskNotifyGive(requester);
+    }
+  }
+  return fb;
+}
+
+camera_fb_t *CameraManager::acquireRawFrame()
+{
+  // announce ourselves before checking the flag, so reinitialize() either sees us or we see it
+  this->framesInFlight++;
+  if (this->streamBlocks.load() > 0)
+  {
+    this->framesInFlight--;
+    return nullptr;
+  }
+
+  TRACE_BEGIN(TRACE_CAPTURE, 0);
+  camera_fb_t *fb = esp_camera_fb_get();
+  TRACE_END(TRACE_CAPTURE, fb ? fb->len : 0);
+  if (fb == nullptr)
+  {
+    this->captureFailures++;
+    this->framesInFlight--;
+    return nullptr;
+  }
+
+#if CONFIG_CAMERA_JPEG_VALIDATION
+  if (fb->format == PIXFORMAT_JPEG)
+  {
+    const JpegCheck check = validateJpeg(fb->buf, fb->len);
+    this->jpegStats.record(check, fb->len);
+    if (check.error != JpegError::None)
+    {
+      ESP_LOGD(CAMERA_MANAGER_TAG, "Dropping frame: %s", jpegErrorToString(check.error));
+      esp_camera_fb_return(fb);
+      this->framesInFlight--;
+      return nullptr;
+    }
+    // the driver rounds up to DMA chunks, don't ship the padding
+    fb->len = check.length;
+  }
+#endif
+
+  return fb;
+}
+
+void CameraManager::trackFrame(const camera_fb_t *fb)
+{
+  BootProfiler::markFirstFrame();
+  this->framesDelivered++;
+  this->bytesDelivered += fb->len;
+  this->lastFrameBytes = fb->len;
+
+  const int64_t timestamp_us = static_cast<int64_t>(fb->timestamp.tv_sec) * 1000000 + fb->timestamp.tv_usec;
+  const int64_t interval_us = timestamp_us - this->lastFrameTimestampUs;
+  this->lastFrameTimestampUs = timestamp_us;
+
+  // a gap of more than a second means the stream was idle, start over rather than average it in
+  if (interval_us <= 0 || interval_us > 1000000)
+  {
+    this->measuredFps = 0.0f;
+    return;
+  }
+
+  const float instant = 1000000.0f / static_cast<float>(interval_us);
+  const float previous = this->measuredFps.load();
+  this->measuredFps = previous > 0.0f ? previous + (instant - previous) * 0.1f : instant;
+}
+
+void CameraManager::releaseFrame(camera_fb_t *fb)
+{
+  if (fb == nullptr)
+    return;
+
+  esp_camera_fb_return(fb);
+  this->framesInFlight--;
+}
+
+uint16_t CameraManager::getSensorPID() const
+{
+  return this->camera_sensor ? this->camera_sensor->id.PID : 0;
+}
+
+bool CameraManager::blockStreams()
+{
+  this->streamBlocks++;
+
+  // give the streaming paths a moment to hand back the buffers they're still holding
+  for (int i = 0; i < 50 && this->framesInFlight.load() > 0; i++)
+  {
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+
+  if (this->framesInFlight.load() > 0)
+  {
+    ESP_LOGW(CAMERA_MANAGER_TAG, "Blocking streams with %d frame(s) still in flight", this->framesInFlight.load());
+    return false;
+  }
+  return true;
+}
+
+void CameraManager::unblockStreams()
+{
+  this->streamBlocks--;
+}
+
+bool CameraManager::reinitialize(const int xclk_freq_hz)
+{
+  // deinit frees the frame buffers, a stream still holding one would read freed memory
+  if (!this->blockStreams())
+  {
+    ESP_LOGE(CAMERA_MANAGER_TAG, "Not re-initializing at %d Hz, frames are still in flight", xclk_freq_hz);
+    this->unblockStreams();
+    return false;
+  }
+
+  const bool result = this->restartDriver(xclk_freq_hz);
+  this->unblockStreams();
+  return result;
+}
+
+// streams are blocked and every frame has been handed back
+bool CameraManager::restartDriver(const int xclk_freq_hz)
+{
+  esp_camera_deinit();
+  config.xclk_freq_hz = xclk_freq_hz;
+  {
+    // fresh sensor, fresh registers
+    std::lock_guard lock(this->timingMutex);
+    this->timingBaseline.valid = false;
+    this->sensorFrameRate = 0;
+  }
+  const auto result = esp_camera_init(&config);
+  if (result == ESP_OK)
+  {
+    this->setupCameraSensor();
+    this->applySensorFrameTiming();
+    this->applyExposure();
+  }
+  else
+  {
+    ESP_LOGE(CAMERA_MANAGER_TAG, "Re-initialization at %d Hz failed: %s", xclk_freq_hz, esp_err_to_name(result));
+  }
+  return result == ESP_OK;
+}
+
+bool CameraManager::applyXclk(const int xclk_freq_hz)
+{
+  ESP_LOGI(CAMERA_MANAGER_TAG, "Applying XCLK frequency: %d Hz", xclk_freq_hz);
+  const bool applied = this->reinitialize(xclk_freq_hz);
+  // a driver that couldn't be taken down keeps running at the clock it had
+  if (config.xclk_freq_hz == xclk_freq_hz)
+    this->nominalXclkFreqHz = xclk_freq_hz;
+  return applied;
+}
+
+bool CameraManager::throttleXclk(const int xclk_freq_hz)
+{
+  // only ever go down, and only when there's a camera to re-initialize
+  if (this->camera_sensor == nullptr || xclk_freq_hz <= 0 || xclk_freq_hz >= config.xclk_freq_hz)
+    return false;
+
+  ESP_LOGW(CAMERA_MANAGER_TAG, "Throttling XCLK from %d Hz to %d Hz", config.xclk_freq_hz, xclk_freq_hz);
+  return this->reinitialize(xclk_freq_hz);
+}
+
+bool CameraManager::restoreXclk()
+{
+  if (!this->isXclkThrottled())
+    return false;
+
+  ESP_LOGI(CAMERA_MANAGER_TAG, "Restoring XCLK to %d Hz", this->nominalXclkFreqHz);
+  return this->reinitialize(this->nominalXclkFreqHz);
+}
+
+XclkProbeResult CameraManager::probeXclk(const int xclk_freq_hz, const int duration_ms)
+{
+  XclkProbeResult result{xclk_freq_hz, false, 0, 0, 0, 0.0f};
+
+  // blocked from before the re-init until the measurement is done, a stream must not get a frame in between
+  if (!this->blockStreams() || !this->restartDriver(xclk_freq_hz))
+  {
+    this->unblockStreams();
+    return result;
+  }
+  result.initialized = true;
+
+  // we want what the clock can do, not the rate the stream asked for
+  this->resetSensorFrameTiming();
+
+  // the first few frames after init are taken with the sensor still settling, skip them
+  for (int i = 0; i < 3; i++)
+  {
+    if (auto *fb = esp_camera_fb_get())
+      esp_camera_fb_return(fb);
+  }
+
+  const int64_t start_us = esp_timer_get_time();
+  const int64_t end_us = start_us + static_cast<int64_t>(duration_ms) * 1000;
+  while (esp_timer_get_time() < end_us)
+  {
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (fb == nullptr)
+    {
+      result.timeouts++;
+      continue;
+    }
+
+    result.frames++;
+    if (validateJpeg(fb->buf, fb->len).error != JpegError::None)
+      result.corrupt_frames++;
+    esp_camera_fb_return(fb);
+  }
+
+  const int64_t elapsed_us = esp_timer_get_time() - start_us;
+  result.fps = elapsed_us > 0 ? (result.frames * 1000000.0f) / static_cast<float>(elapsed_us) : 0.0f;
+
+  this->unblockStreams();
+
+  ESP_LOGI(CAMERA_MANAGER_TAG, "XCLK probe %d Hz: %lu frames, %lu corrupt, %lu timeouts, %.1f fps",
+           xclk_freq_hz, static_cast<unsigned long>(result.frames),
+           static_cast<unsigned long>(result.corrupt_frames),
+           static_cast<unsigned long>(result.timeouts), result.fps);
+  return result;
+}
+
+void CameraManager::setFrameRateCap(const int fps)
+{
+  this->frameRateCap = fps;
+  this->applySensorFrameTiming();
+  this->applyExposure();
+}
+
+void CameraManager::setRequestedFrameRate(const int fps)
+{
+  this->requestedFrameRate = fps;
+  this->applySensorFrameTiming();
+  this->applyExposure();
+}
+
+int CameraManager::getTargetFrameRate() const
+{
+  const int requested = this->requestedFrameRate.load();
+  const int cap = this->frameRateCap.load();
+  if (requested > 0 && cap > 0)
+    return std::min(requested, cap);
+  return requested > 0 ? requested : cap;
+}
+
+// total lines per frame for the readout mode the esp32-camera driver picks for a given size,
+// CIF mode for sizes up to 400x296, SVGA up to 800x600 and UXGA above that
+static uint16_t ov2640FrameLines(const framesize_t frameSize)
+{
+  const auto &info = resolution[frameSize];
+  if (info.width <= 400 && info.height <= 296)
+    return 336;
+  if (info.width <= 800 && info.height <= 600)
+    return 672;
+  return 1248;
+}
+
+float CameraManager::measureNativeFps()
+{
+  const framesize_t frameSize = this->camera_sensor->status.framesize;
+  if (this->nativeFps > 0.0f && this->nativeFpsFramesize == frameSize && this->nativeFpsXclk == config.xclk_freq_hz &&
+      this->nativeFpsHighSpeed == this->highSpeedMode)
+    return this->nativeFps;
+
+  // only captures, a frame still held by a stream does no harm here
+  this->blockStreams();
+
+  // flush whatever was captured before, those frames may come from the old timing
+  for (int i = 0; i < 3; i++)
+  {
+    if (auto *fb = esp_camera_fb_get())
+      esp_camera_fb_return(fb);
+  }
+
+  constexpr int frames_to_measure = 10;
+  int frames = 0;
+  const int64_t start_us = esp_timer_get_time();
+  for (int i = 0; i < frames_to_measure; i++)
+  {
+    if (auto *fb = esp_camera_fb_get())
+    {
+      esp_camera_fb_return(fb);
+      frames++;
+    }
+  }
+  const int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+  this->unblockStreams();
+
+  if (frames == 0 || elapsed_us <= 0)
+    return 0.0f;
+
+  this->nativeFps = (frames * 1000000.0f) / static_cast<float>(elapsed_us);
+  this->nativeFpsFramesize = frameSize;
+  this->nativeFpsXclk = config.xclk_freq_hz;
+  this->nativeFpsHighSpeed = this->highSpeedMode;
+  ESP_LOGI(CAMERA_MANAGER_TAG, "Native sensor rate: %.1f fps", this->nativeFps);
+  return this->nativeFps;
+}
+
+void CameraManager::resetSensorFrameTiming()
+{
+  std::lock_guard lock(this->timingMutex);
+  this->restoreSensorFrameTiming();
+}
+
+// callers hold timingMutex
+void CameraManager::restoreSensorFrameTiming()
+{
+  if (this->camera_sensor == nullptr || !this->timingBaseline.valid)
+    return;
+
+  switch (this->camera_sensor->id.PID)
+  {
+  case OV2640_PID:
+    // bit 8 of the register address selects the sensor bank in the ov2640 driver
+    this->camera_sensor->set_reg(this->camera_sensor, 0x111, 0xff, this->timingBaseline.clkrc);
+    this->camera_sensor->set_reg(this->camera_sensor, 0x146, 0xff, this->timingBaseline.lines & 0xff);
+    this->camera_sensor->set_reg(this->camera_sensor, 0x147, 0xff, this->timingBaseline.lines >> 8);
+    break;
+  case OV5640_PID:
+    this->camera_sensor->set_reg(this->camera_sensor, 0x380E, 0xff, this->timingBaseline.lines >> 8);
+    this->camera_sensor->set_reg(this->camera_sensor, 0x380F, 0xff, this->timingBaseline.lines & 0xff);
+    break;
+  default:
+    break;
+  }
+  this->sensorFrameRate = 0;
+}
+
+void CameraManager::applySensorFrameTiming()
+{
+  if (this->camera_sensor == nullptr)
+    return;
+
+  const uint16_t pid = this->camera_sensor->id.PID;
+  if (pid != OV2640_PID && pid != OV5640_PID)
+    return;
+
+  // the UVC host, the thermal throttle and resolution changes can all land here from different tasks
+  std::lock_guard lock(this->timingMutex);
+
+  const int target = this->getTargetFrameRate();
+  if (target == this->sensorFrameRate)
+    return;
+
+  // measure from the driver's own timing, not from whatever we programmed last
+  this->restoreSensorFrameTiming();
+  if (target <= 0)
+  {
+    ESP_LOGI(CAMERA_MANAGER_TAG, "Sensor frame timing back to free-running");
+    return;
+  }
+
+  const float native = this->measureNativeFps();
+  if (native <= 0.0f || native <= static_cast<float>(target))
+  {
+    // the sensor isn't faster than what's asked for, nothing to slow down
+    return;
+  }
+
+  const float ratio = native / static_cast<float>(target);
+
+  if (pid == OV2640_PID)
+  {
+    const auto clkrc = static_cast<uint8_t>(this->camera_sensor->get_reg(this->camera_sensor, 0x111, 0xff));
+    const auto fll = static_cast<uint16_t>(this->camera_sensor->get_reg(this->camera_sensor, 0x146, 0xff) |
+                                           (this->camera_sensor->get_reg(this->camera_sensor, 0x147, 0xff) << 8));
+    this->timingBaseline = {true, clkrc, fll};
+
+    // coarse step: divide the pixel clock, which is also where the power goes
+    const int base_divider = (clkrc & 0x3f) + 1;
+    const int divider = std::clamp(static_cast<int>(ratio), 1, 64 / base_divider);
+    // fine step: pad the frame with dummy lines for whatever the divider couldn't reach
+    const float residual = ratio / static_cast<float>(divider);
+    const int frame_lines = ov2640FrameLines(this->camera_sensor->status.framesize) + fll;
+    const int dummy_lines = std::clamp(static_cast<int>(frame_lines * (residual - 1.0f) + 0.5f), 0, 0xffff - fll);
+    const int new_fll = fll + dummy_lines;
+
+    this->camera_sensor->set_reg(this->camera_sensor, 0x111, 0xff, (clkrc & 0xc0) | ((base_divider * divider - 1) & 0x3f));
+    this->camera_sensor->set_reg(this->camera_sensor, 0x146, 0xff, new_fll & 0xff);
+    this->camera_sensor->set_reg(this->camera_sensor, 0x147, 0xff, new_fll >> 8);
+    ESP_LOGI(CAMERA_MANAGER_TAG, "OV2640 timing for %d fps (native %.1f): clock divider x%d, %d dummy lines",
+             target, native, divider, dummy_lines);
+  }
+  else
+  {
+    const auto vts = static_cast<uint16_t>((this->camera_sensor->get_reg(this->camera_sensor, 0x380E, 0xff) << 8) |
+                                           this->camera_sensor->get_reg(this->camera_sensor, 0x380F, 0xff));
+    this->timingBaseline = {true, 0, vts};
+
+    // frame time scales linearly with VTS at a fixed pixel clock and line length
+    const int new_vts = std::clamp(static_cast<int>(vts * ratio + 0.5f), static_cast<int>(vts), 0xffff);
+    this->camera_sensor->set_reg(this->camera_sensor, 0x380E, 0xff, new_vts >> 8);
+    this->camera_sensor->set_reg(this->camera_sensor, 0x380F, 0xff, new_vts & 0xff);
+    ESP_LOGI(CAMERA_MANAGER_TAG, "OV5640 timing for %d fps (native %.1f): VTS %u -> %d", target, native, vts, new_vts);
+  }
+
+  this->sensorFrameRate = target;
+}
+
+void CameraManager::applyReadoutMode()
+{
+  if (this->camera_sensor == nullptr || !this->highSpeedMode)
+    return;
+
+  switch (this->camera_sensor->id.PID)
+  {
+  case OV2640_PID:
+    // the driver already reads out in CIF mode (2x subsampled) for sizes up to 400x296,
+    // what's left is running that readout at twice the pixel clock: doubler on, no divider
+    this->driverClkrc = static_cast<uint8_t>(this->camera_sensor->get_reg(this->camera_sensor, 0x111, 0xff));
+    this->camera_sensor->set_reg(this->camera_sensor, 0x111, 0xff, 0x80);
+    break;
+  case OV5640_PID:
+    // the driver bins small sizes but keeps the PLL low, bump the system clock multiplier.
+    // same dividers as the driver's JPEG setup, so the pixel clock stays within what the DMA takes
+    this->camera_sensor->set_pll(this->camera_sensor, false, 252, 4, 2, false, 2, true, 4);
+    break;
+  default:
+    ESP_LOGW(CAMERA_MANAGER_TAG, "High speed readout not supported for sensor 0x%x", this->camera_sensor->id.PID);
+    return;
+  }
+
+  ESP_LOGI(CAMERA_MANAGER_TAG, "High speed readout enabled");
+}
+
+bool CameraManager::setHighSpeedMode(const bool enabled)
+{
+  if (this->highSpeedMode == enabled)
+    return true;
+
+  this->highSpeedMode = enabled;
+  if (this->camera_sensor == nullptr)
+    return false;
+
+  {
+    // switched in place on top of the current size, a resolution change would measure the sensor all over again
+    std::lock_guard lock(this->timingMutex);
+    if (enabled)
+    {
+      this->restoreSensorFrameTiming();
+      this->applyReadoutMode();
+      this->timingBaseline.valid = false;
+    }
+    else
+    {
+      this->restoreDriverReadout();
+      // the PLL the driver picked for this size can't be read back, it has to set the size up again
+      if (this->camera_sensor->id.PID == OV5640_PID)
+        this->camera_sensor->set_framesize(this->camera_sensor, this->camera_sensor->status.framesize);
+    }
+    // the timing has to be worked out again for the new readout
+    this->sensorFrameRate = 0;
+  }
+  this->applySensorFrameTiming();
+  this->applyExposure();
+  return true;
+}
+
+int CameraManager::setStreamFormat(const framesize_t frameSize, const bool highSpeed, const int fps)
+{
+  if (this->camera_sensor == nullptr)
+    return -1;
+
+  if (this->highSpeedMode && !highSpeed)
+  {
+    std::lock_guard lock(this->timingMutex);
+    this->restoreDriverReadout();
+  }
+  this->highSpeedMode = highSpeed;
+  this->requestedFrameRate = fps;
+  // the readout mode and the rate are layered on by the one resolution change, so the sensor is measured once
+  return this->setCameraResolution(frameSize);
+}
+
+// puts the driver's own clock back in case set_framesize leaves it alone, callers hold timingMutex
+void CameraManager::restoreDriverReadout()
+{
+  this->restoreSensorFrameTiming();
+  if (this->camera_sensor->id.PID == OV2640_PID)
+    this->camera_sensor->set_reg(this->camera_sensor, 0x111, 0xff, this->driverClkrc);
+  this->timingBaseline.valid = false;
+}
+
+bool CameraManager::decodeLumaGrid(const camera_fb_t *fb, LumaGrid &grid)
+{
+  if (fb == nullptr || fb->format != PIXFORMAT_JPEG)
+    return false;
+
+  std::lock_guard lock(this->dcDecoderMutex);
+  if (this->dcDecoder.decode(fb->buf, fb->len, grid))
+    return true;
+
+  // validation normally drops these before they get here, count the ones it let through
+  if (this->dcDecoder.getLastError() != JpegError::None)
+    this->jpegStats.record(JpegCheck{this->dcDecoder.getLastError(), 0, 0}, fb->len);
+  return false;
+}
+
+bool CameraManager::isStreaming() const
+{
+  return esp_timer_get_time() - this->lastFrameTimestampUs.load() < STREAMING_IDLE_US;
+}
+
+bool CameraManager::captureLumaGrid(LumaGrid &grid)
+{
+  // acquireFrame() serves a single waiting task
+  std::lock_guard requestLock(this->lumaRequestMutex);
+
+  if (this->isStreaming())
+  {
+    this->lumaRequestGrid = &grid;
+    this->lumaRequestResult = false;
+    this->lumaRequester = xTaskGetCurrentTaskHandle();
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LUMA_REQUEST_TIMEOUT_MS)) > 0)
+      return this->lumaRequestResult;
+
+    // the stream went quiet, unless it took the request just now in which case the result is on its way
+    if (this->lumaRequester.exchange(nullptr) == nullptr)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      return this->lumaRequestResult;
+    }
+  }
+
+  // nothing is streaming, take a frame ourselves without counting it as a streamed one
+  for (int attempt = 0; attempt < LUMA_FILTER_MAX_FRAMES; attempt++)
+  {
+    camera_fb_t *fb = this->acquireRawFrame();
+    if (fb == nullptr)
+      return false;
+
+    if (this->lumaFrameFilter && !this->lumaFrameFilter(fb))
+    {
+      this->releaseFrame(fb);
+      continue;
+    }
+
+    const bool decoded = this->decodeLumaGrid(fb, grid);
+    this->releaseFrame(fb);
+    return decoded;
+  }
+  return false;
+}
+
+int CameraManager::getMaxExposureLines() const
+{
+  if (this->camera_sensor == nullptr)
+    return 0;
+
+  // exposure longer than the frame stretches the frame, on the OV2640 we know how long that is
+  if (this->camera_sensor->id.PID == OV2640_PID)
+  {
+    const int fll = this->camera_sensor->get_reg(this->camera_sensor, 0x146, 0xff) |
+                    (this->camera_sensor->get_reg(this->camera_sensor, 0x147, 0xff) << 8);
+    return std::min(MAX_AEC_VALUE, ov2640FrameLines(this->camera_sensor->status.framesize) + fll);
+  }
+  return MAX_AEC_VALUE;
+}
+
+bool CameraManager::setManualExposure(const int aec_value, const int agc_gain)
+{
+  if (this->camera_sensor == nullptr)
+    return false;
+
+  this->aecValue = std::clamp(aec_value, 0, MAX_AEC_VALUE);
+  if (!this->applyExposure())
+    return false;
+
+  const int gain = std::clamp(agc_gain, 0, MAX_AGC_GAIN);
+  if (gain != this->agcGain && this->camera_sensor->set_agc_gain(this->camera_sensor, gain) != 0)
+    return false;
+  this->agcGain = gain;
+  return true;
+}
+
+void CameraManager::setFullFrameExposure(const bool enabled)
+{
+  this->fullFrameExposure = enabled;
+  this->applyExposure();
+}
+
+bool CameraManager::applyExposure()
+{
+  if (this->camera_sensor == nullptr)
+    return false;
+
+  // with a strobed illuminator every row has to be integrating while the LED fires,
+  // the light pulse sets the effective exposure and aecValue only sizes that pulse
+  const int lines = this->fullFrameExposure ? this->getMaxExposureLines() : this->aecValue;
+  if (lines == this->sensorAecValue)
+    return true;
+
+  if (this->camera_sensor->set_aec_value(this->camera_sensor, lines) != 0)
+    return false;
+  this->sensorAecValue = lines;
+  return true;
+}
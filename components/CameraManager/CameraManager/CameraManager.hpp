@@ -6,24 +6,107 @@
 #include "esp_camera.h"
 #include "driver/gpio.h"
 #include "esp_psram.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
 
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include <StateManager.hpp>
 #include <ProjectConfig.hpp>
+#include <JpegValidator.hpp>
+#include <JpegDcDecoder.hpp>
 
 #define OV5640_XCLK_FREQ_HZ CONFIG_CAMERA_WIFI_XCLK_FREQ
 
+// manual exposure / gain ranges of the esp32-camera sensor API
+constexpr int MAX_AEC_VALUE = 1200;
+constexpr int MAX_AGC_GAIN = 30;
+
+struct XclkProbeResult
+{
+  int xclk_freq_hz;
+  bool initialized;
+  uint32_t frames;
+  uint32_t corrupt_frames;
+  uint32_t timeouts;
+  float fps;
+};
+
+// sensor timing registers as the driver left them, restored when we stop throttling the sensor
+struct SensorTimingBaseline
+{
+  bool valid;
+  uint8_t clkrc;  // OV2640 CLKRC
+  uint16_t lines; // OV2640 FLL / OV5640 VTS
+};
+
 class CameraManager
 {
 private:
-  sensor_t *camera_sensor;
+  sensor_t *camera_sensor = nullptr;
   std::shared_ptr<ProjectConfig> projectConfig;
   QueueHandle_t eventQueue;
   camera_config_t config;
 
+  // non-zero while the driver is being re-initialized or measured, streams get no frames meanwhile.
+  // A count, a measurement inside a re-initialization must not unblock the streams early
+  std::atomic<int> streamBlocks{0};
+  std::atomic<int> framesInFlight{0};
+
+  // 0 means no cap, the streaming paths pace themselves at min(their own rate, cap)
+  std::atomic<int> frameRateCap{0};
+  // rate asked for by the consumer (UVC host), 0 if it didn't ask for anything
+  std::atomic<int> requestedFrameRate{0};
+
+  // sensor-side frame timing, see applySensorFrameTiming()
+  SensorTimingBaseline timingBaseline{};
+  float nativeFps = 0.0f;
+  framesize_t nativeFpsFramesize = FRAMESIZE_INVALID;
+  int nativeFpsXclk = 0;
+  bool nativeFpsHighSpeed = false;
+  int sensorFrameRate = 0;
+  std::mutex timingMutex;
+
+  bool highSpeedMode = false;
+  uint8_t driverClkrc = 0;
+  // smoothed rate at which the streaming paths actually get frames
+  std::atomic<float> measuredFps{0.0f};
+  std::atomic<int64_t> lastFrameTimestampUs{0};
+  // frames handed to the streaming paths and their size after trimming
+  std::atomic<uint32_t> framesDelivered{0};
+  std::atomic<uint64_t> bytesDelivered{0};
+  std::atomic<uint32_t> lastFrameBytes{0};
+  // the driver had no frame for us within its timeout
+  std::atomic<uint32_t> captureFailures{0};
+
+  JpegValidationStats jpegStats;
+
+  // DC-only decoder for frame statistics, its tables are reused between frames
+  JpegDcDecoder dcDecoder;
+  std::mutex dcDecoderMutex;
+  // captureLumaGrid() waiting on the stream, see acquireFrame()
+  std::mutex lumaRequestMutex;
+  std::atomic<TaskHandle_t> lumaRequester{nullptr};
+  LumaGrid *lumaRequestGrid = nullptr;
+  bool lumaRequestResult = false;
+  // frames captureLumaGrid() may measure, set once at startup
+  std::function<bool(const camera_fb_t *)> lumaFrameFilter;
+
+  // manual exposure and gain, re-applied whenever the sensor gets set up again
+  int aecValue = 300;
+  int agcGain = 2;
+  // exposure actually programmed, differs from aecValue while fullFrameExposure is on
+  int sensorAecValue = 300;
+  bool fullFrameExposure = false;
+
+  // clock we're meant to run at, thermal throttling may temporarily run below it
+  int nominalXclkFreqHz = 0;
+
 public:
   CameraManager(std::shared_ptr<ProjectConfig> projectConfig, QueueHandle_t eventQueue);
   int setCameraResolution(framesize_t frameSize);
@@ -32,11 +115,85 @@ public:
   int setHFlip(int direction);
   int setVieWindow(int offsetX, int offsetY, int outputX, int outputY);
 
+  // frame access used by the streaming paths, returns nullptr while the camera is being reconfigured
+  // or when the frame failed validation, valid frames come back trimmed to their EOI
+  camera_fb_t *acquireFrame();
+  void releaseFrame(camera_fb_t *fb);
+
+  // XCLK calibration, re-initializes the driver at the given clock and measures it for duration_ms
+  XclkProbeResult probeXclk(int xclk_freq_hz, int duration_ms);
+  bool applyXclk(int xclk_freq_hz);
+  int getXclkFrequency() const { return config.xclk_freq_hz; }
+  uint16_t getSensorPID() const;
+
+  // thermal throttling
+  void setFrameRateCap(int fps);
+  int getFrameRateCap() const { return frameRateCap.load(); }
+
+  // frame rate the consumer asked for, programmed into the sensor's own frame timing
+  // so we don't capture frames just to throw them away
+  void setRequestedFrameRate(int fps);
+  // min(requested, cap), 0 if neither is set
+  int getTargetFrameRate() const;
+  // rate the sensor timing is currently programmed for, 0 when free-running
+  int getSensorFrameRate() const { return sensorFrameRate; }
+
+  // high frame rate readout (faster pixel clock over the binned/CIF readout) for small eye ROIs
+  bool setHighSpeedMode(bool enabled);
+  // what a stream start negotiated: size, readout mode and rate, applied with a single resolution change
+  int setStreamFormat(framesize_t frameSize, bool highSpeed, int fps);
+  bool isHighSpeedMode() const { return highSpeedMode; }
+
+  float getMeasuredFps() const { return measuredFps.load(); }
+  const JpegValidationStats &getJpegStats() const { return jpegStats; }
+  uint32_t getFramesDelivered() const { return framesDelivered.load(); }
+  uint64_t getBytesDelivered() const { return bytesDelivered.load(); }
+  uint32_t getLastFrameBytes() const { return lastFrameBytes.load(); }
+  uint32_t getCaptureFailures() const { return captureFailures.load(); }
+  float getNativeFps() const { return nativeFps; }
+  framesize_t getFrameSize() const { return camera_sensor ? camera_sensor->status.framesize : FRAMESIZE_INVALID; }
+  bool throttleXclk(int xclk_freq_hz);
+  bool restoreXclk();
+  bool isXclkThrottled() const { return this->camera_sensor != nullptr && config.xclk_freq_hz != nominalXclkFreqHz; }
+
+  // 1/8 scale luminance of a frame, straight from the JPEG DC coefficients
+  bool decodeLumaGrid(const camera_fb_t *fb, LumaGrid &grid);
+  // decodes the next streamed frame, or grabs one itself when nothing is streaming
+  bool captureLumaGrid(LumaGrid &grid);
+  // restricts captureLumaGrid() to frames the filter accepts, e.g. only the lit ones of an LED pattern
+  void setLumaFrameFilter(std::function<bool(const camera_fb_t *)> filter) { lumaFrameFilter = std::move(filter); }
+  // true while a streaming path has been getting frames recently
+  bool isStreaming() const;
+
+  // manual exposure in sensor lines (0-1200) and analog gain step (0-30)
+  bool setManualExposure(int aec_value, int agc_gain);
+  int getExposureValue() const { return aecValue; }
+  int getGainValue() const { return agcGain; }
+  // longest exposure that still fits in the current frame timing
+  int getMaxExposureLines() const;
+  // keeps the sensor integrating for the whole frame, for the strobed illuminator
+  void setFullFrameExposure(bool enabled);
+
 private:
   void loadConfigData();
   void setupCameraPinout();
   void setupCameraSensor();
   void setupBasicResolution();
+  bool reinitialize(int xclk_freq_hz);
+  bool restartDriver(int xclk_freq_hz);
+  camera_fb_t *acquireRawFrame();
+  bool applyExposure();
+  // false if a stream still holds a frame after waiting for it, the block stays either way
+  bool blockStreams();
+  void unblockStreams();
+
+  void applySensorFrameTiming();
+  void applyReadoutMode();
+  void restoreDriverReadout();
+  void trackFrame(const camera_fb_t *fb);
+  void resetSensorFrameTiming();
+  void restoreSensorFrameTiming();
+  float measureNativeFps();
 };
 
 #endif // CAMERAMANAGER_HPP
\ No newline at end of file
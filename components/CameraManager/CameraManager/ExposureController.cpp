@@ -0,0 +1,279 @@
+#include "ExposureController.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const char *EXPOSURE_CONTROLLER_TAG = "[EXPOSURE_CONTROLLER]";
+
+#if CONFIG_CAMERA_AUTO_EXPOSURE
+static constexpr int UPDATE_INTERVAL_MS = CONFIG_CAMERA_AUTO_EXPOSURE_INTERVAL_MS;
+static constexpr float TOLERANCE = CONFIG_CAMERA_AUTO_EXPOSURE_TOLERANCE;
+static constexpr float MAX_STEP = CONFIG_CAMERA_AUTO_EXPOSURE_MAX_STEP_PERCENT / 100.0f;
+static constexpr int MAX_GAIN = CONFIG_CAMERA_AUTO_EXPOSURE_MAX_GAIN;
+static constexpr int MIN_LED_DUTY = CONFIG_CAMERA_AUTO_EXPOSURE_MIN_LED_DUTY;
+#else
+static constexpr int UPDATE_INTERVAL_MS = 100;
+static constexpr float TOLERANCE = 8.0f;
+static constexpr float MAX_STEP = 0.1f;
+static constexpr int MAX_GAIN = 16;
+static constexpr int MIN_LED_DUTY = 10;
+#endif
+
+// shortest exposure we'll go to, below a few lines the OV2640 starts banding
+static constexpr int MIN_AEC_VALUE = 4;
+// a p95 this high means a good part of the skin is about to clip, don't push further
+static constexpr uint8_t CLIP_LEVEL = 250;
+
+const char *exposureStateToString(const ExposureState state)
+{
+  switch (state)
+  {
+  case ExposureState::Disabled:
+    return "disabled";
+  case ExposureState::Idle:
+    return "idle";
+  case ExposureState::Converging:
+    return "converging";
+  case ExposureState::Converged:
+    return "converged";
+  case ExposureState::Limited:
+    return "limited";
+  }
+  return "unknown";
+}
+
+ExposureController::ExposureController(std::shared_ptr<CameraManager> cameraManager,
+                                       std::shared_ptr<LEDManager> ledManager,
+                                       std::shared_ptr<ProjectConfig> projectConfig)
+    : cameraManager(cameraManager), ledManager(ledManager), projectConfig(projectConfig)
+{
+  this->status.state = ExposureState::Disabled;
+  this->status.ledDuty = -1;
+}
+
+void ExposureController::start()
+{
+#if CONFIG_CAMERA_AUTO_EXPOSURE
+  const auto &cameraConfig = this->projectConfig->getCameraConfig();
+  this->configure(cameraConfig.auto_exposure, cameraConfig.exposure_target, cameraConfig.exposure_led);
+
+  if (this->task == nullptr)
+  {
+    xTaskCreate(&ExposureController::taskEntry, "ExposureControlTask", 3072, this, 1, &this->task);
+  }
+#else
+  ESP_LOGI(EXPOSURE_CONTROLLER_TAG, "Auto exposure disabled by Kconfig");
+#endif
+}
+
+void ExposureController::configure(const bool enabled, const uint8_t target, const bool useLed)
+{
+  std::lock_guard lock(this->mutex);
+  const bool wasEnabled = this->status.enabled;
+  if (enabled && !wasEnabled)
+  {
+    // the fixed exposure the unit runs at without the loop, put back when it's turned off
+    this->fixedAecValue = this->cameraManager->getExposureValue();
+    this->fixedAgcGain = this->cameraManager->getGainValue();
+  }
+  else if (!enabled && wasEnabled && this->fixedAecValue >= 0)
+  {
+    this->cameraManager->setManualExposure(this->fixedAecValue, this->fixedAgcGain);
+    ESP_LOGI(EXPOSURE_CONTROLLER_TAG, "Exposure back to aec %d, gain %d", this->fixedAecValue, this->fixedAgcGain);
+    this->fixedAecValue = -1;
+  }
+
+  this->status.enabled = enabled;
+  this->status.target = target;
+  this->status.useLed = useLed;
+
+  if (enabled && useLed && this->ledManager)
+  {
+    if (this->status.ledDuty < 0)
+    {
+      // start from the configured duty, it's the brightest the loop may go
+      this->status.ledDuty = this->projectConfig->getDeviceConfig().led_external_pwm_duty_cycle;
+      if (!this->ledManager->isExternalLEDRegulated())
+        this->ledManager->setExternalLEDDutyOverride(this->status.ledDuty);
+    }
+  }
+  else if (this->status.ledDuty >= 0)
+  {
+    this->status.ledDuty = -1;
+    if (this->ledManager && !this->ledManager->isExternalLEDRegulated())
+      this->ledManager->clearExternalLEDDutyOverride();
+  }
+
+  this->convergeStartUs = esp_timer_get_time();
+  this->status.state = enabled ? ExposureState::Converging : ExposureState::Disabled;
+  ESP_LOGI(EXPOSURE_CONTROLLER_TAG, "Auto exposure %s, target %u, LED %s", enabled ? "on" : "off", target,
+           useLed ? "on" : "off");
+}
+
+ExposureStatus ExposureController::getStatus()
+{
+  std::lock_guard lock(this->mutex);
+  this->status.aecValue = this->cameraManager->getExposureValue();
+  this->status.agcGain = this->cameraManager->getGainValue();
+  return this->status;
+}
+
+void ExposureController::taskEntry(void *arg)
+{
+  static_cast<ExposureController *>(arg)->run();
+}
+
+void ExposureController::run()
+{
+  while (true)
+  {
+    this->update();
+    vTaskDelay(pdMS_TO_TICKS(UPDATE_INTERVAL_MS));
+  }
+}
+
+void ExposureController::setState(const ExposureState next)
+{
+  const ExposureState current = this->status.state;
+  if (next == current)
+    return;
+
+  const bool wasSettling = current == ExposureState::Converging || current == ExposureState::Limited;
+  if (next == ExposureState::Converging && !wasSettling)
+  {
+    this->convergeStartUs = esp_timer_get_time();
+  }
+  else if (next == ExposureState::Converged && wasSettling)
+  {
+    this->status.lastConvergenceMs = static_cast<uint32_t>((esp_timer_get_time() - this->convergeStartUs) / 1000);
+    this->status.convergences++;
+    ESP_LOGI(EXPOSURE_CONTROLLER_TAG, "Converged in %lu ms, aec %d, gain %d, led %d",
+             static_cast<unsigned long>(this->status.lastConvergenceMs), this->cameraManager->getExposureValue(),
+             this->cameraManager->getGainValue(), this->status.ledDuty);
+  }
+  this->status.state = next;
+}
+
+void ExposureController::update()
+{
+  {
+    std::lock_guard lock(this->mutex);
+    if (!this->status.enabled)
+      return;
+
+    if (!this->cameraManager->isStreaming())
+    {
+      this->setState(ExposureState::Idle);
+      return;
+    }
+  }
+
+  // measured outside the lock, waiting on the stream for a frame shouldn't block the commands
+  LumaGrid grid;
+  if (!this->cameraManager->captureLumaGrid(grid))
+    return;
+  const LumaStats stats = computeLumaStats(grid);
+
+  std::lock_guard lock(this->mutex);
+  if (!this->status.enabled)
+    return;
+
+  this->status.mean = stats.mean;
+  this->status.p95 = stats.p95;
+
+  // the configured duty is the ceiling, follow it if it was lowered underneath us
+  if (this->ledLeverAvailable())
+  {
+    const int ceiling = this->projectConfig->getDeviceConfig().led_external_pwm_duty_cycle;
+    if (this->status.ledDuty > ceiling)
+    {
+      this->status.ledDuty = ceiling;
+      this->ledManager->setExternalLEDDutyOverride(ceiling);
+    }
+  }
+
+  const float target = this->status.target;
+  const float error = std::fabs(target - stats.mean);
+  // twice the tolerance to leave converged state, so noise around the edge doesn't toggle it
+  const float band = this->status.state == ExposureState::Converged ? TOLERANCE * 2.0f : TOLERANCE;
+  if (error <= band)
+  {
+    this->setState(ExposureState::Converged);
+    return;
+  }
+
+  float ratio = target / std::max(stats.mean, 1.0f);
+  if (ratio > 1.0f && stats.p95 >= CLIP_LEVEL)
+  {
+    this->setState(ExposureState::Limited);
+    return;
+  }
+  ratio = std::clamp(ratio, 1.0f / (1.0f + MAX_STEP), 1.0f + MAX_STEP);
+
+  const bool changed = ratio > 1.0f ? this->brighten(ratio) : this->darken(ratio);
+  if (changed)
+    this->status.adjustments++;
+  this->setState(changed ? ExposureState::Converging : ExposureState::Limited);
+}
+
+// a strobed LED is always fully on for its pulse, the exposure lever sizes the pulse instead.
+// a regulated one belongs to the current loop
+bool ExposureController::ledLeverAvailable() const
+{
+  return this->status.ledDuty >= 0 && !this->ledManager->isExternalLEDDetached() &&
+         !this->ledManager->isExternalLEDRegulated();
+}
+
+// brighter: more light first, then longer exposure, gain only as the last resort since it's all noise
+bool ExposureController::brighten(const float ratio)
+{
+  if (this->ledLeverAvailable())
+  {
+    const int ceiling = this->projectConfig->getDeviceConfig().led_external_pwm_duty_cycle;
+    if (this->status.ledDuty < ceiling)
+    {
+      const int duty = static_cast<int>(std::lround(this->status.ledDuty * ratio));
+      this->status.ledDuty = std::min(ceiling, std::max(this->status.ledDuty + 1, duty));
+      this->ledManager->setExternalLEDDutyOverride(this->status.ledDuty);
+      return true;
+    }
+  }
+
+  const int aec = this->cameraManager->getExposureValue();
+  const int gain = this->cameraManager->getGainValue();
+  const int maxAec = this->cameraManager->getMaxExposureLines();
+  if (aec < maxAec)
+  {
+    const int next = std::min(maxAec, std::max(aec + 1, static_cast<int>(std::lround(aec * ratio))));
+    return this->cameraManager->setManualExposure(next, gain);
+  }
+
+  if (gain < MAX_GAIN)
+    return this->cameraManager->setManualExposure(aec, gain + 1);
+
+  return false;
+}
+
+// darker: the other way around, drop the gain, then the exposure, and dim the LED last
+bool ExposureController::darken(const float ratio)
+{
+  const int aec = this->cameraManager->getExposureValue();
+  const int gain = this->cameraManager->getGainValue();
+  if (gain > 0)
+    return this->cameraManager->setManualExposure(aec, gain - 1);
+
+  if (aec > MIN_AEC_VALUE)
+  {
+    const int next = std::max(MIN_AEC_VALUE, std::min(aec - 1, static_cast<int>(std::lround(aec * ratio))));
+    return this->cameraManager->setManualExposure(next, gain);
+  }
+
+  if (this->ledLeverAvailable() && this->status.ledDuty > MIN_LED_DUTY)
+  {
+    const int duty = static_cast<int>(std::lround(this->status.ledDuty * ratio));
+    this->status.ledDuty = std::max(MIN_LED_DUTY, std::min(this->status.ledDuty - 1, duty));
+    this->ledManager->setExternalLEDDutyOverride(this->status.ledDuty);
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef EXPOSURECONTROLLER_HPP
+#define EXPOSURECONTROLLER_HPP
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include <memory>
+#include <mutex>
+#include <CameraManager.hpp>
+#include <LEDManager.hpp>
+#include <ProjectConfig.hpp>
+
+enum class ExposureState
+{
+  Disabled,
+  // no frames are being streamed, nothing to measure
+  Idle,
+  Converging,
+  Converged,
+  // every lever is at its limit and the target still isn't reached
+  Limited,
+};
+
+const char *exposureStateToString(ExposureState state);
+
+struct ExposureStatus
+{
+  ExposureState state;
+  bool enabled;
+  uint8_t target;
+  bool useLed;
+  float mean;
+  uint8_t p95;
+  int aecValue;
+  int agcGain;
+  int ledDuty; // -1 when the loop isn't driving the LED
+  uint32_t adjustments;
+  uint32_t convergences;
+  // how long the last converging phase took
+  uint32_t lastConvergenceMs;
+};
+
+// Firmware side AE/AGC for IR illuminated eyes. The sensor's own AEC meters for visible light scenes and
+// pumps with the IR LED, so it stays off and this loop drives the manual exposure and gain instead,
+// from the DC luminance of the frames that are being streamed anyway.
+class ExposureController
+{
+public:
+  ExposureController(std::shared_ptr<CameraManager> cameraManager,
+                     std::shared_ptr<LEDManager> ledManager,
+                     std::shared_ptr<ProjectConfig> projectConfig);
+
+  // picks the settings up from the camera config and starts the loop
+  void start();
+  void configure(bool enabled, uint8_t target, bool useLed);
+  ExposureStatus getStatus();
+
+private:
+  static void taskEntry(void *arg);
+  void run();
+  void update();
+  bool ledLeverAvailable() const;
+  bool brighten(float ratio);
+  bool darken(float ratio);
+  void setState(ExposureState next);
+
+  std::shared_ptr<CameraManager> cameraManager;
+  std::shared_ptr<LEDManager> ledManager;
+  std::shared_ptr<ProjectConfig> projectConfig;
+  TaskHandle_t task = nullptr;
+
+  // guards the settings and the status, the loop and the commands run on different tasks
+  std::mutex mutex;
+  ExposureStatus status{};
+  int64_t convergeStartUs = 0;
+  // sensor exposure and gain from before the loop took over, -1 while it's off
+  int fixedAecValue = -1;
+  int fixedAgcGain = 0;
+};
+
+#endif // EXPOSURECONTROLLER_HPP
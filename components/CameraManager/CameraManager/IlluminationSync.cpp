@@ -0,0 +1,438 @@
+#include "IlluminationSync.hpp"
+#include "esp_timer.h"
+#include <algorithm>
+
+static const char *ILLUMINATION_SYNC_TAG = "[ILLUMINATION_SYNC]";
+
+static constexpr int REFRESH_INTERVAL_MS = 100;
+// no VSYNC for this long while frames keep coming means we aren't seeing the sensor's timing
+static constexpr int64_t VSYNC_TIMEOUT_US = 1000000;
+
+#if CONFIG_LED_STROBE
+static constexpr uint32_t STROBE_OFFSET_US = CONFIG_LED_STROBE_OFFSET_US;
+static constexpr uint32_t STROBE_MIN_PULSE_US = CONFIG_LED_STROBE_MIN_PULSE_US;
+static constexpr uint32_t STROBE_MAX_PULSE_US = CONFIG_LED_STROBE_MAX_PULSE_US;
+static constexpr uint32_t STROBE_MAX_DUTY_PERCENT = CONFIG_LED_STROBE_MAX_DUTY_PERCENT;
+#else
+static constexpr uint32_t STROBE_OFFSET_US = 0;
+static constexpr uint32_t STROBE_MIN_PULSE_US = 100;
+static constexpr uint32_t STROBE_MAX_PULSE_US = 4000;
+static constexpr uint32_t STROBE_MAX_DUTY_PERCENT = 25;
+#endif
+
+const char *ledModeToString(const LedMode mode)
+{
+  switch (mode)
+  {
+  case LedMode::PWM:
+    return "pwm";
+  case LedMode::STROBE:
+    return "strobe";
+  case LedMode::PATTERN:
+    return "pattern";
+  }
+  return "unknown";
+}
+
+const char *frameLedStateToString(const FrameLedState state)
+{
+  switch (state)
+  {
+  case FrameLedState::Off:
+    return "off";
+  case FrameLedState::On:
+    return "on";
+  case FrameLedState::Unknown:
+    return "unknown";
+  }
+  return "unknown";
+}
+
+bool IlluminationSync::isValidPattern(const std::string &pattern)
+{
+  if (pattern.empty() || pattern.size() > MAX_LED_PATTERN_LENGTH)
+    return false;
+  return std::all_of(pattern.begin(), pattern.end(), [](const char c)
+                     { return c == '0' || c == '1'; });
+}
+
+IlluminationSync::IlluminationSync(std::shared_ptr<CameraManager> cameraManager,
+                                   std::shared_ptr<LEDManager> ledManager,
+                                   std::shared_ptr<MonitoringManager> monitoringManager,
+                                   std::shared_ptr<ProjectConfig> projectConfig)
+    : cameraManager(cameraManager), ledManager(ledManager), monitoringManager(monitoringManager),
+      projectConfig(projectConfig), ledPin(ledManager->getExternalLEDPin()),
+      vsyncPin(static_cast<gpio_num_t>(CONFIG_VSYNC_GPIO_NUM)) {}
+
+void IlluminationSync::start()
+{
+#if CONFIG_LED_STROBE
+  if (this->timer == nullptr)
+  {
+    // free running 1 MHz counter, VSYNC timestamps and pulse edges are all in its microseconds
+    gptimer_config_t timerConfig = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    if (const auto err = gptimer_new_timer(&timerConfig, &this->timer); err != ESP_OK)
+    {
+      ESP_LOGE(ILLUMINATION_SYNC_TAG, "Failed to create strobe timer: %s", esp_err_to_name(err));
+      this->timer = nullptr;
+      return;
+    }
+
+    gptimer_event_callbacks_t callbacks = {.on_alarm = &IlluminationSync::onAlarm};
+    ESP_ERROR_CHECK_WITHOUT_ABORT(gptimer_register_event_callbacks(this->timer, &callbacks, this));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(gptimer_enable(this->timer));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(gptimer_start(this->timer));
+  }
+
+  if (this->task == nullptr)
+  {
+    xTaskCreate(&IlluminationSync::taskEntry, "IlluminationTask", 3072, this, 2, &this->task);
+  }
+
+  // auto exposure has to look at the lit frames only, the dark ones would just push it to the limits
+  this->cameraManager->setLumaFrameFilter([this](const camera_fb_t *fb)
+                                          { return this->mode.load() != LedMode::PATTERN ||
+                                                   this->getFrameIllumination(fb).state == FrameLedState::On; });
+#endif
+
+  const auto &deviceConfig = this->projectConfig->getDeviceConfig();
+  this->setMode(deviceConfig.led_mode, deviceConfig.led_pattern);
+}
+
+bool IlluminationSync::setMode(const LedMode newMode, const std::string &newPattern)
+{
+  std::lock_guard lock(this->mutex);
+  if (newMode == LedMode::PATTERN && !isValidPattern(newPattern))
+  {
+    ESP_LOGE(ILLUMINATION_SYNC_TAG, "Invalid LED pattern: %s", newPattern.c_str());
+    return false;
+  }
+
+  if (newMode != LedMode::PWM)
+  {
+    if (!this->strobing.load() && !this->enableStrobe())
+      return false;
+  }
+  else
+  {
+    this->disableStrobe();
+  }
+
+  // plain strobe is a pattern that lights every frame
+  uint32_t bits = 1;
+  uint32_t length = 1;
+  if (newMode == LedMode::PATTERN)
+  {
+    bits = 0;
+    length = newPattern.size();
+    for (size_t i = 0; i < length; i++)
+    {
+      if (newPattern[i] == '1')
+        bits |= 1u << i;
+    }
+  }
+  this->pattern = bits | (length << 16);
+
+  this->mode = newMode;
+  this->fault = nullptr;
+  ESP_LOGI(ILLUMINATION_SYNC_TAG, "LED mode: %s%s%s", ledModeToString(newMode), newMode == LedMode::PATTERN ? " " : "",
+           newMode == LedMode::PATTERN ? newPattern.c_str() : "");
+  return true;
+}
+
+bool IlluminationSync::enableStrobe()
+{
+#if CONFIG_LED_STROBE
+  if (this->timer == nullptr)
+  {
+    ESP_LOGE(ILLUMINATION_SYNC_TAG, "Strobe timer not available");
+    return false;
+  }
+
+  if (!this->ledManager->detachExternalLED())
+    return false;
+  this->cameraManager->setFullFrameExposure(true);
+
+  this->phase = PulsePhase::Idle;
+  this->pulseUs = 0;
+  this->framePeriodUs = 0;
+  this->lastVsyncEdges = this->vsyncEdges.load();
+  this->lastVsyncSeenUs = esp_timer_get_time();
+
+  // the camera driver may have installed the service already
+  if (const auto err = gpio_install_isr_service(0); err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+  {
+    ESP_LOGE(ILLUMINATION_SYNC_TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(err));
+    this->cameraManager->setFullFrameExposure(false);
+    this->ledManager->attachExternalLED();
+    return false;
+  }
+  gpio_set_intr_type(this->vsyncPin, GPIO_INTR_POSEDGE);
+  gpio_isr_handler_add(this->vsyncPin, &IlluminationSync::vsyncIsr, this);
+  gpio_intr_enable(this->vsyncPin);
+
+  this->strobing = true;
+  return true;
+#else
+  ESP_LOGW(ILLUMINATION_SYNC_TAG, "Strobe mode not built in (CONFIG_LED_STROBE)");
+  return false;
+#endif
+}
+
+void IlluminationSync::disableStrobe()
+{
+#if CONFIG_LED_STROBE
+  if (!this->strobing.load())
+    return;
+
+  this->strobing = false;
+  gpio_intr_disable(this->vsyncPin);
+  gpio_isr_handler_remove(this->vsyncPin);
+  gpio_set_intr_type(this->vsyncPin, GPIO_INTR_DISABLE);
+
+  // let a pulse that's already scheduled run out before the pin goes back to the PWM
+  vTaskDelay(pdMS_TO_TICKS((STROBE_OFFSET_US + STROBE_MAX_PULSE_US) / 1000 + 2));
+  gpio_set_level(this->ledPin, 0);
+  this->phase = PulsePhase::Idle;
+
+  this->cameraManager->setFullFrameExposure(false);
+  this->ledManager->attachExternalLED();
+#endif
+}
+
+void IlluminationSync::trip(const char *reason)
+{
+  ESP_LOGE(ILLUMINATION_SYNC_TAG, "Strobe disabled: %s, falling back to PWM", reason);
+  this->disableStrobe();
+  // not persisted, the next boot tries again
+  this->mode = LedMode::PWM;
+  this->fault = reason;
+}
+
+void IlluminationSync::vsyncIsr(void *arg)
+{
+  auto *self = static_cast<IlluminationSync *>(arg);
+
+  uint64_t now = 0;
+  gptimer_get_raw_count(self->timer, &now);
+  const uint64_t period = now - self->lastVsyncCount;
+  self->lastVsyncCount = now;
+  if (period < 1000000)
+    self->framePeriodUs = static_cast<uint32_t>(period);
+
+  const uint32_t sequence = self->vsyncEdges.load() + 1;
+  const uint32_t patternState = self->pattern.load();
+  const uint32_t patternLength = std::max<uint32_t>(1, patternState >> 16);
+  const bool wanted = (patternState >> (sequence % patternLength)) & 1;
+
+  bool lit = false;
+  const uint32_t width = self->pulseUs.load();
+  // a regulator trip cuts the LED right away, refresh() only catches up with it on its next round
+  if (self->strobing.load() && wanted && width > 0 && !self->ledManager->isExternalLEDCut())
+  {
+    // never stack pulses, if the last one is still going this frame stays dark
+    if (self->phase.load() != PulsePhase::Idle)
+    {
+      self->skippedFrames++;
+    }
+    else
+    {
+      self->activePulseUs = width;
+      self->phase = PulsePhase::Waiting;
+      gptimer_alarm_config_t alarm = {};
+      alarm.alarm_count = now + STROBE_OFFSET_US + 1;
+      gptimer_set_alarm_action(self->timer, &alarm);
+      lit = true;
+    }
+  }
+
+  if (lit)
+    self->litFrames++;
+  else
+    self->darkFrames++;
+
+  // the pulse lands in the blanking after this VSYNC, so it lights the frame read out after it
+  FrameRecord &record = self->frameHistory[sequence % FRAME_HISTORY];
+  record.sequence.store(0, std::memory_order_release);
+  record.startUs = esp_timer_get_time();
+  record.lit = lit;
+  record.sequence.store(sequence, std::memory_order_release);
+  self->vsyncEdges.store(sequence);
+}
+
+bool IlluminationSync::onAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg)
+{
+  auto *self = static_cast<IlluminationSync *>(arg);
+
+  if (self->phase.load() == PulsePhase::Waiting && self->strobing.load() && !self->ledManager->isExternalLEDCut())
+  {
+    gpio_set_level(self->ledPin, 1);
+    self->phase = PulsePhase::On;
+    self->pulses++;
+
+    gptimer_alarm_config_t alarm = {};
+    alarm.alarm_count = edata->alarm_value + self->activePulseUs;
+    gptimer_set_alarm_action(timer, &alarm);
+    return false;
+  }
+
+  // end of the pulse, or the strobe got turned off while we were waiting
+  gpio_set_level(self->ledPin, 0);
+  self->phase = PulsePhase::Idle;
+  return false;
+}
+
+void IlluminationSync::taskEntry(void *arg)
+{
+  static_cast<IlluminationSync *>(arg)->run();
+}
+
+void IlluminationSync::run()
+{
+  while (true)
+  {
+    {
+      std::lock_guard lock(this->mutex);
+      this->refresh();
+    }
+    vTaskDelay(pdMS_TO_TICKS(REFRESH_INTERVAL_MS));
+  }
+}
+
+void IlluminationSync::refresh()
+{
+#if CONFIG_LED_STROBE
+  if (!this->strobing.load())
+    return;
+
+  const int64_t now = esp_timer_get_time();
+  if (const uint32_t edges = this->vsyncEdges.load(); edges != this->lastVsyncEdges)
+  {
+    this->lastVsyncEdges = edges;
+    this->lastVsyncSeenUs = now;
+  }
+  else if (this->cameraManager->isStreaming() && now - this->lastVsyncSeenUs > VSYNC_TIMEOUT_US)
+  {
+    this->trip("no VSYNC");
+    return;
+  }
+
+  // held dark until set_led_current re-arms the regulator
+  if (this->ledManager->isExternalLEDCut())
+  {
+    this->pulseUs = 0;
+    return;
+  }
+
+  const uint32_t period = this->framePeriodUs.load();
+  if (period == 0)
+    return;
+
+  // the exposure the sensor would have used, in time, becomes the pulse width
+  const int lines = std::max(1, this->cameraManager->getMaxExposureLines());
+  const float lineUs = static_cast<float>(period) / static_cast<float>(lines);
+  const auto wanted = static_cast<uint32_t>(static_cast<float>(this->cameraManager->getExposureValue()) * lineUs);
+
+  const uint32_t dutyCap = std::min<uint32_t>(STROBE_MAX_DUTY_PERCENT, this->ledManager->getExternalLEDDutyLimit());
+  const uint32_t cap = std::min(STROBE_MAX_PULSE_US, period * dutyCap / 100);
+  this->pulseUs = std::min(std::max(wanted, STROBE_MIN_PULSE_US), cap);
+
+#if CONFIG_MONITORING_LED_CURRENT && CONFIG_LED_STROBE_MAX_AVG_CURRENT_MA > 0
+  if (this->monitoringManager && this->monitoringManager->getCurrentMilliAmps() > CONFIG_LED_STROBE_MAX_AVG_CURRENT_MA)
+  {
+    this->trip("over current");
+  }
+#endif
+#endif
+}
+
+FrameIllumination IlluminationSync::getFrameIllumination(const camera_fb_t *fb) const
+{
+  FrameIllumination result{};
+  const LedMode currentMode = this->mode.load();
+  if (!this->strobing.load() || currentMode == LedMode::PWM)
+  {
+    // what's on the pin, auto exposure or a tripped regulator may be holding it at 0 whatever is configured
+    const bool on = this->ledManager->getEffectiveExternalLEDDuty() > 0;
+    result.state = on ? FrameLedState::On : FrameLedState::Off;
+    return result;
+  }
+
+  // the driver stamps a frame when it starts receiving it, right after the VSYNC the interrupt recorded.
+  // walk back from the newest VSYNC to the last one before that stamp
+  const int64_t frameUs = static_cast<int64_t>(fb->timestamp.tv_sec) * 1000000 + fb->timestamp.tv_usec;
+  const int64_t periodUs = this->framePeriodUs.load();
+  const uint32_t newest = this->vsyncEdges.load();
+  result.state = FrameLedState::Unknown;
+
+  // the oldest slots may be getting overwritten right now, leave them out
+  for (uint32_t age = 0; age < FRAME_HISTORY - 2 && age < newest; age++)
+  {
+    const uint32_t sequence = newest - age;
+    const FrameRecord &record = this->frameHistory[sequence % FRAME_HISTORY];
+    if (record.sequence.load(std::memory_order_acquire) != sequence)
+      break;
+    const int64_t startUs = record.startUs;
+    const bool lit = record.lit;
+    if (record.sequence.load(std::memory_order_acquire) != sequence)
+      break;
+
+    if (startUs > frameUs)
+      continue;
+
+    // more than half a frame after the VSYNC and it isn't the frame that VSYNC started
+    if (periodUs == 0 || frameUs - startUs < periodUs / 2)
+    {
+      result.state = lit ? FrameLedState::On : FrameLedState::Off;
+      result.sequence = sequence;
+    }
+    break;
+  }
+  return result;
+}
+
+IlluminationStatus IlluminationSync::getStatus()
+{
+  std::lock_guard lock(this->mutex);
+
+  IlluminationStatus status{};
+  status.mode = this->mode.load();
+  status.faulted = this->fault != nullptr;
+  status.fault = this->fault ? this->fault : "";
+  status.framePeriodUs = this->framePeriodUs.load();
+  status.pulseUs = this->strobing.load() ? this->pulseUs.load() : 0;
+  status.pulses = this->pulses.load();
+  status.skippedFrames = this->skippedFrames.load();
+  status.litFrames = this->litFrames.load();
+  status.darkFrames = this->darkFrames.load();
+
+  const uint32_t patternState = this->pattern.load();
+  const uint32_t patternLength = std::min<uint32_t>(MAX_LED_PATTERN_LENGTH, patternState >> 16);
+  uint32_t patternLit = 0;
+  for (uint32_t i = 0; i < patternLength; i++)
+  {
+    const bool bit = (patternState >> i) & 1;
+    status.pattern[i] = bit ? '1' : '0';
+    patternLit += bit;
+  }
+  status.pattern[patternLength] = '\0';
+
+  if (status.mode != LedMode::PWM)
+  {
+    // averaged over the pattern, the dark frames draw nothing
+    const float litShare = patternLength > 0 ? static_cast<float>(patternLit) / static_cast<float>(patternLength) : 1.0f;
+    status.dutyPercent = status.framePeriodUs > 0 ? 100.0f * status.pulseUs / status.framePeriodUs * litShare : 0.0f;
+  }
+  else
+  {
+    status.dutyPercent = this->ledManager->getEffectiveExternalLEDDuty();
+  }
+
+  status.currentMilliAmps = this->monitoringManager ? this->monitoringManager->getCurrentMilliAmps() : 0.0f;
+  status.peakMilliAmps = status.dutyPercent > 0.0f ? status.currentMilliAmps * 100.0f / status.dutyPercent : 0.0f;
+  return status;
+}
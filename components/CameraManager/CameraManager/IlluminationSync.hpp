@@ -0,0 +1,148 @@
+#pragma once
+#ifndef ILLUMINATIONSYNC_HPP
+#define ILLUMINATIONSYNC_HPP
+
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <CameraManager.hpp>
+#include <LEDManager.hpp>
+#include <MonitoringManager.hpp>
+#include <ProjectConfig.hpp>
+
+const char *ledModeToString(LedMode mode);
+
+// longest frame pattern, one bit per frame
+constexpr size_t MAX_LED_PATTERN_LENGTH = 16;
+
+enum class FrameLedState
+{
+  Off,
+  On,
+  // strobing, but the frame couldn't be matched to the VSYNC it was captured after
+  Unknown,
+};
+
+const char *frameLedStateToString(FrameLedState state);
+
+// what the LED was doing while a frame was being exposed
+struct FrameIllumination
+{
+  FrameLedState state;
+  // VSYNC count the frame started at, 0 if it couldn't be matched
+  uint32_t sequence;
+};
+
+struct IlluminationStatus
+{
+  LedMode mode;
+  // strobe turned itself off, over current or no VSYNC
+  bool faulted;
+  const char *fault;
+  uint32_t framePeriodUs;
+  uint32_t pulseUs;
+  uint32_t pulses;
+  // frames where the previous pulse was still running when VSYNC came, no new pulse was fired
+  uint32_t skippedFrames;
+  // frames the pattern lit and kept dark
+  uint32_t litFrames;
+  uint32_t darkFrames;
+  char pattern[MAX_LED_PATTERN_LENGTH + 1];
+  float dutyPercent;
+  float currentMilliAmps;
+  // measured average current divided by the duty, what the LED draws while it's on
+  float peakMilliAmps;
+};
+
+// Drives the external IR LED in step with the sensor instead of as a constant PWM.
+// VSYNC starts a one-shot hardware timer sequence per frame: wait for the offset, LED on, wait for the pulse
+// width, LED off. The sensor is kept integrating for the whole frame meanwhile, so the pulse alone decides
+// the exposure - less motion blur and the LED is dark through readout and blanking.
+class IlluminationSync
+{
+public:
+  IlluminationSync(std::shared_ptr<CameraManager> cameraManager,
+                   std::shared_ptr<LEDManager> ledManager,
+                   std::shared_ptr<MonitoringManager> monitoringManager,
+                   std::shared_ptr<ProjectConfig> projectConfig);
+
+  // sets up the timer and applies the stored LED mode
+  void start();
+  // pattern is only used by LedMode::PATTERN, '1' lit and '0' dark frames
+  bool setMode(LedMode mode, const std::string &pattern = "1");
+  LedMode getMode() const { return mode.load(); }
+  IlluminationStatus getStatus();
+
+  // matches a captured frame to the VSYNC it started at, cheap enough to call for every streamed frame
+  FrameIllumination getFrameIllumination(const camera_fb_t *fb) const;
+  static bool isValidPattern(const std::string &pattern);
+
+private:
+  enum class PulsePhase : uint8_t
+  {
+    Idle,
+    Waiting,
+    On,
+  };
+
+  // written by the VSYNC interrupt, the sequence goes in last so readers can tell a half written record
+  struct FrameRecord
+  {
+    int64_t startUs;
+    bool lit;
+    std::atomic<uint32_t> sequence;
+  };
+  static constexpr size_t FRAME_HISTORY = 8;
+
+  static void vsyncIsr(void *arg);
+  static bool onAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg);
+  static void taskEntry(void *arg);
+  void run();
+  void refresh();
+  bool enableStrobe();
+  void disableStrobe();
+  void trip(const char *reason);
+
+  std::shared_ptr<CameraManager> cameraManager;
+  std::shared_ptr<LEDManager> ledManager;
+  std::shared_ptr<MonitoringManager> monitoringManager;
+  std::shared_ptr<ProjectConfig> projectConfig;
+
+  gptimer_handle_t timer = nullptr;
+  TaskHandle_t task = nullptr;
+  gpio_num_t ledPin;
+  gpio_num_t vsyncPin;
+  std::mutex mutex;
+
+  std::atomic<LedMode> mode{LedMode::PWM};
+  const char *fault = nullptr;
+
+  // shared with the interrupts
+  std::atomic<bool> strobing{false};
+  std::atomic<PulsePhase> phase{PulsePhase::Idle};
+  std::atomic<uint32_t> pulseUs{0};
+  std::atomic<uint32_t> framePeriodUs{0};
+  std::atomic<uint32_t> pulses{0};
+  std::atomic<uint32_t> skippedFrames{0};
+  std::atomic<uint32_t> vsyncEdges{0};
+  std::atomic<uint32_t> litFrames{0};
+  std::atomic<uint32_t> darkFrames{0};
+  // pattern bits in the low half, pattern length in the high half
+  std::atomic<uint32_t> pattern{1u | (1u << 16)};
+  FrameRecord frameHistory[FRAME_HISTORY]{};
+  uint64_t lastVsyncCount = 0;
+  uint32_t activePulseUs = 0;
+
+  // VSYNC watchdog, see refresh()
+  uint32_t lastVsyncEdges = 0;
+  int64_t lastVsyncSeenUs = 0;
+};
+
+#endif // ILLUMINATIONSYNC_HPP
@@ -0,0 +1,191 @@
+#include "CommandExecutor.hpp"
+#include "CommandManager.hpp"
+#include <algorithm>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *COMMAND_EXECUTOR_TAG = "[COMMAND_EXECUTOR]";
+
+// the handlers used to run on the 6K serial and CDC task stacks
+static constexpr uint32_t COMMAND_EXECUTOR_STACK_SIZE = 1024 * 6;
+// above the transports (1), so a queued command runs as soon as the one before it is done
+static constexpr UBaseType_t COMMAND_EXECUTOR_PRIORITY = 2;
+
+const char *commandLaneToString(const CommandLane lane)
+{
+  switch (lane)
+  {
+  case CommandLane::Control:
+    return "control";
+  case CommandLane::Normal:
+    return "normal";
+  case CommandLane::Config:
+    return "config";
+  case CommandLane::Caller:
+    return "caller";
+  case CommandLane::Job:
+    return "job";
+  }
+  return "unknown";
+}
+
+bool CommandExecutor::start()
+{
+  // under the mutex, two transports may send their first command at once
+  if (this->task != nullptr)
+  {
+    return true;
+  }
+
+  this->ready = xSemaphoreCreateCounting(COMMAND_EXECUTOR_QUEUE_SIZE, 0);
+  if (this->ready == nullptr ||
+      xTaskCreate(&CommandExecutor::taskEntry, "CommandExecutorTask", COMMAND_EXECUTOR_STACK_SIZE, this,
+                  COMMAND_EXECUTOR_PRIORITY, &this->task) != pdPASS)
+  {
+    ESP_LOGE(COMMAND_EXECUTOR_TAG, "Failed to start the command executor");
+    if (this->ready != nullptr)
+    {
+      vSemaphoreDelete(this->ready);
+      this->ready = nullptr;
+    }
+    this->task = nullptr;
+    return false;
+  }
+  return true;
+}
+
+CommandResult CommandExecutor::run(const CommandEntry &entry, const nlohmann::json &payload)
+{
+  // a handler calling back into the executor would wait on itself
+  if (this->task != nullptr && xTaskGetCurrentTaskHandle() == this->task)
+  {
+    return this->manager.invoke(entry, payload);
+  }
+
+  Pending pending{
+      .lane = entry.lane,
+      .entry = &entry,
+      .payload = &payload,
+      .batch = nullptr,
+      .result = nullptr,
+      .done = nullptr,
+      .sequence = 0,
+      .queuedUs = 0,
+  };
+  return this->enqueue(pending);
+}
+
+CommandResult CommandExecutor::runBatch(const CommandLane lane, const std::function<CommandResult()> &batch)
+{
+  if (this->task != nullptr && xTaskGetCurrentTaskHandle() == this->task)
+  {
+    return batch();
+  }
+
+  Pending pending{
+      .lane = lane,
+      .entry = nullptr,
+      .payload = nullptr,
+      .batch = &batch,
+      .result = nullptr,
+      .done = nullptr,
+      .sequence = 0,
+      .queuedUs = 0,
+  };
+  return this->enqueue(pending);
+}
+
+CommandResult CommandExecutor::enqueue(Pending &pending)
+{
+  StaticSemaphore_t doneBuffer;
+  CommandResult result = CommandResult::getErrorResult("Command was not run");
+  pending.result = &result;
+  pending.queuedUs = esp_timer_get_time();
+
+  {
+    std::lock_guard lock(this->mutex);
+    if (!this->start())
+    {
+      return CommandResult::getErrorResult("Failed to start the command executor");
+    }
+    if (this->queued == this->queue.size())
+    {
+      this->stats.rejected++;
+      return CommandResult::getErrorResult("Too many commands waiting, try again");
+    }
+    pending.done = xSemaphoreCreateBinaryStatic(&doneBuffer);
+    pending.sequence = this->nextSequence++;
+    this->queue[this->queued++] = &pending;
+    this->stats.maxQueued = std::max(this->stats.maxQueued, this->queued);
+  }
+
+  xSemaphoreGive(this->ready);
+  xSemaphoreTake(pending.done, portMAX_DELAY);
+  vSemaphoreDelete(pending.done);
+  return result;
+}
+
+CommandExecutor::Pending *CommandExecutor::takeNext()
+{
+  std::lock_guard lock(this->mutex);
+  if (this->queued == 0)
+  {
+    return nullptr;
+  }
+
+  // a handful of entries at most, a scan is cheaper than keeping them ordered
+  const auto first = this->queue.begin();
+  const auto next = std::min_element(first, first + this->queued, [](const Pending *a, const Pending *b)
+                                     {
+    if (a->lane != b->lane)
+    {
+      return a->lane < b->lane;
+    }
+    // wraps after 4 billion commands, the difference still orders the few that are waiting
+    return static_cast<int32_t>(a->sequence - b->sequence) < 0; });
+
+  Pending *pending = *next;
+  *next = this->queue[--this->queued];
+  this->queue[this->queued] = nullptr;
+
+  const auto waitUs = static_cast<uint32_t>(esp_timer_get_time() - pending->queuedUs);
+  this->stats.lastWaitUs = waitUs;
+  this->stats.maxWaitUs = std::max(this->stats.maxWaitUs, waitUs);
+  return pending;
+}
+
+void CommandExecutor::taskEntry(void *arg)
+{
+  static_cast<CommandExecutor *>(arg)->loop();
+}
+
+void CommandExecutor::loop()
+{
+  while (true)
+  {
+    xSemaphoreTake(this->ready, portMAX_DELAY);
+    Pending *pending = this->takeNext();
+    if (pending == nullptr)
+    {
+      continue;
+    }
+
+    {
+      std::lock_guard running(this->runMutex);
+      *pending->result = pending->entry != nullptr ? this->manager.invoke(*pending->entry, *pending->payload)
+                                                   : (*pending->batch)();
+    }
+    {
+      std::lock_guard lock(this->mutex);
+      this->stats.executed++;
+    }
+    // the caller's stack frame may be gone right after this
+    xSemaphoreGive(pending->done);
+  }
+}
+
+CommandExecutorStats CommandExecutor::getStats()
+{
+  std::lock_guard lock(this->mutex);
+  return this->stats;
+}
@@ -0,0 +1,101 @@
+#ifndef COMMAND_EXECUTOR_HPP
+#define COMMAND_EXECUTOR_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <nlohmann-json.hpp>
+#include "CommandResult.hpp"
+
+class CommandManager;
+struct CommandEntry;
+
+// commands waiting for the executor at once, across all transports
+static constexpr size_t COMMAND_EXECUTOR_QUEUE_SIZE = 8;
+
+// Which way a command is run, the first three are the executor's priorities, most urgent first
+enum class CommandLane : uint8_t
+{
+  // real-time controls (LED, exposure), they go ahead of anything else waiting
+  Control,
+  Normal,
+  // config writes, they can wait for the rest
+  Config,
+  // on the calling task, for commands that only touch state with a lock of its own
+  Caller,
+  // handed to CommandJobs, see there
+  Job,
+};
+
+const char *commandLaneToString(CommandLane lane);
+
+struct CommandExecutorStats
+{
+  uint32_t executed;
+  uint32_t rejected;
+  // time spent queued, from the last command and the worst since boot
+  uint32_t lastWaitUs;
+  uint32_t maxWaitUs;
+  size_t maxQueued;
+};
+
+// Runs the commands of every transport (serial, CDC, REST) one at a time on a single task, so handlers never race
+// each other over the config, the LED or the camera. The transports only parse and wait in line, in order of
+// the command's lane and then of arrival.
+class CommandExecutor
+{
+public:
+  explicit CommandExecutor(const CommandManager &manager) : manager(manager) {}
+
+  // blocks the calling task until the command has run, the executor task is only started by the first one
+  CommandResult run(const CommandEntry &entry, const nlohmann::json &payload);
+  // the same for several commands that must not have another channel's command land between them, they're one
+  // entry in the queue and the batch calls the handlers itself
+  CommandResult runBatch(CommandLane lane, const std::function<CommandResult()> &batch);
+  // held by the executor while a command runs, a job's short steps that touch the camera or the config take it
+  // too so they never run alongside a command. Never across anything that takes seconds, every command waits on it.
+  // Not for the executor's own handlers, they already hold it
+  std::unique_lock<std::mutex> exclusive() { return std::unique_lock(this->runMutex); }
+  CommandExecutorStats getStats();
+
+private:
+  struct Pending
+  {
+    CommandLane lane;
+    // a single command, or a batch when entry is nullptr
+    const CommandEntry *entry;
+    const nlohmann::json *payload;
+    const std::function<CommandResult()> *batch;
+    CommandResult *result;
+    SemaphoreHandle_t done;
+    uint32_t sequence;
+    int64_t queuedUs;
+  };
+
+  static void taskEntry(void *arg);
+  void loop();
+  bool start();
+  // queues the command and blocks until it ran, its result or why it couldn't be queued
+  CommandResult enqueue(Pending &pending);
+  // the most urgent and then oldest one, nullptr when none is waiting
+  Pending *takeNext();
+
+  const CommandManager &manager;
+  TaskHandle_t task = nullptr;
+  // counts the waiting commands, the task sleeps on it
+  SemaphoreHandle_t ready = nullptr;
+
+  std::mutex mutex;
+  std::mutex runMutex;
+  // points into the waiting callers' stacks, they can't return before their command ran
+  std::array<Pending *, COMMAND_EXECUTOR_QUEUE_SIZE> queue{};
+  size_t queued = 0;
+  uint32_t nextSequence = 0;
+  CommandExecutorStats stats{};
+};
+
+#endif
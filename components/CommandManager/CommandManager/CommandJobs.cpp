@@ -0,0 +1,205 @@
+#include "CommandJobs.hpp"
+#include "CommandManager.hpp"
+#include <algorithm>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *COMMAND_JOBS_TAG = "[COMMAND_JOBS]";
+
+// scan results and the XCLK sweep build their JSON on this stack
+static constexpr uint32_t COMMAND_JOB_STACK_SIZE = 1024 * 6;
+// how often a waiting get_job looks at the job again
+static constexpr TickType_t COMMAND_JOB_POLL_INTERVAL = pdMS_TO_TICKS(50);
+
+const char *jobStateToString(const JobState state)
+{
+  switch (state)
+  {
+  case JobState::Free:
+    return "free";
+  case JobState::Queued:
+    return "queued";
+  case JobState::Running:
+    return "running";
+  case JobState::Done:
+    return "done";
+  case JobState::Failed:
+    return "failed";
+  }
+  return "unknown";
+}
+
+static bool isFinished(const JobState state)
+{
+  return state == JobState::Free || state == JobState::Done || state == JobState::Failed;
+}
+
+CommandResult CommandJobs::submit(const CommandEntry &entry, const nlohmann::json &payload)
+{
+  std::lock_guard lock(this->mutex);
+
+  // a free slot, or the one holding the oldest finished job
+  CommandJob *slot = nullptr;
+  for (auto &job : this->jobs)
+  {
+    if (isFinished(job.state) && (slot == nullptr || job.id < slot->id))
+    {
+      slot = &job;
+    }
+  }
+  if (slot == nullptr)
+  {
+    return CommandResult::getErrorResult("Too many jobs in flight, try again once one is done");
+  }
+
+  if (this->task == nullptr)
+  {
+    // every slot can be queued at most once, so sends never have to wait
+    this->queue = xQueueCreate(COMMAND_JOB_SLOTS, sizeof(uint32_t));
+    if (this->queue == nullptr ||
+        xTaskCreate(&CommandJobs::taskEntry, "CommandJobTask", COMMAND_JOB_STACK_SIZE, this, 1, &this->task) != pdPASS)
+    {
+      ESP_LOGE(COMMAND_JOBS_TAG, "Failed to start the job worker");
+      if (this->queue != nullptr)
+      {
+        vQueueDelete(this->queue);
+        this->queue = nullptr;
+      }
+      this->task = nullptr;
+      return CommandResult::getErrorResult("Failed to start the job worker");
+    }
+  }
+
+  *slot = CommandJob{
+      .id = this->nextId++,
+      .state = JobState::Queued,
+      .entry = &entry,
+      .payload = payload,
+      .result = nullptr,
+      .queuedUs = esp_timer_get_time(),
+      .startedUs = 0,
+      .finishedUs = 0,
+  };
+  xQueueSend(this->queue, &slot->id, 0);
+
+  return CommandResult::getSuccessResult(nlohmann::json{
+      {"job_id", slot->id},
+      {"command", entry.name},
+      {"state", jobStateToString(JobState::Queued)},
+  });
+}
+
+CommandResult CommandJobs::get(const uint32_t id, const int waitMs)
+{
+  const int64_t deadline = esp_timer_get_time() + static_cast<int64_t>(waitMs) * 1000;
+  while (true)
+  {
+    {
+      std::lock_guard lock(this->mutex);
+      const CommandJob *job = this->find(id);
+      if (job == nullptr)
+      {
+        return CommandResult::getErrorResult(std::format("Unknown job {}, it may have been replaced by newer ones", id));
+      }
+      if (isFinished(job->state) || esp_timer_get_time() >= deadline)
+      {
+        return CommandResult::getSuccessResult(this->describe(*job));
+      }
+    }
+    vTaskDelay(COMMAND_JOB_POLL_INTERVAL);
+  }
+}
+
+CommandResult CommandJobs::list()
+{
+  std::lock_guard lock(this->mutex);
+  nlohmann::json jobs = nlohmann::json::array();
+  for (const auto &job : this->jobs)
+  {
+    if (job.state == JobState::Free)
+    {
+      continue;
+    }
+    // the results can be large, they're only handed out one job at a time
+    auto summary = this->describe(job);
+    summary.erase("result");
+    jobs.push_back(summary);
+  }
+  std::sort(jobs.begin(), jobs.end(), [](const nlohmann::json &a, const nlohmann::json &b)
+            { return a["job_id"].get<uint32_t>() < b["job_id"].get<uint32_t>(); });
+  return CommandResult::getSuccessResult(nlohmann::json{{"jobs", jobs}});
+}
+
+CommandJob *CommandJobs::find(const uint32_t id)
+{
+  for (auto &job : this->jobs)
+  {
+    if (job.state != JobState::Free && job.id == id)
+    {
+      return &job;
+    }
+  }
+  return nullptr;
+}
+
+nlohmann::json CommandJobs::describe(const CommandJob &job) const
+{
+  const int64_t now = esp_timer_get_time();
+  const int64_t started = job.startedUs != 0 ? job.startedUs : now;
+  const int64_t finished = job.finishedUs != 0 ? job.finishedUs : now;
+
+  nlohmann::json description = {
+      {"job_id", job.id},
+      {"command", job.entry->name},
+      {"state", jobStateToString(job.state)},
+      {"queued_ms", (started - job.queuedUs) / 1000},
+      {"run_ms", job.startedUs != 0 ? (finished - job.startedUs) / 1000 : 0},
+  };
+  if (job.state == JobState::Done || job.state == JobState::Failed)
+  {
+    description["result"] = job.result;
+  }
+  return description;
+}
+
+void CommandJobs::taskEntry(void *arg)
+{
+  static_cast<CommandJobs *>(arg)->run();
+}
+
+void CommandJobs::run()
+{
+  uint32_t id = 0;
+  while (true)
+  {
+    if (xQueueReceive(this->queue, &id, portMAX_DELAY) != pdTRUE)
+    {
+      continue;
+    }
+
+    const CommandEntry *entry = nullptr;
+    nlohmann::json payload;
+    {
+      std::lock_guard lock(this->mutex);
+      CommandJob *job = this->find(id);
+      if (job == nullptr || job->state != JobState::Queued)
+      {
+        continue;
+      }
+      job->state = JobState::Running;
+      job->startedUs = esp_timer_get_time();
+      entry = job->entry;
+      // the job keeps no use for it once it runs
+      payload = std::move(job->payload);
+    }
+
+    const CommandResult result = this->manager.invoke(*entry, payload);
+
+    std::lock_guard lock(this->mutex);
+    // queued and running jobs are never handed to another submit(), the slot is still this job's
+    CommandJob *job = this->find(id);
+    job->state = result.isSuccess() ? JobState::Done : JobState::Failed;
+    job->result = result;
+    job->finishedUs = esp_timer_get_time();
+  }
+}
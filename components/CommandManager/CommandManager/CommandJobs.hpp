@@ -0,0 +1,73 @@
+#ifndef COMMAND_JOBS_HPP
+#define COMMAND_JOBS_HPP
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <nlohmann-json.hpp>
+#include "CommandResult.hpp"
+
+class CommandManager;
+struct CommandEntry;
+
+// jobs kept at once, queued and running ones can't be replaced so this also caps how many can wait
+static constexpr size_t COMMAND_JOB_SLOTS = 4;
+// how long get_job may hold the caller waiting for a job to finish
+static constexpr int COMMAND_JOB_MAX_WAIT_MS = 30000;
+
+enum class JobState : uint8_t
+{
+  Free,
+  Queued,
+  Running,
+  Done,
+  Failed,
+};
+
+const char *jobStateToString(JobState state);
+
+struct CommandJob
+{
+  uint32_t id;
+  JobState state;
+  const CommandEntry *entry;
+  nlohmann::json payload;
+  nlohmann::json result;
+  int64_t queuedUs;
+  int64_t startedUs;
+  int64_t finishedUs;
+};
+
+// Runs the commands that take seconds (scans, sweeps, benchmarks) on a worker task of their own, so the transport
+// that asked gets a job id back right away and stays free to serve everything else in the meantime. Finished
+// jobs are kept until their slot is needed again, for get_job to pick the result up.
+class CommandJobs
+{
+public:
+  explicit CommandJobs(const CommandManager &manager) : manager(manager) {}
+
+  // the worker task is only started by the first job
+  CommandResult submit(const CommandEntry &entry, const nlohmann::json &payload);
+  // waitMs > 0 blocks until the job is done or the wait runs out
+  CommandResult get(uint32_t id, int waitMs);
+  CommandResult list();
+
+private:
+  static void taskEntry(void *arg);
+  void run();
+  CommandJob *find(uint32_t id);
+  nlohmann::json describe(const CommandJob &job) const;
+
+  const CommandManager &manager;
+  TaskHandle_t task = nullptr;
+  QueueHandle_t queue = nullptr;
+
+  std::mutex mutex;
+  std::array<CommandJob, COMMAND_JOB_SLOTS> jobs{};
+  uint32_t nextId = 1;
+};
+
+#endif
@@ -1,165 +1,409 @@
 #include "CommandManager.hpp"
+#include <algorithm>
 #include <cstdlib>
+#include <functional>
+#include <unordered_map>
+#include <esp_timer.h>
+#include <TraceRecorder.h>
 
-std::unordered_map<std::string, CommandType> commandTypeMap = {
-    {"ping", CommandType::PING},
-    {"pause", CommandType::PAUSE},
-    {"set_wifi", CommandType::SET_WIFI},
-    {"update_wifi", CommandType::UPDATE_WIFI},
-    {"update_ota_credentials", CommandType::UPDATE_OTA_CREDENTIALS},
-    {"delete_network", CommandType::DELETE_NETWORK},
-    {"update_ap_wifi", CommandType::UPDATE_AP_WIFI},
-    {"set_mdns", CommandType::SET_MDNS},
-    {"get_mdns_name", CommandType::GET_MDNS_NAME},
-    {"update_camera", CommandType::UPDATE_CAMERA},
-    {"save_config", CommandType::SAVE_CONFIG},
-    {"get_config", CommandType::GET_CONFIG},
-    {"reset_config", CommandType::RESET_CONFIG},
-    {"restart_device", CommandType::RESTART_DEVICE},
-    {"scan_networks", CommandType::SCAN_NETWORKS},
-    {"start_streaming", CommandType::START_STREAMING},
-    {"get_wifi_status", CommandType::GET_WIFI_STATUS},
-    {"connect_wifi", CommandType::CONNECT_WIFI},
-    {"switch_mode", CommandType::SWITCH_MODE},
-    {"get_device_mode", CommandType::GET_DEVICE_MODE},
-    {"set_led_duty_cycle", CommandType::SET_LED_DUTY_CYCLE},
-    {"get_led_duty_cycle", CommandType::GET_LED_DUTY_CYCLE},
-    {"get_serial", CommandType::GET_SERIAL},
-    {"get_led_current", CommandType::GET_LED_CURRENT},
-  {"get_who_am_i", CommandType::GET_WHO_AM_I},
+// The handlers keep their own signatures, these fit each of them into the table's
+template <CommandResult (*Handler)()>
+static CommandResult plain(const std::shared_ptr<DependencyRegistry> &, const nlohmann::json &)
+{
+  return Handler();
+}
+
+template <CommandResult (*Handler)(const nlohmann::json &)>
+static CommandResult withPayload(const std::shared_ptr<DependencyRegistry> &, const nlohmann::json &payload)
+{
+  return Handler(payload);
+}
+
+template <CommandResult (*Handler)(std::shared_ptr<DependencyRegistry>)>
+static CommandResult withRegistry(const std::shared_ptr<DependencyRegistry> &registry, const nlohmann::json &)
+{
+  return Handler(registry);
+}
+
+template <CommandResult (*Handler)(std::shared_ptr<DependencyRegistry>, const nlohmann::json &)>
+static CommandResult withBoth(const std::shared_ptr<DependencyRegistry> &registry, const nlohmann::json &payload)
+{
+  return Handler(registry, payload);
+}
+
+static CommandResult benchmarkDispatchCommand(const std::shared_ptr<DependencyRegistry> &registry, const nlohmann::json &payload);
+
+using enum PayloadFieldType;
+
+// what the handlers read from "data", anything not listed is passed through unchecked
+static constexpr PayloadField PAUSE_SCHEMA[] = {{"pause", Boolean, false}};
+static constexpr PayloadField SET_WIFI_SCHEMA[] = {
+    {"name", String, true},
+    {"ssid", String, true},
+    {"password", String, true},
+    {"channel", Integer, true},
+    {"power", Integer, true},
+};
+static constexpr PayloadField UPDATE_WIFI_SCHEMA[] = {
+    {"name", String, true},
+    {"ssid", String, false},
+    {"password", String, false},
+    {"channel", Integer, false},
+    {"power", Integer, false},
+};
+static constexpr PayloadField DELETE_NETWORK_SCHEMA[] = {{"name", String, true}};
+static constexpr PayloadField UPDATE_AP_WIFI_SCHEMA[] = {
+    {"ssid", String, false},
+    {"password", String, false},
+    {"channel", Integer, false},
+};
+static constexpr PayloadField UPDATE_OTA_CREDENTIALS_SCHEMA[] = {
+    {"login", String, false},
+    {"password", String, false},
+    {"port", Integer, false},
+};
+static constexpr PayloadField SET_MDNS_SCHEMA[] = {{"hostname", String, true}};
+static constexpr PayloadField UPDATE_CAMERA_SCHEMA[] = {
+    {"vflip", Integer, false},
+    {"href", Integer, false},
+    {"framesize", Integer, false},
+    {"quality", Integer, false},
+    {"brightness", Integer, false},
+    {"high_speed", Boolean, false},
+};
+static constexpr PayloadField RESET_CONFIG_SCHEMA[] = {{"section", String, true}};
+static constexpr PayloadField SWITCH_MODE_SCHEMA[] = {{"mode", String, true}};
+static constexpr PayloadField SET_LED_DUTY_CYCLE_SCHEMA[] = {{"dutyCycle", Integer, true}};
+static constexpr PayloadField CALIBRATE_XCLK_SCHEMA[] = {
+    {"candidates", Array, false},
+    {"duration_ms", Integer, false},
+};
+static constexpr PayloadField GET_FRAME_STATS_SCHEMA[] = {{"histogram_bins", Integer, false}};
+static constexpr PayloadField SET_AUTO_EXPOSURE_SCHEMA[] = {
+    {"enabled", Boolean, false},
+    {"target", Integer, false},
+    {"use_led", Boolean, false},
+};
+static constexpr PayloadField SET_LED_MODE_SCHEMA[] = {
+    {"mode", String, true},
+    {"pattern", String, false},
+};
+static constexpr PayloadField SET_LED_CURRENT_SCHEMA[] = {{"target_ma", Integer, true}};
+static constexpr PayloadField GET_SYSTEM_STATS_SCHEMA[] = {{"history", Boolean, false}};
+static constexpr PayloadField GET_TRACE_SCHEMA[] = {
+    {"max_events", Integer, false},
+    {"clear", Boolean, false},
+};
+static constexpr PayloadField GET_JOB_SCHEMA[] = {
+    {"job_id", Integer, false},
+    {"wait_ms", Integer, false},
+};
+static constexpr PayloadField SUBSCRIBE_SCHEMA[] = {
+    {"metrics", Array, false},
+    {"period_ms", Integer, false},
+    {"binary", Boolean, false},
+};
+static constexpr PayloadField BENCHMARK_DISPATCH_SCHEMA[] = {{"iterations", Integer, false}};
+
+// sorted by name for the binary search in findCommand(), checked below
+static constexpr CommandEntry COMMAND_TABLE[] = {
+    {"benchmark_dispatch", CommandType::BENCHMARK_DISPATCH, benchmarkDispatchCommand, BENCHMARK_DISPATCH_SCHEMA, CommandLane::Job},
+    {"calibrate_xclk", CommandType::CALIBRATE_XCLK, withBoth<calibrateXclkCommand>, CALIBRATE_XCLK_SCHEMA, CommandLane::Job},
+    {"connect_wifi", CommandType::CONNECT_WIFI, withRegistry<connectWiFiCommand>, {}},
+    {"delete_network", CommandType::DELETE_NETWORK, withBoth<deleteWiFiCommand>, DELETE_NETWORK_SCHEMA, CommandLane::Config},
+    {"get_auto_exposure_status", CommandType::GET_AUTO_EXPOSURE_STATUS, withRegistry<getAutoExposureStatusCommand>, {}},
+    {"get_boot_profile", CommandType::GET_BOOT_PROFILE, plain<getBootProfileCommand>, {}},
+    {"get_camera_status", CommandType::GET_CAMERA_STATUS, withRegistry<getCameraStatusCommand>, {}},
+    {"get_config", CommandType::GET_CONFIG, withRegistry<getConfigCommand>, {}},
+    {"get_device_mode", CommandType::GET_DEVICE_MODE, withRegistry<getDeviceModeCommand>, {}},
+    {"get_frame_stats", CommandType::GET_FRAME_STATS, withBoth<getFrameStatsCommand>, GET_FRAME_STATS_SCHEMA},
+    {"get_illumination_status", CommandType::GET_ILLUMINATION_STATUS, withRegistry<getIlluminationStatusCommand>, {}},
+    {"get_job", CommandType::GET_JOB, withBoth<getJobCommand>, GET_JOB_SCHEMA, CommandLane::Caller},
+    {"get_led_current", CommandType::GET_LED_CURRENT, withRegistry<getLEDCurrentCommand>, {}},
+    {"get_led_duty_cycle", CommandType::GET_LED_DUTY_CYCLE, withRegistry<getLEDDutyCycleCommand>, {}},
+    {"get_mdns_name", CommandType::GET_MDNS_NAME, withRegistry<getMDNSNameCommand>, {}},
+    {"get_serial", CommandType::GET_SERIAL, withRegistry<getSerialNumberCommand>, {}},
+    {"get_system_stats", CommandType::GET_SYSTEM_STATS, withBoth<getSystemStatsCommand>, GET_SYSTEM_STATS_SCHEMA},
+    {"get_thermal_status", CommandType::GET_THERMAL_STATUS, withRegistry<getThermalStatusCommand>, {}},
+    {"get_trace", CommandType::GET_TRACE, withPayload<getTraceCommand>, GET_TRACE_SCHEMA},
+    {"get_who_am_i", CommandType::GET_WHO_AM_I, withRegistry<getInfoCommand>, {}},
+    {"get_wifi_status", CommandType::GET_WIFI_STATUS, withRegistry<getWiFiStatusCommand>, {}},
+    {"pause", CommandType::PAUSE, withPayload<PauseCommand>, PAUSE_SCHEMA},
+    {"ping", CommandType::PING, plain<PingCommand>, {}},
+    {"reset_config", CommandType::RESET_CONFIG, withBoth<resetConfigCommand>, RESET_CONFIG_SCHEMA, CommandLane::Config},
+    {"restart_device", CommandType::RESTART_DEVICE, plain<restartDeviceCommand>, {}},
+    {"save_config", CommandType::SAVE_CONFIG, withRegistry<saveConfigCommand>, {}, CommandLane::Config},
+    {"scan_networks", CommandType::SCAN_NETWORKS, withRegistry<scanNetworksCommand>, {}, CommandLane::Job},
+    {"set_auto_exposure", CommandType::SET_AUTO_EXPOSURE, withBoth<setAutoExposureCommand>, SET_AUTO_EXPOSURE_SCHEMA, CommandLane::Control},
+    {"set_led_current", CommandType::SET_LED_CURRENT, withBoth<setLEDCurrentCommand>, SET_LED_CURRENT_SCHEMA, CommandLane::Control},
+    {"set_led_duty_cycle", CommandType::SET_LED_DUTY_CYCLE, withBoth<updateLEDDutyCycleCommand>, SET_LED_DUTY_CYCLE_SCHEMA, CommandLane::Control},
+    {"set_led_mode", CommandType::SET_LED_MODE, withBoth<setLEDModeCommand>, SET_LED_MODE_SCHEMA, CommandLane::Control},
+    {"set_mdns", CommandType::SET_MDNS, withBoth<setMDNSCommand>, SET_MDNS_SCHEMA, CommandLane::Config},
+    {"set_wifi", CommandType::SET_WIFI, withBoth<setWiFiCommand>, SET_WIFI_SCHEMA, CommandLane::Config},
+    {"start_streaming", CommandType::START_STREAMING, plain<startStreamingCommand>, {}},
+    {"subscribe", CommandType::SUBSCRIBE, withBoth<subscribeCommand>, SUBSCRIBE_SCHEMA, CommandLane::Caller},
+    {"switch_mode", CommandType::SWITCH_MODE, withBoth<switchModeCommand>, SWITCH_MODE_SCHEMA, CommandLane::Config},
+    {"unsubscribe", CommandType::UNSUBSCRIBE, withRegistry<unsubscribeCommand>, {}, CommandLane::Caller},
+    {"update_ap_wifi", CommandType::UPDATE_AP_WIFI, withBoth<updateAPWiFiCommand>, UPDATE_AP_WIFI_SCHEMA, CommandLane::Config},
+    {"update_camera", CommandType::UPDATE_CAMERA, withBoth<updateCameraCommand>, UPDATE_CAMERA_SCHEMA, CommandLane::Config},
+    {"update_ota_credentials", CommandType::UPDATE_OTA_CREDENTIALS, withBoth<updateOTACredentialsCommand>, UPDATE_OTA_CREDENTIALS_SCHEMA, CommandLane::Config},
+    {"update_wifi", CommandType::UPDATE_WIFI, withBoth<updateWiFiCommand>, UPDATE_WIFI_SCHEMA, CommandLane::Config},
 };
 
-std::function<CommandResult()> CommandManager::createCommand(const CommandType type, const nlohmann::json &json) const
+static_assert(std::ranges::is_sorted(COMMAND_TABLE, {}, &CommandEntry::name), "COMMAND_TABLE must stay sorted by name");
+// every CommandType but None has an entry
+static_assert(std::size(COMMAND_TABLE) == static_cast<size_t>(CommandType::BENCHMARK_DISPATCH), "COMMAND_TABLE is missing a command");
+
+const CommandEntry *CommandManager::findCommand(const std::string_view name)
 {
-  switch (type)
+  const auto entry = std::ranges::lower_bound(COMMAND_TABLE, name, {}, &CommandEntry::name);
+  if (entry == std::end(COMMAND_TABLE) || entry->name != name)
   {
-  case CommandType::PING:
-    return {PingCommand};
-  case CommandType::PAUSE:
-    return [json]
-    { return PauseCommand(json); };
-  case CommandType::UPDATE_OTA_CREDENTIALS:
-    return [this, json]
-    { return updateOTACredentialsCommand(this->registry, json); };
-  case CommandType::SET_WIFI:
-    return [this, json]
-    { return setWiFiCommand(this->registry, json); };
-  case CommandType::UPDATE_WIFI:
-    return [this, json]
-    { return updateWiFiCommand(this->registry, json); };
-  case CommandType::UPDATE_AP_WIFI:
-    return [this, json]
-    { return updateAPWiFiCommand(this->registry, json); };
-  case CommandType::DELETE_NETWORK:
-    return [this, json]
-    { return deleteWiFiCommand(this->registry, json); };
-  case CommandType::SET_MDNS:
-    return [this, json]
-    { return setMDNSCommand(this->registry, json); };
-  case CommandType::GET_MDNS_NAME:
-    return [this]
-    { return getMDNSNameCommand(this->registry); };
-  case CommandType::UPDATE_CAMERA:
-    return [this, json]
-    { return updateCameraCommand(this->registry, json); };
-  case CommandType::GET_CONFIG:
-    return [this]
-    { return getConfigCommand(this->registry); };
-  case CommandType::SAVE_CONFIG:
-    return [this]
-    { return saveConfigCommand(this->registry); };
-  case CommandType::RESET_CONFIG:
-    return [this, json]
-    { return resetConfigCommand(this->registry, json); };
-  case CommandType::RESTART_DEVICE:
-    return restartDeviceCommand;
-  case CommandType::SCAN_NETWORKS:
-    return [this]
-    { return scanNetworksCommand(this->registry); };
-  case CommandType::START_STREAMING:
-    return startStreamingCommand;
-  case CommandType::GET_WIFI_STATUS:
-    return [this]
-    { return getWiFiStatusCommand(this->registry); };
-  case CommandType::CONNECT_WIFI:
-    return [this]
-    { return connectWiFiCommand(this->registry); };
-  case CommandType::SWITCH_MODE:
-    return [this, json]
-    { return switchModeCommand(this->registry, json); };
-  case CommandType::GET_DEVICE_MODE:
-    return [this]
-    { return getDeviceModeCommand(this->registry); };
-  case CommandType::SET_LED_DUTY_CYCLE:
-    return [this, json]
-    { return updateLEDDutyCycleCommand(this->registry, json); };
-  case CommandType::GET_LED_DUTY_CYCLE:
-    return [this]
-    { return getLEDDutyCycleCommand(this->registry); };
-  case CommandType::GET_SERIAL:
-    return [this]
-    { return getSerialNumberCommand(this->registry); };
-  case CommandType::GET_LED_CURRENT:
-    return [this]
-    { return getLEDCurrentCommand(this->registry); };
-  case CommandType::GET_WHO_AM_I:
-    return [this]
-    { return getInfoCommand(this->registry); };
-  default:
     return nullptr;
   }
+  return entry;
+}
+
+const CommandEntry *CommandManager::findCommand(const CommandType type)
+{
+  const auto entry = std::ranges::find(COMMAND_TABLE, type, &CommandEntry::type);
+  return entry == std::end(COMMAND_TABLE) ? nullptr : entry;
+}
+
+// Times what dispatch adds on top of a handler, the name lookup and the payload check, against the
+// std::string map + std::function path it replaced. No handler runs
+static CommandResult benchmarkDispatchCommand(const std::shared_ptr<DependencyRegistry> &, const nlohmann::json &payload)
+{
+  constexpr int DEFAULT_ITERATIONS = 1000;
+  constexpr int MAX_ITERATIONS = 20000;
+
+  const int iterations = payload.value("iterations", DEFAULT_ITERATIONS);
+  if (iterations < 1 || iterations > MAX_ITERATIONS)
+  {
+    return CommandResult::getErrorResult(std::format("Invalid payload - iterations must be between 1 and {}", MAX_ITERATIONS));
+  }
+
+  // a typical small payload, it gets checked against every schema in turn
+  const nlohmann::json sample = {{"mode", "wifi"}};
+  constexpr size_t count = std::size(COMMAND_TABLE);
+  volatile uintptr_t sink = 0;
+
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    const CommandEntry *entry = CommandManager::findCommand(COMMAND_TABLE[i % count].name);
+    sink = sink + reinterpret_cast<uintptr_t>(entry->handler) + (validatePayload(entry->schema, sample).reason == nullptr);
+  }
+  const int64_t tableUs = esp_timer_get_time() - start;
+
+  // what every command used to go through: a std::string key into the map, the payload copied out of the
+  // request and again into the lambda, and a std::function big enough to need the heap
+  static const auto legacyMap = []
+  {
+    std::unordered_map<std::string, CommandType> map;
+    for (const auto &entry : COMMAND_TABLE)
+      map.emplace(entry.name, entry.type);
+    return map;
+  }();
+
+  start = esp_timer_get_time();
+  for (int i = 0; i < iterations; i++)
+  {
+    const auto name = std::string(COMMAND_TABLE[i % count].name);
+    const CommandType type = legacyMap.at(name);
+    const auto copied = sample;
+    const std::function<uintptr_t()> command = [copied, type, &sink]
+    { return static_cast<uintptr_t>(type) + copied.size() + sink; };
+    sink = command();
+  }
+  const int64_t legacyUs = esp_timer_get_time() - start;
+
+  return CommandResult::getSuccessResult(nlohmann::json{
+      {"iterations", iterations},
+      {"commands", count},
+      {"table_dispatch_ns", tableUs * 1000 / iterations},
+      {"legacy_dispatch_ns", legacyUs * 1000 / iterations},
+  });
+}
+
+// commands without "data" all share this one
+static const nlohmann::json EMPTY_PAYLOAD = nlohmann::json::object();
+
+CommandResult CommandManager::execute(const CommandEntry &entry, const nlohmann::json &payload) const
+{
+  if (const auto error = validatePayload(entry.schema, payload); error.reason != nullptr)
+  {
+    return CommandResult::getErrorResult(std::format("Invalid payload - {} {}", error.reason, error.field));
+  }
+
+  switch (entry.lane)
+  {
+  case CommandLane::Job:
+    return this->jobs->submit(entry, payload);
+  case CommandLane::Caller:
+    return this->invoke(entry, payload);
+  default:
+    return this->executor->run(entry, payload);
+  }
+}
+
+CommandResult CommandManager::invoke(const CommandEntry &entry, const nlohmann::json &payload) const
+{
+  TRACE_BEGIN(TRACE_COMMAND, entry.type);
+  const CommandResult result = entry.handler(this->registry, payload);
+  TRACE_END(TRACE_COMMAND, entry.type);
+  return result;
 }
 
 CommandManagerResponse CommandManager::executeFromJson(const std::string_view json) const
 {
-  if (!nlohmann::json::accept(json))
+  CommandEnvelope envelope;
+  return executeParsed(parseCommandEnvelope(json, envelope), envelope);
+}
+
+CommandManagerResponse CommandManager::executeFromCbor(const std::span<const uint8_t> cbor) const
+{
+  CommandEnvelope envelope;
+  return executeParsed(parseCommandEnvelope(cbor, envelope), envelope);
+}
+
+CommandManagerResponse CommandManager::executeParsed(const CommandParseStatus status, const CommandEnvelope &envelope) const
+{
+  // every reply carries the request's id, errors included, so pipelined requests can be told apart
+  const auto respond = [&envelope](nlohmann::json response)
+  {
+    if (!envelope.id.is_null())
+    {
+      response["id"] = envelope.id;
+    }
+    return CommandManagerResponse(response);
+  };
+
+  switch (status)
   {
-    return CommandManagerResponse(nlohmann::json{{"error", "Initial JSON Parse - Invalid JSON"}});
+  case CommandParseStatus::InvalidJson:
+    return respond({{"error", "Initial JSON Parse - Invalid JSON"}});
+  case CommandParseStatus::CommandsMissing:
+    return respond(CommandResult::getErrorResult("Commands missing"));
+  case CommandParseStatus::Ok:
+    break;
   }
 
-  nlohmann::json parsedJson = nlohmann::json::parse(json);
-  if (!parsedJson.contains("commands") || !parsedJson["commands"].is_array() || parsedJson["commands"].empty())
+  if (envelope.transaction)
   {
-    return CommandManagerResponse(CommandResult::getErrorResult("Commands missing"));
+    return respond(executeTransaction(envelope.commands));
   }
 
   nlohmann::json results = nlohmann::json::array();
 
-  for (auto &commandObject : parsedJson["commands"].items())
+  for (const auto &command : envelope.commands)
   {
-    auto commandData = commandObject.value();
-    if (!commandData.contains("command"))
+    if (!command.hasName)
     {
-      return CommandManagerResponse({{"command", "Unknown command"}, {"error", "Missing command type"}});
+      return respond({{"command", "Unknown command"}, {"error", "Missing command type"}});
     }
 
-    const auto commandName = commandData["command"].get<std::string>();
-    if (!commandTypeMap.contains(commandName))
+    const CommandEntry *entry = findCommand(command.name);
+    if (entry == nullptr)
     {
-      return CommandManagerResponse({{"command", commandName}, {"error", "Unknown command"}});
+      return respond({{"command", command.name}, {"error", "Unknown command"}});
     }
 
-    const auto commandType = commandTypeMap.at(commandName);
-    const auto commandPayload = commandData.contains("data") ? commandData["data"] : nlohmann::json::object();
-
-    auto command = createCommand(commandType, commandPayload);
     results.push_back({
-        {"command", commandName},
-        {"result", command()},
+        {"command", command.name},
+        {"result", execute(*entry, command.hasData ? command.payload : EMPTY_PAYLOAD)},
     });
   }
-  auto response = nlohmann::json{{"results", results}};
-  return CommandManagerResponse(response);
+  return respond({{"results", results}});
+}
+
+nlohmann::json CommandManager::executeTransaction(const std::vector<ParsedCommand> &commands) const
+{
+  // everything is checked before anything runs, a batch that can't go through whole doesn't start
+  std::vector<const CommandEntry *> entries;
+  entries.reserve(commands.size());
+  for (const auto &command : commands)
+  {
+    if (!command.hasName)
+    {
+      return {{"command", "Unknown command"}, {"error", "Missing command type"}};
+    }
+
+    const CommandEntry *entry = findCommand(command.name);
+    if (entry == nullptr)
+    {
+      return {{"command", command.name}, {"error", "Unknown command"}};
+    }
+    // jobs outlive the batch and the caller lane doesn't touch the config, neither has anything to roll back
+    if (entry->lane == CommandLane::Job || entry->lane == CommandLane::Caller)
+    {
+      return {{"command", command.name}, {"error", "Command can't be part of a transaction"}};
+    }
+    if (const auto error = validatePayload(entry->schema, command.hasData ? command.payload : EMPTY_PAYLOAD);
+        error.reason != nullptr)
+    {
+      return {{"command", command.name}, {"error", std::format("Invalid payload - {} {}", error.reason, error.field)}};
+    }
+    entries.push_back(entry);
+  }
+
+  const auto projectConfig = this->registry->resolve<ProjectConfig>(DependencyType::project_config);
+  nlohmann::json results = nlohmann::json::array();
+
+  // one entry for the executor, so no other channel's command sees the config half changed or gets rolled back with it
+  const CommandResult outcome = this->executor->runBatch(CommandLane::Config, [&]
+                                                         {
+    projectConfig->beginTransaction();
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      const auto &command = commands[i];
+      const CommandResult result = this->invoke(*entries[i], command.hasData ? command.payload : EMPTY_PAYLOAD);
+      results.push_back({
+          {"command", command.name},
+          {"result", result},
+      });
+      // what a handler already applied to the hardware stays until it's set again or the device restarts
+      if (!result.isSuccess())
+      {
+        projectConfig->rollbackTransaction();
+        return CommandResult::getErrorResult(std::format("{} failed, the config was rolled back", command.name));
+      }
+    }
+
+    const int64_t start = esp_timer_get_time();
+    const ConfigCommitStats stats = projectConfig->commitTransaction();
+    const int64_t writeUs = esp_timer_get_time() - start;
+    if (!stats.committed)
+    {
+      return CommandResult::getErrorResult("Failed to write the config, it was rolled back");
+    }
+
+    // each of the setters' saves used to write its whole section on its own, a section touched twice twice over
+    return CommandResult::getSuccessResult(nlohmann::json{
+        {"setter_saves", stats.stagedSaves},
+        {"sections_written", stats.sectionsWritten},
+        {"keys_written", stats.keysWritten},
+        {"write_us", writeUs},
+    }); });
+
+  return {{"results", results}, {"transaction", outcome}};
 }
 
 CommandManagerResponse CommandManager::executeFromType(const CommandType type, const std::string_view json) const
 {
-  const auto command = createCommand(type, json);
+  const CommandEntry *entry = findCommand(type);
 
-  if (command == nullptr)
+  if (entry == nullptr)
   {
     return CommandManagerResponse({{"command", type}, {"error", "Unknown command"}});
   }
 
-  return CommandManagerResponse({"result", command()});
-}
\ No newline at end of file
+  // the REST routes hand over the raw request body, which is empty for the ones that take no payload
+  const nlohmann::json payload = json.empty() ? nlohmann::json::object() : nlohmann::json::parse(json, nullptr, false);
+  if (payload.is_discarded())
+  {
+    return CommandManagerResponse({{"command", entry->name}, {"error", "Invalid JSON"}});
+  }
+
+  return CommandManagerResponse({"result", execute(*entry, payload)});
+}
@@ -4,12 +4,16 @@
 #include <ProjectConfig.hpp>
 #include <CameraManager.hpp>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 #include <optional>
-#include <unordered_map>
-#include <functional>
 #include "CommandResult.hpp"
 #include "CommandSchema.hpp"
+#include "CommandParser.hpp"
+#include "CommandJobs.hpp"
+#include "CommandExecutor.hpp"
+#include "TelemetrySubscription.hpp"
 #include "DependencyRegistry.hpp"
 #include "commands/simple_commands.hpp"
 #include "commands/camera_commands.hpp"
@@ -18,6 +22,8 @@
 #include "commands/wifi_commands.hpp"
 #include "commands/device_commands.hpp"
 #include "commands/scan_commands.hpp"
+#include "commands/job_commands.hpp"
+#include "commands/telemetry_commands.hpp"
 #include <nlohmann-json.hpp>
 
 enum class CommandType
@@ -48,17 +54,72 @@ enum class CommandType
   GET_SERIAL,
   GET_LED_CURRENT,
   GET_WHO_AM_I,
+  CALIBRATE_XCLK,
+  GET_THERMAL_STATUS,
+  GET_CAMERA_STATUS,
+  GET_FRAME_STATS,
+  SET_AUTO_EXPOSURE,
+  GET_AUTO_EXPOSURE_STATUS,
+  SET_LED_MODE,
+  GET_ILLUMINATION_STATUS,
+  SET_LED_CURRENT,
+  GET_SYSTEM_STATS,
+  GET_TRACE,
+  GET_BOOT_PROFILE,
+  GET_JOB,
+  SUBSCRIBE,
+  UNSUBSCRIBE,
+  BENCHMARK_DISPATCH,
+};
+
+// every handler is called through this shape, the payload is never copied on the way
+using CommandHandler = CommandResult (*)(const std::shared_ptr<DependencyRegistry> &registry, const nlohmann::json &payload);
+
+struct CommandEntry
+{
+  std::string_view name;
+  CommandType type;
+  CommandHandler handler;
+  PayloadSchema schema;
+  CommandLane lane = CommandLane::Normal;
 };
 
 class CommandManager
 {
   std::shared_ptr<DependencyRegistry> registry;
+  std::shared_ptr<CommandJobs> jobs;
+  std::shared_ptr<CommandExecutor> executor;
+  std::shared_ptr<TelemetrySubscription> telemetry;
+
+  // checks the payload, then hands the command to its lane
+  CommandResult execute(const CommandEntry &entry, const nlohmann::json &payload) const;
+  // runs the handler itself, on whichever task calls it
+  CommandResult invoke(const CommandEntry &entry, const nlohmann::json &payload) const;
+  friend class CommandJobs;
+  friend class CommandExecutor;
+  CommandManagerResponse executeParsed(CommandParseStatus status, const CommandEnvelope &envelope) const;
+  // a "transaction": true envelope, the config changes of all its commands are written together or not at all
+  nlohmann::json executeTransaction(const std::vector<ParsedCommand> &commands) const;
 
 public:
-  explicit CommandManager(const std::shared_ptr<DependencyRegistry> &DependencyRegistry) : registry(DependencyRegistry) {};
-  std::function<CommandResult()> createCommand(const CommandType type, const nlohmann::json &json) const;
+  explicit CommandManager(const std::shared_ptr<DependencyRegistry> &DependencyRegistry)
+      : registry(DependencyRegistry),
+        jobs(std::make_shared<CommandJobs>(*this)),
+        executor(std::make_shared<CommandExecutor>(*this)),
+        telemetry(std::make_shared<TelemetrySubscription>(*DependencyRegistry)) {};
+
+  std::shared_ptr<CommandJobs> getJobs() const { return this->jobs; }
+  std::shared_ptr<CommandExecutor> getExecutor() const { return this->executor; }
+  // for serial and CDC to push what subscribe asked for
+  std::shared_ptr<TelemetrySubscription> getTelemetry() const { return this->telemetry; }
+
+  // lookups into the constexpr command table, nullptr for unknown commands
+  static const CommandEntry *findCommand(std::string_view name);
+  static const CommandEntry *findCommand(CommandType type);
 
   CommandManagerResponse executeFromJson(std::string_view json) const;
+  // the same {"commands":[...]} envelope as CBOR, for the binary framing on serial/CDC
+  CommandManagerResponse executeFromCbor(std::span<const uint8_t> cbor) const;
   CommandManagerResponse executeFromType(CommandType type, std::string_view json) const;
 };
 
@@ -0,0 +1,296 @@
+#include "CommandParser.hpp"
+#include <type_traits>
+#include <utility>
+
+namespace
+{
+  using json = nlohmann::json;
+
+  class CommandEnvelopeSax
+  {
+  public:
+    explicit CommandEnvelopeSax(CommandEnvelope &envelope)
+        : commands(envelope.commands), id(envelope.id), transaction(envelope.transaction) {}
+
+    bool commandsFound = false;
+
+    bool null() { return value(nullptr); }
+    bool boolean(const bool val) { return value(val); }
+    bool number_integer(const json::number_integer_t val) { return value(val); }
+    bool number_unsigned(const json::number_unsigned_t val) { return value(val); }
+    bool number_float(const json::number_float_t val, const json::string_t &) { return value(val); }
+    bool binary(json::binary_t &val) { return value(std::move(val)); }
+
+    bool string(json::string_t &val)
+    {
+      if (skipDepth == 0 && capture.empty() && level == Level::Element && next == Slot::Command)
+      {
+        commands.back().hasName = true;
+        commands.back().name = std::move(val);
+        return true;
+      }
+      return value(std::move(val));
+    }
+
+    bool start_object(std::size_t) { return open(json::object()); }
+    bool start_array(std::size_t) { return open(json::array()); }
+    bool end_object() { return close(); }
+    bool end_array() { return close(); }
+
+    bool key(json::string_t &val)
+    {
+      if (skipDepth > 0)
+        return true;
+      if (!capture.empty())
+      {
+        captureKey = std::move(val);
+        return true;
+      }
+
+      if (level == Level::Root)
+        next = val == "commands"      ? Slot::Commands
+               : val == "id"          ? Slot::Id
+               : val == "transaction" ? Slot::Transaction
+                                      : Slot::Ignore;
+      else if (level == Level::Element)
+        next = val == "command" ? Slot::Command : val == "data" ? Slot::Data : Slot::Ignore;
+      return true;
+    }
+
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &)
+    {
+      return false;
+    }
+
+  private:
+    // where in the envelope the parser is, anything deeper is either captured into a payload or skipped
+    enum class Level
+    {
+      None,
+      Root,
+      Commands,
+      Element,
+      Done,
+    };
+
+    // what the value after the last key is for
+    enum class Slot
+    {
+      Ignore,
+      Commands,
+      Id,
+      Transaction,
+      Command,
+      Data,
+    };
+
+    std::vector<ParsedCommand> &commands;
+    json &id;
+    bool &transaction;
+    Level level = Level::None;
+    Slot next = Slot::Ignore;
+    // open containers inside a value that isn't kept
+    size_t skipDepth = 0;
+    // containers of the "data" subtree being built, innermost last
+    std::vector<json *> capture;
+    json::string_t captureKey;
+
+    // adds a value to the innermost captured container and returns where it ended up
+    json *addCaptured(json &&val)
+    {
+      json &parent = *capture.back();
+      if (parent.is_array())
+      {
+        parent.push_back(std::move(val));
+        return &parent.back();
+      }
+      json &slot = parent[captureKey];
+      slot = std::move(val);
+      return &slot;
+    }
+
+    template <typename Value>
+    bool value(Value &&val)
+    {
+      if (skipDepth > 0)
+        return true;
+      if (!capture.empty())
+      {
+        addCaptured(json(std::forward<Value>(val)));
+        return true;
+      }
+
+      switch (level)
+      {
+      case Level::Root:
+        // a "commands" that isn't an array counts as none
+        if (next == Slot::Commands)
+        {
+          commandsFound = false;
+          commands.clear();
+        }
+        else if (next == Slot::Id)
+        {
+          // only something a client can match on, an id of any other type is left out of the response
+          json candidate(std::forward<Value>(val));
+          id = candidate.is_string() || candidate.is_number() ? std::move(candidate) : json();
+        }
+        else if (next == Slot::Transaction)
+        {
+          // anything but a boolean leaves the commands running one by one
+          if constexpr (std::is_same_v<std::decay_t<Value>, bool>)
+            transaction = val;
+        }
+        break;
+      case Level::Commands:
+        // not an object, reported as missing its command type
+        commands.emplace_back();
+        break;
+      case Level::Element:
+        if (next == Slot::Command)
+        {
+          commands.back().hasName = false;
+        }
+        else if (next == Slot::Data)
+        {
+          commands.back().hasData = true;
+          commands.back().payload = json(std::forward<Value>(val));
+        }
+        break;
+      default:
+        break;
+      }
+      return true;
+    }
+
+    bool open(json &&container)
+    {
+      if (skipDepth > 0)
+      {
+        skipDepth++;
+        return true;
+      }
+      if (!capture.empty())
+      {
+        capture.push_back(addCaptured(std::move(container)));
+        return true;
+      }
+
+      const bool isObject = container.is_object();
+      switch (level)
+      {
+      case Level::None:
+        if (isObject)
+          level = Level::Root;
+        else
+          skipDepth = 1;
+        break;
+      case Level::Root:
+        if (next == Slot::Commands)
+        {
+          // the last "commands" key wins, like it would in a DOM
+          commandsFound = !isObject;
+          commands.clear();
+          if (commandsFound)
+          {
+            level = Level::Commands;
+            break;
+          }
+        }
+        skipDepth = 1;
+        break;
+      case Level::Commands:
+        commands.emplace_back();
+        if (isObject)
+        {
+          level = Level::Element;
+          next = Slot::Ignore;
+        }
+        else
+          skipDepth = 1;
+        break;
+      case Level::Element:
+        if (next == Slot::Data)
+        {
+          // no new commands get added while capturing, so the pointer into the vector stays valid
+          ParsedCommand &command = commands.back();
+          command.hasData = true;
+          command.payload = std::move(container);
+          capture.push_back(&command.payload);
+          break;
+        }
+        if (next == Slot::Command)
+          commands.back().hasName = false;
+        skipDepth = 1;
+        break;
+      default:
+        skipDepth = 1;
+        break;
+      }
+      return true;
+    }
+
+    bool close()
+    {
+      if (skipDepth > 0)
+      {
+        skipDepth--;
+        return true;
+      }
+      if (!capture.empty())
+      {
+        capture.pop_back();
+        return true;
+      }
+
+      switch (level)
+      {
+      case Level::Element:
+        level = Level::Commands;
+        break;
+      case Level::Commands:
+        level = Level::Root;
+        break;
+      case Level::Root:
+        level = Level::Done;
+        break;
+      default:
+        break;
+      }
+      return true;
+    }
+  };
+}
+
+template <typename Parse>
+static CommandParseStatus parseWith(CommandEnvelope &envelope, Parse &&parse)
+{
+  envelope.id = nullptr;
+  envelope.transaction = false;
+  envelope.commands.clear();
+  CommandEnvelopeSax sax(envelope);
+  // an id read before the error is kept, so even that reply can be matched to its request
+  if (!parse(sax))
+  {
+    envelope.commands.clear();
+    return CommandParseStatus::InvalidJson;
+  }
+
+  if (!sax.commandsFound || envelope.commands.empty())
+  {
+    return CommandParseStatus::CommandsMissing;
+  }
+  return CommandParseStatus::Ok;
+}
+
+CommandParseStatus parseCommandEnvelope(const std::string_view json, CommandEnvelope &envelope)
+{
+  return parseWith(envelope, [json](CommandEnvelopeSax &sax)
+                   { return nlohmann::json::sax_parse(json, &sax); });
+}
+
+CommandParseStatus parseCommandEnvelope(const std::span<const uint8_t> cbor, CommandEnvelope &envelope)
+{
+  return parseWith(envelope, [cbor](CommandEnvelopeSax &sax)
+                   { return nlohmann::json::sax_parse(cbor.begin(), cbor.end(), &sax, nlohmann::json::input_format_t::cbor); });
+}
@@ -0,0 +1,44 @@
+#ifndef COMMAND_PARSER_HPP
+#define COMMAND_PARSER_HPP
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann-json.hpp>
+
+struct ParsedCommand
+{
+  // false when "command" was missing or not a string
+  bool hasName = false;
+  std::string name;
+  // the "data" subtree, the only part of a request that becomes a DOM
+  bool hasData = false;
+  nlohmann::json payload;
+};
+
+struct CommandEnvelope
+{
+  // the request's "id" when it had a string or number one, echoed in the response; null otherwise
+  nlohmann::json id;
+  // "transaction": true, the config changes of all the commands are written together or not at all
+  bool transaction = false;
+  std::vector<ParsedCommand> commands;
+};
+
+enum class CommandParseStatus
+{
+  Ok,
+  InvalidJson,
+  // no "commands" array, or an empty one
+  CommandsMissing,
+};
+
+// Reads the {"id":..., "commands":[{"command":..., "data":...}, ...]} envelope in a single SAX pass. Keys outside
+// of it are skipped without being stored, and malformed input is reported by the same pass. The parser keeps its
+// nesting state on the heap, so deep payloads don't grow the calling task's stack.
+CommandParseStatus parseCommandEnvelope(std::string_view json, CommandEnvelope &envelope);
+// the same envelope, CBOR encoded
+CommandParseStatus parseCommandEnvelope(std::span<const uint8_t> cbor, CommandEnvelope &envelope);
+
+#endif
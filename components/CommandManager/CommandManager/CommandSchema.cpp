@@ -1,5 +1,46 @@
 #include "CommandSchema.hpp"
 
+static bool hasType(const nlohmann::json &value, const PayloadFieldType type)
+{
+  switch (type)
+  {
+  case PayloadFieldType::String:
+    return value.is_string();
+  case PayloadFieldType::Integer:
+    return value.is_number_integer();
+  case PayloadFieldType::Boolean:
+    return value.is_boolean();
+  case PayloadFieldType::Array:
+    return value.is_array();
+  }
+  return false;
+}
+
+PayloadError validatePayload(const PayloadSchema schema, const nlohmann::json &payload)
+{
+  if (!payload.is_object())
+  {
+    return {"data must be an object", "data"};
+  }
+
+  for (const auto &field : schema)
+  {
+    // find() on a string_view key compares in place, no temporary std::string
+    const auto value = payload.find(field.name);
+    if (value == payload.end())
+    {
+      if (field.required)
+        return {"missing required field", field.name};
+      continue;
+    }
+    if (!hasType(*value, field.type))
+    {
+      return {"wrong type for field", field.name};
+    }
+  }
+  return {nullptr, {}};
+}
+
 void to_json(nlohmann::json &j, const UpdateWifiPayload &payload)
 {
   j = nlohmann::json{{"name", payload.name}, {"ssid", payload.ssid}, {"password", payload.password}, {"channel", payload.channel}, {"power", payload.power}};
@@ -53,7 +94,7 @@ void from_json(const nlohmann::json &j, UpdateAPWiFiPayload &payload)
 
 void to_json(nlohmann::json &j, const UpdateCameraConfigPayload &payload)
 {
-  j = nlohmann::json{{"vflip", payload.vflip}, {"href", payload.href}, {"framesize", payload.framesize}, {"quality", payload.quality}, {"brightness", payload.brightness}};
+  j = nlohmann::json{{"vflip", payload.vflip}, {"href", payload.href}, {"framesize", payload.framesize}, {"quality", payload.quality}, {"brightness", payload.brightness}, {"high_speed", payload.high_speed}};
 }
 
 void from_json(const nlohmann::json &j, UpdateCameraConfigPayload &payload)
@@ -78,4 +119,8 @@ void from_json(const nlohmann::json &j, UpdateCameraConfigPayload &payload)
   {
     payload.brightness = j.at("brightness").get<uint8_t>();
   }
+  if (j.contains("high_speed"))
+  {
+    payload.high_speed = j.at("high_speed").get<bool>();
+  }
 }
\ No newline at end of file
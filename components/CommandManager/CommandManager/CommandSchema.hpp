@@ -1,7 +1,37 @@
 #ifndef COMMAND_SCHEMA_HPP
 #define COMMAND_SCHEMA_HPP
+#include <span>
+#include <string_view>
 #include <nlohmann-json.hpp>
 
+enum class PayloadFieldType : uint8_t
+{
+  String,
+  Integer,
+  Boolean,
+  Array,
+};
+
+// One key of a command's "data" object, checked before the handler runs so the typed decoders below never see
+// a missing or mistyped field
+struct PayloadField
+{
+  std::string_view name;
+  PayloadFieldType type;
+  bool required;
+};
+
+using PayloadSchema = std::span<const PayloadField>;
+
+struct PayloadError
+{
+  // nullptr when the payload fits
+  const char *reason;
+  std::string_view field;
+};
+
+PayloadError validatePayload(PayloadSchema schema, const nlohmann::json &payload);
+
 struct BasePayload
 {
 };
@@ -58,6 +88,7 @@ struct UpdateCameraConfigPayload : BasePayload
   std::optional<uint8_t> framesize;
   std::optional<uint8_t> quality;
   std::optional<uint8_t> brightness;
+  std::optional<bool> high_speed;
   // TODO add more options here
 };
 
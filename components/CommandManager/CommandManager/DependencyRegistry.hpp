@@ -10,7 +10,13 @@ enum class DependencyType
   camera_manager,
   wifi_manager,
   led_manager,
-  monitoring_manager
+  monitoring_manager,
+  exposure_controller,
+  illumination_sync,
+  led_current_regulator,
+  command_jobs,
+  command_executor,
+  telemetry
 };
 
 class DependencyRegistry
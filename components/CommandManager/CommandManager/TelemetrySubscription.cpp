@@ -0,0 +1,149 @@
+#include "TelemetrySubscription.hpp"
+#include <cmath>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <CameraManager.hpp>
+#include <MonitoringManager.hpp>
+#include "sdkconfig.h"
+
+static bool wants(const uint32_t metrics, const TelemetryMetric metric)
+{
+  return (metrics & (1u << static_cast<size_t>(metric))) != 0;
+}
+
+// one decimal is all a dashboard shows, and it keeps the frames short
+static double roundTenths(const float value)
+{
+  return std::round(static_cast<double>(value) * 10.0) / 10.0;
+}
+
+static std::string_view metricName(const TelemetryMetric metric)
+{
+  return TELEMETRY_METRIC_NAMES[static_cast<size_t>(metric)];
+}
+
+void TelemetrySubscription::subscribe(const uint32_t metrics, const uint32_t periodMs, const bool binary)
+{
+  std::lock_guard lock(this->mutex);
+  this->metrics = metrics & TELEMETRY_ALL_METRICS;
+  this->periodMs = periodMs;
+  this->binary = binary;
+  this->nextUs = esp_timer_get_time();
+  this->sequence = 0;
+}
+
+void TelemetrySubscription::unsubscribe()
+{
+  std::lock_guard lock(this->mutex);
+  this->metrics = 0;
+}
+
+TickType_t TelemetrySubscription::ticksUntilDue()
+{
+  std::lock_guard lock(this->mutex);
+  if (this->metrics == 0)
+  {
+    return portMAX_DELAY;
+  }
+  const int64_t remainingUs = this->nextUs - esp_timer_get_time();
+  return remainingUs <= 0 ? 0 : pdMS_TO_TICKS(static_cast<uint32_t>((remainingUs + 999) / 1000));
+}
+
+std::optional<TelemetryFrame> TelemetrySubscription::takeDue()
+{
+  uint32_t metrics = 0;
+  uint32_t sequence = 0;
+  bool binary = false;
+  {
+    std::lock_guard lock(this->mutex);
+    const int64_t now = esp_timer_get_time();
+    if (this->metrics == 0 || now < this->nextUs)
+    {
+      return std::nullopt;
+    }
+    // a transport that fell behind skips the frames it missed rather than bursting them out
+    this->nextUs += static_cast<int64_t>(this->periodMs) * 1000;
+    if (this->nextUs <= now)
+    {
+      this->nextUs = now + static_cast<int64_t>(this->periodMs) * 1000;
+    }
+    metrics = this->metrics;
+    sequence = this->sequence++;
+    binary = this->binary;
+  }
+
+  auto data = this->collect(metrics);
+  data["seq"] = sequence;
+  return TelemetryFrame{nlohmann::json{{"telemetry", std::move(data)}}, binary};
+}
+
+// everything read here is an atomic or a driver query, safe from the transport tasks. A figure that isn't
+// available (no camera, sensor or AP, or left out of the build) is sent as null
+nlohmann::json TelemetrySubscription::collect(const uint32_t metrics)
+{
+  nlohmann::json data = {{"uptime_ms", esp_timer_get_time() / 1000}};
+
+  const auto cameraManager = this->registry.resolve<CameraManager>(DependencyType::camera_manager);
+  if (wants(metrics, TelemetryMetric::Fps))
+  {
+    data[metricName(TelemetryMetric::Fps)] = cameraManager ? nlohmann::json(roundTenths(cameraManager->getMeasuredFps()))
+                                                           : nlohmann::json(nullptr);
+  }
+  if (wants(metrics, TelemetryMetric::Drops))
+  {
+    nlohmann::json drops = nullptr;
+    if (cameraManager)
+    {
+      // every reason /metrics breaks out, summed up
+      uint32_t total = cameraManager->getCaptureFailures();
+      const auto &jpegStats = cameraManager->getJpegStats();
+      for (size_t i = static_cast<size_t>(JpegError::None) + 1; i < static_cast<size_t>(JpegError::Count); i++)
+      {
+        total += jpegStats.getFailures(static_cast<JpegError>(i));
+      }
+      drops = total;
+    }
+    data[metricName(TelemetryMetric::Drops)] = drops;
+  }
+
+  const auto monitoringManager = this->registry.resolve<MonitoringManager>(DependencyType::monitoring_manager);
+  if (wants(metrics, TelemetryMetric::LedCurrent))
+  {
+    nlohmann::json current = nullptr;
+#if CONFIG_MONITORING_LED_CURRENT
+    if (monitoringManager)
+    {
+      current = roundTenths(monitoringManager->getCurrentMilliAmps());
+    }
+#endif
+    data[metricName(TelemetryMetric::LedCurrent)] = current;
+  }
+  if (wants(metrics, TelemetryMetric::Temperature))
+  {
+    nlohmann::json celsius = nullptr;
+#if CONFIG_MONITORING_THERMAL
+    if (monitoringManager)
+    {
+      if (const float last = monitoringManager->getLastChipTemperatureCelsius(); !std::isnan(last))
+      {
+        celsius = roundTenths(last);
+      }
+    }
+#endif
+    data[metricName(TelemetryMetric::Temperature)] = celsius;
+  }
+
+  if (wants(metrics, TelemetryMetric::Rssi))
+  {
+    nlohmann::json rssi = nullptr;
+#if CONFIG_GENERAL_ENABLE_WIRELESS
+    if (wifi_ap_record_t ap; esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+    {
+      rssi = ap.rssi;
+    }
+#endif
+    data[metricName(TelemetryMetric::Rssi)] = rssi;
+  }
+
+  return data;
+}
@@ -0,0 +1,73 @@
+#ifndef TELEMETRY_SUBSCRIPTION_HPP
+#define TELEMETRY_SUBSCRIPTION_HPP
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <freertos/FreeRTOS.h>
+#include <nlohmann-json.hpp>
+#include "DependencyRegistry.hpp"
+
+enum class TelemetryMetric : uint8_t
+{
+  Fps,
+  Drops,
+  LedCurrent,
+  Temperature,
+  Rssi,
+  Count,
+};
+
+// the names used in subscribe's "metrics" and as the keys of a frame
+static constexpr std::array<std::string_view, static_cast<size_t>(TelemetryMetric::Count)> TELEMETRY_METRIC_NAMES = {
+    "fps",
+    "drops",
+    "led_ma",
+    "temp_c",
+    "rssi",
+};
+
+static constexpr uint32_t TELEMETRY_ALL_METRICS = (1u << static_cast<size_t>(TelemetryMetric::Count)) - 1;
+static constexpr uint32_t TELEMETRY_DEFAULT_PERIOD_MS = 1000;
+static constexpr uint32_t TELEMETRY_MIN_PERIOD_MS = 100;
+static constexpr uint32_t TELEMETRY_MAX_PERIOD_MS = 60000;
+
+struct TelemetryFrame
+{
+  nlohmann::json data;
+  // CBOR with the binary command framing rather than a JSON line
+  bool binary;
+};
+
+// What subscribe asked for. Serial and CDC are never up at the same time, so there's a single subscription for the
+// device, and whichever of the two is running pushes the frames from its own task between command responses.
+class TelemetrySubscription
+{
+public:
+  explicit TelemetrySubscription(DependencyRegistry &registry) : registry(registry) {}
+
+  // the first frame is due right away
+  void subscribe(uint32_t metrics, uint32_t periodMs, bool binary);
+  void unsubscribe();
+
+  // how long the transport may block before the next frame is due, portMAX_DELAY without a subscription
+  TickType_t ticksUntilDue();
+  // the next frame once it's due, read from the task that's going to write it
+  std::optional<TelemetryFrame> takeDue();
+
+private:
+  nlohmann::json collect(uint32_t metrics);
+
+  DependencyRegistry &registry;
+
+  std::mutex mutex;
+  uint32_t metrics = 0;
+  uint32_t periodMs = TELEMETRY_DEFAULT_PERIOD_MS;
+  bool binary = false;
+  int64_t nextUs = 0;
+  uint32_t sequence = 0;
+};
+
+#endif
@@ -1,4 +1,15 @@
 #include "camera_commands.hpp"
+#include "CommandExecutor.hpp"
+#include "MonitoringManager.hpp"
+#include "ExposureController.hpp"
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <vector>
+#include <main_globals.hpp>
+
+// the camera comes up in parallel with the command channels, only the commands that touch the sensor wait for it
+static constexpr TickType_t CAMERA_INIT_TIMEOUT = pdMS_TO_TICKS(5000);
 
 CommandResult updateCameraCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
 {
@@ -13,5 +24,297 @@ CommandResult updateCameraCommand(std::shared_ptr<DependencyRegistry> registry,
       payload.quality.has_value() ? payload.quality.value() : oldConfig.quality,
       payload.brightness.has_value() ? payload.brightness.value() : oldConfig.brightness);
 
+  if (payload.high_speed.has_value())
+  {
+    projectConfig->setCameraHighSpeedConfig(payload.high_speed.value());
+    // a camera still coming up reads the saved mode itself
+    const auto cameraManager = registry->resolve<CameraManager>(DependencyType::camera_manager);
+    if (cameraManager && waitForCameraInit(CAMERA_INIT_TIMEOUT))
+    {
+      cameraManager->setHighSpeedMode(payload.high_speed.value());
+    }
+  }
+
   return CommandResult::getSuccessResult("Config updated");
-}
\ No newline at end of file
+}
+
+CommandResult getCameraStatusCommand(std::shared_ptr<DependencyRegistry> registry)
+{
+  const auto cameraManager = registry->resolve<CameraManager>(DependencyType::camera_manager);
+  if (!cameraManager || !waitForCameraInit(CAMERA_INIT_TIMEOUT))
+  {
+    return CommandResult::getErrorResult("Camera not available");
+  }
+
+  const auto frameSize = cameraManager->getFrameSize();
+  nlohmann::json json = {
+      {"framesize", static_cast<int>(frameSize)},
+      {"high_speed", cameraManager->isHighSpeedMode()},
+      {"xclk_freq_hz", cameraManager->getXclkFrequency()},
+      {"target_fps", cameraManager->getTargetFrameRate()},
+      {"sensor_fps", cameraManager->getSensorFrameRate()},
+      {"native_fps", std::format("{:.1f}", static_cast<double>(cameraManager->getNativeFps()))},
+      {"measured_fps", std::format("{:.1f}", static_cast<double>(cameraManager->getMeasuredFps()))},
+  };
+  const auto &jpegStats = cameraManager->getJpegStats();
+  nlohmann::json jpegFailures = nlohmann::json::object();
+  for (size_t i = 1; i < static_cast<size_t>(JpegError::Count); i++)
+  {
+    const auto error = static_cast<JpegError>(i);
+    jpegFailures[jpegErrorToString(error)] = jpegStats.getFailures(error);
+  }
+  json["jpeg"] = {
+      {"valid", jpegStats.getValid()},
+      {"failures", jpegFailures},
+      {"trimmed_frames", jpegStats.getTrimmedFrames()},
+      {"trimmed_bytes", jpegStats.getTrimmedBytes()},
+  };
+
+  if (frameSize < FRAMESIZE_INVALID)
+  {
+    json["width"] = resolution[frameSize].width;
+    json["height"] = resolution[frameSize].height;
+  }
+
+  return CommandResult::getSuccessResult(json);
+}
+
+CommandResult calibrateXclkCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
+{
+  const auto cameraManager = registry->resolve<CameraManager>(DependencyType::camera_manager);
+  const auto projectConfig = registry->resolve<ProjectConfig>(DependencyType::project_config);
+  const auto monitoringManager = registry->resolve<MonitoringManager>(DependencyType::monitoring_manager);
+  const auto executor = registry->resolve<CommandExecutor>(DependencyType::command_executor);
+
+  if (!cameraManager || !waitForCameraInit(CAMERA_INIT_TIMEOUT))
+  {
+    return CommandResult::getErrorResult("Camera not available");
+  }
+
+  std::vector<int> candidates = {10000000, 12000000, 14000000, 16500000, 18000000, 20000000, 22000000, 24000000};
+  if (json.contains("candidates"))
+  {
+    if (!json["candidates"].is_array() || json["candidates"].empty())
+    {
+      return CommandResult::getErrorResult("Invalid payload - candidates must be a non-empty array of frequencies in Hz");
+    }
+
+    candidates.clear();
+    for (const auto &candidate : json["candidates"])
+    {
+      if (!candidate.is_number_integer() || candidate.get<int>() < 1000000 || candidate.get<int>() > 24000000)
+      {
+        return CommandResult::getErrorResult("Invalid payload - unsupported candidate frequency");
+      }
+      candidates.push_back(candidate.get<int>());
+    }
+  }
+
+  int duration_ms = CONFIG_CAMERA_XCLK_CALIBRATION_PROBE_MS;
+  if (json.contains("duration_ms"))
+  {
+    if (!json["duration_ms"].is_number_integer() || json["duration_ms"].get<int>() < 200 || json["duration_ms"].get<int>() > 10000)
+    {
+      return CommandResult::getErrorResult("Invalid payload - duration_ms must be between 200 and 10000");
+    }
+    duration_ms = json["duration_ms"].get<int>();
+  }
+
+  // the OV5640 is specced for a lower XCLK than the OV2640, don't go above what it's known to handle
+  if (cameraManager->getSensorPID() == OV5640_PID)
+  {
+    std::erase_if(candidates, [](const int candidate)
+                  { return candidate > OV5640_XCLK_FREQ_HZ; });
+    if (candidates.empty())
+    {
+      return CommandResult::getErrorResult("No candidate frequency is supported by the OV5640");
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+
+  const int previous_xclk = cameraManager->getXclkFrequency();
+  int best_xclk = 0;
+  float best_fps = 0.0f;
+  auto probes = nlohmann::json::array();
+
+  // one probe at a time holds off the other commands, in between they get their turn
+  const auto exclusive = [&executor]
+  { return executor ? executor->exclusive() : std::unique_lock<std::mutex>(); };
+
+  for (const auto candidate : candidates)
+  {
+    XclkProbeResult probe;
+    {
+      const auto lock = exclusive();
+      probe = cameraManager->probeXclk(candidate, duration_ms);
+    }
+    const float temperature = monitoringManager ? monitoringManager->getChipTemperatureCelsius() : NAN;
+
+    const uint32_t attempts = probe.frames + probe.timeouts;
+    const uint32_t corrupt_permille = attempts > 0 ? ((probe.corrupt_frames + probe.timeouts) * 1000) / attempts : 1000;
+    const bool stable = probe.initialized &&
+                        probe.frames > 0 &&
+                        corrupt_permille <= CONFIG_CAMERA_XCLK_CALIBRATION_MAX_CORRUPT_PERMILLE &&
+                        (std::isnan(temperature) || temperature <= CONFIG_CAMERA_XCLK_CALIBRATION_MAX_TEMP_C);
+
+    // a faster clock only wins if it actually buys us frames, otherwise the slower one runs cooler
+    if (stable && probe.fps > best_fps * 1.02f)
+    {
+      best_xclk = candidate;
+      best_fps = probe.fps;
+    }
+
+    nlohmann::json entry = {
+        {"xclk_freq_hz", candidate},
+        {"initialized", probe.initialized},
+        {"frames", probe.frames},
+        {"corrupt_frames", probe.corrupt_frames},
+        {"timeouts", probe.timeouts},
+        {"fps", probe.fps},
+        {"stable", stable},
+    };
+    if (!std::isnan(temperature))
+    {
+      entry["temperature_c"] = temperature;
+    }
+    probes.push_back(entry);
+  }
+
+  const auto lock = exclusive();
+  if (best_xclk == 0)
+  {
+    cameraManager->applyXclk(previous_xclk);
+    return CommandResult::getErrorResult("No stable XCLK frequency found, kept " + std::to_string(previous_xclk) + " Hz");
+  }
+
+  if (!cameraManager->applyXclk(best_xclk))
+  {
+    cameraManager->applyXclk(previous_xclk);
+    return CommandResult::getErrorResult("Failed to apply calibrated XCLK frequency");
+  }
+
+  projectConfig->setCameraXclkConfig(best_xclk);
+
+  return CommandResult::getSuccessResult({
+      {"xclk_freq_hz", best_xclk},
+      {"fps", best_fps},
+      {"probes", probes},
+  });
+}
+
+CommandResult getFrameStatsCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
+{
+  int bins = 16;
+  if (json.contains("histogram_bins"))
+  {
+    if (!json["histogram_bins"].is_number_integer())
+    {
+      return CommandResult::getErrorResult("Invalid payload - histogram_bins must be an integer");
+    }
+    bins = json["histogram_bins"].get<int>();
+    // keep bins an even split of the 256 levels
+    if (bins < 1 || bins > 256 || (256 % bins) != 0)
+    {
+      return CommandResult::getErrorResult("Invalid payload - histogram_bins must divide 256");
+    }
+  }
+
+  const auto cameraManager = registry->resolve<CameraManager>(DependencyType::camera_manager);
+  if (!cameraManager || !waitForCameraInit(CAMERA_INIT_TIMEOUT))
+  {
+    return CommandResult::getErrorResult("Camera not available");
+  }
+
+  LumaGrid grid;
+  if (!cameraManager->captureLumaGrid(grid))
+  {
+    return CommandResult::getErrorResult("Failed to capture or decode a frame");
+  }
+
+  const auto stats = computeLumaStats(grid);
+  const int binWidth = 256 / bins;
+  auto histogram = nlohmann::json::array();
+  for (int bin = 0; bin < bins; bin++)
+  {
+    uint32_t count = 0;
+    for (int i = 0; i < binWidth; i++)
+      count += stats.histogram[bin * binWidth + i];
+    histogram.push_back(count);
+  }
+
+  return CommandResult::getSuccessResult({
+      {"grid_width", grid.width},
+      {"grid_height", grid.height},
+      {"mean", std::format("{:.1f}", static_cast<double>(stats.mean))},
+      {"min", stats.min},
+      {"max", stats.max},
+      {"p5", stats.p5},
+      {"p50", stats.p50},
+      {"p95", stats.p95},
+      {"histogram", histogram},
+  });
+}
+
+CommandResult setAutoExposureCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
+{
+  const auto projectConfig = registry->resolve<ProjectConfig>(DependencyType::project_config);
+  const auto &cameraConfig = projectConfig->getCameraConfig();
+  bool enabled = cameraConfig.auto_exposure;
+  int target = cameraConfig.exposure_target;
+  bool useLed = cameraConfig.exposure_led;
+
+  if (json.contains("enabled"))
+  {
+    if (!json["enabled"].is_boolean())
+      return CommandResult::getErrorResult("Invalid payload - enabled must be a boolean");
+    enabled = json["enabled"].get<bool>();
+  }
+  if (json.contains("target"))
+  {
+    if (!json["target"].is_number_integer())
+      return CommandResult::getErrorResult("Invalid payload - target must be an integer");
+    target = json["target"].get<int>();
+    if (target < 16 || target > 240)
+      return CommandResult::getErrorResult("Invalid payload - target must be between 16 and 240");
+  }
+  if (json.contains("use_led"))
+  {
+    if (!json["use_led"].is_boolean())
+      return CommandResult::getErrorResult("Invalid payload - use_led must be a boolean");
+    useLed = json["use_led"].get<bool>();
+  }
+
+  projectConfig->setCameraAutoExposureConfig(enabled, static_cast<uint8_t>(target), useLed);
+  if (const auto controller = registry->resolve<ExposureController>(DependencyType::exposure_controller))
+  {
+    controller->configure(enabled, static_cast<uint8_t>(target), useLed);
+  }
+
+  return CommandResult::getSuccessResult("Auto exposure updated");
+}
+
+CommandResult getAutoExposureStatusCommand(std::shared_ptr<DependencyRegistry> registry)
+{
+  const auto controller = registry->resolve<ExposureController>(DependencyType::exposure_controller);
+  if (!controller)
+  {
+    return CommandResult::getErrorResult("Auto exposure not available");
+  }
+
+  const auto status = controller->getStatus();
+  return CommandResult::getSuccessResult({
+      {"enabled", status.enabled},
+      {"state", exposureStateToString(status.state)},
+      {"target", status.target},
+      {"use_led", status.useLed},
+      {"mean", std::format("{:.1f}", static_cast<double>(status.mean))},
+      {"p95", status.p95},
+      {"aec_value", status.aecValue},
+      {"agc_gain", status.agcGain},
+      {"led_duty", status.ledDuty},
+      {"adjustments", status.adjustments},
+      {"convergences", status.convergences},
+      {"last_convergence_ms", status.lastConvergenceMs},
+  });
+}
@@ -11,6 +11,11 @@
 #include <nlohmann-json.hpp>
 
 CommandResult updateCameraCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
+CommandResult getCameraStatusCommand(std::shared_ptr<DependencyRegistry> registry);
+CommandResult getFrameStatsCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
+CommandResult setAutoExposureCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
+CommandResult getAutoExposureStatusCommand(std::shared_ptr<DependencyRegistry> registry);
+CommandResult calibrateXclkCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
 
 #endif
 
@@ -1,8 +1,18 @@
 #include "device_commands.hpp"
 #include "LEDManager.hpp"
+#include "LEDCurrentRegulator.hpp"
+#include "CameraManager.hpp"
 #include "MonitoringManager.hpp"
+#include "IlluminationSync.hpp"
+#include "TraceRecorder.h"
+#include "BootProfiler.hpp"
+#include "CommandExecutor.hpp"
 #include "esp_mac.h"
+#include "esp_system.h"
+#include <array>
 #include <cstdio>
+#include <cmath>
+#include <vector>
 
 CommandResult setDeviceModeCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
 {
@@ -151,7 +161,40 @@ CommandResult switchModeCommand(std::shared_ptr<DependencyRegistry> registry, co
     ESP_LOGI("[DEVICE_COMMANDS]", "Setting device mode to: %d", (int)newMode);
     projectConfig->setDeviceMode(newMode);
 
-    return CommandResult::getSuccessResult("Device mode switched, restart to apply");
+    const ModeSwitchKind kind = getModeSwitchKind();
+    if (kind == ModeSwitchKind::OnStart)
+    {
+        return CommandResult::getSuccessResult(nlohmann::json{
+            {"switch", "on_start"},
+            {"message", "Device mode switched, applied when streaming starts"},
+        });
+    }
+
+    // same as start_streaming, the transport we're answering over may be the one getting torn down
+    static esp_timer_handle_t modeSwitchTimer = nullptr;
+    if (modeSwitchTimer == nullptr)
+    {
+        esp_timer_create_args_t args{
+            .callback = applyModeSwitch,
+            .arg = nullptr,
+            .name = "applyModeSwitch"};
+        esp_timer_create(&args, &modeSwitchTimer);
+    }
+    // a second switch within the delay replaces the first, the saved mode is what gets applied
+    esp_timer_stop(modeSwitchTimer);
+    esp_timer_start_once(modeSwitchTimer, 150 * 1000);
+
+    if (kind == ModeSwitchKind::Reboot)
+    {
+        return CommandResult::getSuccessResult(nlohmann::json{
+            {"switch", "reboot"},
+            {"message", "Device mode switched, restarting to apply"},
+        });
+    }
+    return CommandResult::getSuccessResult(nlohmann::json{
+        {"switch", "hot"},
+        {"message", "Device mode switched, applying now"},
+    });
 }
 
 CommandResult getDeviceModeCommand(std::shared_ptr<DependencyRegistry> registry)
@@ -173,10 +216,14 @@ CommandResult getDeviceModeCommand(std::shared_ptr<DependencyRegistry> registry)
         break;
     }
 
-    const auto json = nlohmann::json{
+    auto json = nlohmann::json{
         {"mode", modeStr},
         {"value", static_cast<int>(currentMode)},
     };
+    if (const int64_t switchUs = getLastModeSwitchUs(); switchUs >= 0)
+    {
+        json["last_switch_ms"] = switchUs / 1000;
+    }
     return CommandResult::getSuccessResult(json);
 }
 
@@ -212,13 +259,317 @@ CommandResult getLEDCurrentCommand(std::shared_ptr<DependencyRegistry> registry)
         return CommandResult::getErrorResult("MonitoringManager unavailable");
     }
     float ma = mon->getCurrentMilliAmps();
-    const auto json = nlohmann::json{{"led_current_ma", std::format("{:.3f}", static_cast<double>(ma))}};
+    auto json = nlohmann::json{{"led_current_ma", std::format("{:.3f}", static_cast<double>(ma))}};
+
+    if (auto regulator = registry->resolve<LEDCurrentRegulator>(DependencyType::led_current_regulator))
+    {
+        const auto status = regulator->getStatus();
+        json["target_ma"] = status.targetMilliAmps;
+        json["regulating"] = status.regulating;
+        json["tripped"] = status.tripped;
+        json["trips"] = status.trips;
+        json["on_current_ma"] = status.sampleMilliAmps;
+        json["peak_on_current_ma"] = status.peakSampleMilliAmps;
+        json["duty_percent"] = status.dutyPercent;
+    }
     return CommandResult::getSuccessResult(json);
 #else
     return CommandResult::getErrorResult("Monitoring disabled");
 #endif
 }
 
+CommandResult setLEDCurrentCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
+{
+    // also re-arms the over-current trip, so it's there with monitoring alone
+#if CONFIG_MONITORING_LED_CURRENT
+    if (!json.contains("target_ma") || !json["target_ma"].is_number_integer())
+    {
+        return CommandResult::getErrorResult("Invalid payload - missing target_ma");
+    }
+
+    const auto target = json["target_ma"].get<int>();
+    if (target < 0 || target > 5000)
+    {
+        return CommandResult::getErrorResult("Invalid payload - target_ma must be between 0 and 5000");
+    }
+
+    auto regulator = registry->resolve<LEDCurrentRegulator>(DependencyType::led_current_regulator);
+    if (!regulator)
+    {
+        return CommandResult::getErrorResult("LED current regulation unavailable");
+    }
+
+    regulator->setTarget(target);
+    const auto projectConfig = registry->resolve<ProjectConfig>(DependencyType::project_config);
+    projectConfig->setLEDCurrentConfig(target);
+    return CommandResult::getSuccessResult(target > 0 ? "LED current regulation on" : "LED current regulation off");
+#else
+    return CommandResult::getErrorResult("Monitoring disabled");
+#endif
+}
+
+CommandResult getThermalStatusCommand(std::shared_ptr<DependencyRegistry> registry)
+{
+#if CONFIG_MONITORING_THERMAL
+    auto mon = registry->resolve<MonitoringManager>(DependencyType::monitoring_manager);
+    if (!mon)
+    {
+        return CommandResult::getErrorResult("MonitoringManager unavailable");
+    }
+
+    const float celsius = mon->getLastChipTemperatureCelsius();
+    auto json = nlohmann::json{
+        {"chip_temperature_c", std::isnan(celsius) ? nlohmann::json(nullptr) : nlohmann::json(std::format("{:.1f}", static_cast<double>(celsius)))},
+        {"state", thermalStateToString(mon->getThermalState())},
+        {"transitions", mon->getThermalTransitions()},
+        {"thresholds", {
+                           {"warm_c", CONFIG_MONITORING_THERMAL_WARM_C},
+                           {"critical_c", CONFIG_MONITORING_THERMAL_CRITICAL_C},
+                           {"hysteresis_c", CONFIG_MONITORING_THERMAL_HYSTERESIS_C},
+                       }},
+    };
+
+    if (auto camera = registry->resolve<CameraManager>(DependencyType::camera_manager))
+    {
+        json["frame_rate_cap"] = camera->getFrameRateCap();
+        json["xclk_freq_hz"] = camera->getXclkFrequency();
+        json["xclk_throttled"] = camera->isXclkThrottled();
+    }
+
+    if (auto ledMgr = registry->resolve<LEDManager>(DependencyType::led_manager))
+    {
+        json["led_duty_limit"] = ledMgr->getExternalLEDDutyLimit();
+    }
+
+    return CommandResult::getSuccessResult(json);
+#else
+    return CommandResult::getErrorResult("Thermal monitoring disabled");
+#endif
+}
+
+CommandResult getSystemStatsCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
+{
+#if CONFIG_MONITORING_SYSTEM
+    auto mon = registry->resolve<MonitoringManager>(DependencyType::monitoring_manager);
+    if (!mon)
+    {
+        return CommandResult::getErrorResult("MonitoringManager unavailable");
+    }
+
+    if (json.contains("history") && !json["history"].is_boolean())
+    {
+        return CommandResult::getErrorResult("Invalid payload - history must be a boolean");
+    }
+
+    // -1 means the FreeRTOS build doesn't carry run time stats
+    const auto cpuJson = [](const int8_t *percent)
+    {
+        auto cores = nlohmann::json::array();
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+            cores.push_back(percent[core] < 0 ? nlohmann::json(nullptr) : nlohmann::json(percent[core]));
+        return cores;
+    };
+
+    // a snapshot is about a kilobyte, too much for the smaller transport task stacks
+    const auto snapshot = std::make_unique<SystemSnapshot>();
+    mon->getSystemSnapshot(*snapshot);
+    const auto &latest = snapshot->latest;
+    auto tasks = nlohmann::json::array();
+    for (size_t i = 0; i < snapshot->task_count; i++)
+    {
+        const auto &task = snapshot->tasks[i];
+        tasks.push_back({
+            {"name", task.name},
+            {"priority", task.priority},
+            {"cpu_percent", task.cpu_percent < 0 ? nlohmann::json(nullptr) : nlohmann::json(std::format("{:.1f}", static_cast<double>(task.cpu_percent)))},
+            {"stack_free_min", task.stack_free_min},
+        });
+    }
+
+    auto result = nlohmann::json{
+        {"uptime_ms", latest.uptime_ms},
+        {"interval_ms", CONFIG_MONITORING_SYSTEM_INTERVAL_MS},
+        {"cpu_percent", cpuJson(latest.cpu_percent)},
+        {"heap", {
+                     {"free", latest.internal_free},
+                     {"largest_free_block", latest.internal_largest},
+                     {"min_free", latest.internal_min_free},
+                     {"fragmentation_percent", latest.fragmentation_percent},
+                 }},
+        {"psram", {
+                      {"free", latest.psram_free},
+                      {"largest_free_block", latest.psram_largest},
+                  }},
+        {"tasks", tasks},
+    };
+
+    if (json.value("history", true))
+    {
+        std::vector<SystemSample> samples(SYSTEM_HISTORY_LENGTH);
+        const size_t count = mon->copySystemHistory(samples.data(), samples.size());
+        auto history = nlohmann::json::array();
+        for (size_t i = 0; i < count; i++)
+        {
+            const auto &sample = samples[i];
+            history.push_back({
+                {"uptime_ms", sample.uptime_ms},
+                {"cpu_percent", cpuJson(sample.cpu_percent)},
+                {"heap_free", sample.internal_free},
+                {"heap_largest_free_block", sample.internal_largest},
+                {"psram_free", sample.psram_free},
+                {"fragmentation_percent", sample.fragmentation_percent},
+            });
+        }
+        result["history"] = history;
+    }
+
+    if (const auto executor = registry->resolve<CommandExecutor>(DependencyType::command_executor))
+    {
+        const auto stats = executor->getStats();
+        result["commands"] = {
+            {"executed", stats.executed},
+            {"rejected", stats.rejected},
+            {"last_wait_us", stats.lastWaitUs},
+            {"max_wait_us", stats.maxWaitUs},
+            {"max_queued", stats.maxQueued},
+        };
+    }
+
+    return CommandResult::getSuccessResult(result);
+#else
+    return CommandResult::getErrorResult("System monitoring disabled");
+#endif
+}
+
+CommandResult getTraceCommand(const nlohmann::json &json)
+{
+    // a trace is ~120 bytes of JSON per event, the serial link can't take the whole ring in one response
+    constexpr int DEFAULT_TRACE_EVENTS = 256;
+    constexpr int MAX_TRACE_EVENTS = 2048;
+
+    const auto status = traceGetStatus();
+    if (!status.enabled)
+    {
+        return CommandResult::getErrorResult("Tracing disabled (CONFIG_GENERAL_TRACE)");
+    }
+
+    if (json.contains("max_events") && !json["max_events"].is_number_integer())
+    {
+        return CommandResult::getErrorResult("Invalid payload - max_events must be an integer");
+    }
+    const auto maxEvents = json.value("max_events", DEFAULT_TRACE_EVENTS);
+    if (maxEvents < 0 || maxEvents > MAX_TRACE_EVENTS)
+    {
+        return CommandResult::getErrorResult(std::format("Invalid payload - max_events must be between 0 and {}", MAX_TRACE_EVENTS));
+    }
+
+    // the same Chrome trace the /trace endpoint streams, built as JSON right away rather than parsed back from text
+    nlohmann::json events = nlohmann::json::array();
+    for (int lane = 0; lane < TRACE_EVENT_COUNT; lane++)
+    {
+        events.push_back({{"name", "thread_name"},
+                          {"ph", "M"},
+                          {"pid", 1},
+                          {"tid", lane},
+                          {"args", {{"name", traceEventName(static_cast<trace_event_t>(lane))}}}});
+    }
+
+    const bool complete = traceForEachEvent(maxEvents, [&events](const TraceEvent &event)
+                                            {
+        nlohmann::json entry = {{"name", event.name},
+                                {"ph", std::string(1, event.phase)},
+                                {"ts", event.timestamp_us},
+                                {"pid", 1},
+                                {"tid", event.lane},
+                                {"args", {{"arg", event.arg}, {"core", event.core}}}};
+        if (event.phase == TRACE_PHASE_INSTANT)
+        {
+            entry["s"] = "t";
+        }
+        events.push_back(std::move(entry));
+        return true; });
+    if (!complete)
+    {
+        return CommandResult::getErrorResult("Failed to render trace");
+    }
+
+    if (json.value("clear", false))
+    {
+        traceClear();
+    }
+
+    return CommandResult::getSuccessResult({
+        {"displayTimeUnit", "ms"},
+        {"otherData", {{"overhead_ns", status.overhead_ns}, {"recorded", status.recorded}, {"capacity", status.capacity}}},
+        {"traceEvents", std::move(events)},
+    });
+}
+
+static const char *resetReasonToString(const esp_reset_reason_t reason)
+{
+    switch (reason)
+    {
+    case ESP_RST_POWERON:
+        return "power_on";
+    case ESP_RST_EXT:
+        return "external";
+    case ESP_RST_SW:
+        return "software";
+    case ESP_RST_PANIC:
+        return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+        return "watchdog";
+    case ESP_RST_DEEPSLEEP:
+        return "deep_sleep";
+    case ESP_RST_BROWNOUT:
+        return "brownout";
+    case ESP_RST_USB:
+        return "usb";
+    default:
+        return "unknown";
+    }
+}
+
+CommandResult getBootProfileCommand()
+{
+    const auto toMs = [](const int64_t us)
+    { return std::format("{:.1f}", static_cast<double>(us) / 1000.0); };
+
+    std::array<BootPhase, BootProfiler::MAX_PHASES> phases{};
+    const size_t count = BootProfiler::getPhases(phases.data(), phases.size());
+
+    auto phasesJson = nlohmann::json::array();
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto &phase = phases[i];
+        phasesJson.push_back({
+            {"name", phase.name},
+            {"start_ms", toMs(phase.startUs)},
+            {"duration_ms", phase.endUs > 0 ? nlohmann::json(toMs(phase.endUs - phase.startUs)) : nlohmann::json(nullptr)},
+            {"core", phase.core},
+        });
+    }
+
+    // timestamps count from esp_timer start, right before app_main, the ROM and bootloader come before that
+    const int64_t firstFrameUs = BootProfiler::getFirstFrameUs();
+    const esp_reset_reason_t reason = esp_reset_reason();
+    return CommandResult::getSuccessResult(nlohmann::json{
+#if CONFIG_GENERAL_PARALLEL_STARTUP
+        {"parallel_startup", true},
+#else
+        {"parallel_startup", false},
+#endif
+        // cold is a power-on reset, brownouts, resets and panics count as warm
+        {"boot", reason == ESP_RST_POWERON ? "cold" : "warm"},
+        {"reset_reason", resetReasonToString(reason)},
+        {"uptime_ms", toMs(esp_timer_get_time())},
+        {"time_to_first_frame_ms", firstFrameUs > 0 ? nlohmann::json(toMs(firstFrameUs)) : nlohmann::json(nullptr)},
+        {"phases", phasesJson},
+    });
+}
+
 CommandResult getInfoCommand(std::shared_ptr<DependencyRegistry> /*registry*/)
 {
     const char *who = CONFIG_GENERAL_BOARD;
@@ -235,3 +586,78 @@ CommandResult getInfoCommand(std::shared_ptr<DependencyRegistry> /*registry*/)
     };
     return CommandResult::getSuccessResult(json);
 }
+
+CommandResult setLEDModeCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
+{
+    if (!json.contains("mode") || !json["mode"].is_string())
+    {
+        return CommandResult::getErrorResult("Invalid payload - missing mode");
+    }
+
+    const auto modeName = json["mode"].get<std::string>();
+    LedMode mode;
+    if (modeName == "pwm")
+        mode = LedMode::PWM;
+    else if (modeName == "strobe")
+        mode = LedMode::STROBE;
+    else if (modeName == "pattern")
+        mode = LedMode::PATTERN;
+    else
+        return CommandResult::getErrorResult("Invalid payload - unsupported mode");
+
+    const auto projectConfig = registry->resolve<ProjectConfig>(DependencyType::project_config);
+    std::string pattern = projectConfig->getDeviceConfig().led_pattern;
+    if (json.contains("pattern"))
+    {
+        if (!json["pattern"].is_string() || !IlluminationSync::isValidPattern(json["pattern"].get<std::string>()))
+        {
+            return CommandResult::getErrorResult("Invalid payload - pattern must be 1 to 16 characters of 0 and 1");
+        }
+        pattern = json["pattern"].get<std::string>();
+    }
+
+    auto illumination = registry->resolve<IlluminationSync>(DependencyType::illumination_sync);
+    if (!illumination)
+    {
+        return CommandResult::getErrorResult("LED mode control unavailable");
+    }
+
+    if (!illumination->setMode(mode, pattern))
+    {
+        return CommandResult::getErrorResult("Failed to switch LED mode");
+    }
+
+    projectConfig->setLEDModeConfig(mode, pattern);
+    return CommandResult::getSuccessResult("LED mode set");
+}
+
+CommandResult getIlluminationStatusCommand(std::shared_ptr<DependencyRegistry> registry)
+{
+    auto illumination = registry->resolve<IlluminationSync>(DependencyType::illumination_sync);
+    if (!illumination)
+    {
+        return CommandResult::getErrorResult("LED mode control unavailable");
+    }
+
+    const auto status = illumination->getStatus();
+    auto json = nlohmann::json{
+        {"mode", ledModeToString(status.mode)},
+        {"fault", status.faulted ? nlohmann::json(status.fault) : nlohmann::json(nullptr)},
+        {"frame_period_us", status.framePeriodUs},
+        {"pulse_us", status.pulseUs},
+        {"pulses", status.pulses},
+        {"skipped_frames", status.skippedFrames},
+        {"pattern", status.pattern},
+        {"lit_frames", status.litFrames},
+        {"dark_frames", status.darkFrames},
+        {"duty_percent", std::format("{:.1f}", static_cast<double>(status.dutyPercent))},
+    };
+
+#if CONFIG_MONITORING_LED_CURRENT
+    // average current should follow the duty, a peak that doesn't match the PWM peak means the pulses are off
+    json["current_ma"] = std::format("{:.1f}", static_cast<double>(status.currentMilliAmps));
+    json["peak_current_ma"] = std::format("{:.1f}", static_cast<double>(status.peakMilliAmps));
+#endif
+
+    return CommandResult::getSuccessResult(json);
+}
@@ -26,6 +26,13 @@ CommandResult getSerialNumberCommand(std::shared_ptr<DependencyRegistry> registr
 
 // Monitoring
 CommandResult getLEDCurrentCommand(std::shared_ptr<DependencyRegistry> registry);
+CommandResult setLEDCurrentCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
+CommandResult getThermalStatusCommand(std::shared_ptr<DependencyRegistry> registry);
+CommandResult getSystemStatsCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
+CommandResult getTraceCommand(const nlohmann::json &json);
+CommandResult getBootProfileCommand();
+CommandResult setLEDModeCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
+CommandResult getIlluminationStatusCommand(std::shared_ptr<DependencyRegistry> registry);
 
 // General info
 CommandResult getInfoCommand(std::shared_ptr<DependencyRegistry> registry);
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include "job_commands.hpp"
+#include <cstdint>
+#include <format>
+
+CommandResult getJobCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
+{
+    const auto jobs = registry->resolve<CommandJobs>(DependencyType::command_jobs);
+    if (!jobs)
+    {
+        return CommandResult::getErrorResult("Not supported by current firmware");
+    }
+
+    // without an id, a summary of every job still held
+    if (!json.contains("job_id"))
+    {
+        return jobs->list();
+    }
+
+    const auto id = json["job_id"].get<int64_t>();
+    if (id < 1 || id > UINT32_MAX)
+    {
+        return CommandResult::getErrorResult("Invalid payload - job_id out of range");
+    }
+
+    const auto waitMs = json.value("wait_ms", 0);
+    if (waitMs < 0 || waitMs > COMMAND_JOB_MAX_WAIT_MS)
+    {
+        return CommandResult::getErrorResult(std::format("Invalid payload - wait_ms must be between 0 and {}", COMMAND_JOB_MAX_WAIT_MS));
+    }
+
+    return jobs->get(static_cast<uint32_t>(id), waitMs);
+}
@@ -0,0 +1,11 @@
+#ifndef JOB_COMMANDS_HPP
+#define JOB_COMMANDS_HPP
+#include <memory>
+#include "CommandResult.hpp"
+#include "CommandJobs.hpp"
+#include "DependencyRegistry.hpp"
+#include <nlohmann-json.hpp>
+
+CommandResult getJobCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
+
+#endif
@@ -12,7 +12,9 @@ CommandResult scanNetworksCommand(std::shared_ptr<DependencyRegistry> registry)
         return CommandResult::getErrorResult("Not supported by current firmware");
     }
 
-    auto networks = wifiManager->ScanNetworks();
+    // runs as a job so the executor keeps answering other commands,
+    // the WiFiManager holds a connect or a mode switch off until the scan is done
+    const auto networks = wifiManager->ScanNetworks();
 
     nlohmann::json result;
     std::vector<nlohmann::json> networksJson;
@@ -0,0 +1,68 @@
+#include "telemetry_commands.hpp"
+#include <algorithm>
+#include <format>
+
+CommandResult subscribeCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json)
+{
+    const auto telemetry = registry->resolve<TelemetrySubscription>(DependencyType::telemetry);
+    if (!telemetry)
+    {
+        return CommandResult::getErrorResult("Not supported by current firmware");
+    }
+
+    uint32_t metrics = TELEMETRY_ALL_METRICS;
+    if (json.contains("metrics"))
+    {
+        metrics = 0;
+        for (const auto &metric : json["metrics"])
+        {
+            const auto name = metric.is_string() ? metric.get<std::string>() : std::string();
+            const auto found = std::ranges::find(TELEMETRY_METRIC_NAMES, name);
+            if (found == TELEMETRY_METRIC_NAMES.end())
+            {
+                return CommandResult::getErrorResult("Invalid payload - metrics must be any of fps, drops, led_ma, temp_c, rssi");
+            }
+            metrics |= 1u << std::distance(TELEMETRY_METRIC_NAMES.begin(), found);
+        }
+        if (metrics == 0)
+        {
+            return CommandResult::getErrorResult("Invalid payload - metrics is empty, use unsubscribe to stop");
+        }
+    }
+
+    const auto periodMs = json.value("period_ms", static_cast<int>(TELEMETRY_DEFAULT_PERIOD_MS));
+    if (periodMs < static_cast<int>(TELEMETRY_MIN_PERIOD_MS) || periodMs > static_cast<int>(TELEMETRY_MAX_PERIOD_MS))
+    {
+        return CommandResult::getErrorResult(std::format("Invalid payload - period_ms must be between {} and {}",
+                                                         TELEMETRY_MIN_PERIOD_MS, TELEMETRY_MAX_PERIOD_MS));
+    }
+
+    const auto binary = json.value("binary", false);
+    telemetry->subscribe(metrics, static_cast<uint32_t>(periodMs), binary);
+
+    auto names = nlohmann::json::array();
+    for (size_t i = 0; i < TELEMETRY_METRIC_NAMES.size(); i++)
+    {
+        if (metrics & (1u << i))
+        {
+            names.push_back(TELEMETRY_METRIC_NAMES[i]);
+        }
+    }
+    return CommandResult::getSuccessResult(nlohmann::json{
+        {"metrics", names},
+        {"period_ms", periodMs},
+        {"binary", binary},
+    });
+}
+
+CommandResult unsubscribeCommand(std::shared_ptr<DependencyRegistry> registry)
+{
+    const auto telemetry = registry->resolve<TelemetrySubscription>(DependencyType::telemetry);
+    if (!telemetry)
+    {
+        return CommandResult::getErrorResult("Not supported by current firmware");
+    }
+
+    telemetry->unsubscribe();
+    return CommandResult::getSuccessResult("Telemetry stopped");
+}
@@ -0,0 +1,12 @@
+#ifndef TELEMETRY_COMMANDS_HPP
+#define TELEMETRY_COMMANDS_HPP
+#include <memory>
+#include "CommandResult.hpp"
+#include "DependencyRegistry.hpp"
+#include "TelemetrySubscription.hpp"
+#include <nlohmann-json.hpp>
+
+CommandResult subscribeCommand(std::shared_ptr<DependencyRegistry> registry, const nlohmann::json &json);
+CommandResult unsubscribeCommand(std::shared_ptr<DependencyRegistry> registry);
+
+#endif
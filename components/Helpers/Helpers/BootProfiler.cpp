@@ -0,0 +1,66 @@
+#include "BootProfiler.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static std::array<BootPhase, BootProfiler::MAX_PHASES> s_phases{};
+static size_t s_phaseCount = 0;
+static portMUX_TYPE s_phasesLock = portMUX_INITIALIZER_UNLOCKED;
+static std::atomic<int64_t> s_firstFrameUs{0};
+
+int BootProfiler::begin(const char *name)
+{
+  const int64_t now = esp_timer_get_time();
+  int handle = -1;
+  taskENTER_CRITICAL(&s_phasesLock);
+  if (s_phaseCount < s_phases.size())
+  {
+    handle = static_cast<int>(s_phaseCount++);
+    s_phases[handle] = {
+        .name = name,
+        .startUs = now,
+        .endUs = 0,
+        .core = static_cast<int>(esp_cpu_get_core_id()),
+    };
+  }
+  taskEXIT_CRITICAL(&s_phasesLock);
+  return handle;
+}
+
+void BootProfiler::end(const int handle)
+{
+  if (handle < 0)
+    return;
+
+  const int64_t now = esp_timer_get_time();
+  taskENTER_CRITICAL(&s_phasesLock);
+  s_phases[handle].endUs = now;
+  taskEXIT_CRITICAL(&s_phasesLock);
+}
+
+void BootProfiler::markFirstFrame()
+{
+  // called for every frame, the load keeps it to a single read once set
+  if (s_firstFrameUs.load(std::memory_order_relaxed) != 0)
+    return;
+
+  int64_t expected = 0;
+  s_firstFrameUs.compare_exchange_strong(expected, esp_timer_get_time());
+}
+
+int64_t BootProfiler::getFirstFrameUs()
+{
+  return s_firstFrameUs.load();
+}
+
+size_t BootProfiler::getPhases(BootPhase *out, const size_t max)
+{
+  taskENTER_CRITICAL(&s_phasesLock);
+  const size_t count = std::min(max, s_phaseCount);
+  std::copy_n(s_phases.begin(), count, out);
+  taskEXIT_CRITICAL(&s_phasesLock);
+  return count;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef BOOTPROFILER_HPP
+#define BOOTPROFILER_HPP
+#include <cstddef>
+#include <cstdint>
+
+struct BootPhase
+{
+  // static string, the table only keeps the pointer
+  const char *name;
+  int64_t startUs;
+  // 0 while the phase is still running
+  int64_t endUs;
+  int core;
+};
+
+// Timestamps of the startup phases, since esp_timer started (right before app_main), for get_boot_profile.
+// Phases may overlap and run on any task.
+namespace BootProfiler
+{
+  constexpr size_t MAX_PHASES = 24;
+
+  // returns the handle for end(), -1 once the table is full
+  int begin(const char *name);
+  void end(int handle);
+
+  // first frame handed to a stream, only the first call after boot counts
+  void markFirstFrame();
+  // 0 until a stream got a frame
+  int64_t getFirstFrameUs();
+
+  size_t getPhases(BootPhase *out, size_t max);
+
+  class ScopedPhase
+  {
+  public:
+    explicit ScopedPhase(const char *name) : handle(begin(name)) {}
+    ~ScopedPhase() { end(handle); }
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+  private:
+    int handle;
+  };
+}
+
+#endif
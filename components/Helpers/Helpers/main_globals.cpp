@@ -3,6 +3,9 @@
 
 // used to force starting the stream setup process via commands
 extern void force_activate_streaming();
+// live mode switching lives in main, next to the transports it starts and stops
+extern ModeSwitchKind plan_mode_switch();
+extern void apply_mode_switch();
 
 static bool s_startupCommandReceived = false;
 bool getStartupCommandReceived()
@@ -33,7 +36,36 @@ void activateStreaming(void *arg)
     force_activate_streaming();
 }
 
+ModeSwitchKind getModeSwitchKind()
+{
+    return plan_mode_switch();
+}
+
+void applyModeSwitch(void *arg)
+{
+    apply_mode_switch();
+}
+
+static int64_t s_lastModeSwitchUs = -1;
+int64_t getLastModeSwitchUs() { return s_lastModeSwitchUs; }
+void setLastModeSwitchUs(int64_t us) { s_lastModeSwitchUs = us; }
+
 // USB handover state
 static bool s_usbHandoverDone = false;
 bool getUsbHandoverDone() { return s_usbHandoverDone; }
-void setUsbHandoverDone(bool done) { s_usbHandoverDone = done; }
\ No newline at end of file
+void setUsbHandoverDone(bool done) { s_usbHandoverDone = done; }
+
+// Camera init state, static so it exists before app_main runs
+static StaticEventGroup_t s_cameraInitGroupBuffer;
+static EventGroupHandle_t s_cameraInitGroup = xEventGroupCreateStatic(&s_cameraInitGroupBuffer);
+static constexpr EventBits_t CAMERA_INIT_DONE_BIT = BIT0;
+
+void setCameraInitDone()
+{
+    xEventGroupSetBits(s_cameraInitGroup, CAMERA_INIT_DONE_BIT);
+}
+
+bool waitForCameraInit(TickType_t timeout)
+{
+    return (xEventGroupWaitBits(s_cameraInitGroup, CAMERA_INIT_DONE_BIT, pdFALSE, pdTRUE, timeout) & CAMERA_INIT_DONE_BIT) != 0;
+}
\ No newline at end of file
@@ -5,12 +5,31 @@
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
 
 // Function to manually activate streaming
 // designed to be scheduled as a task
 // so that the serial manager has time to return the response
 void activateStreaming(void *arg);
 
+// How a saved mode change reaches the running device, decided by main from what's actually up
+enum class ModeSwitchKind
+{
+    // nothing is streaming yet, the next start picks the new mode up
+    OnStart,
+    // the outgoing transport is torn down and the new one started in place
+    Hot,
+    // TinyUSB can't hand the USB PHY back to the serial/JTAG controller, the device restarts into the new mode
+    Reboot,
+};
+
+ModeSwitchKind getModeSwitchKind();
+// esp_timer callback, applies the saved mode to the running device
+void applyModeSwitch(void *arg);
+// time the last hot switch took, -1 until there was one
+int64_t getLastModeSwitchUs();
+void setLastModeSwitchUs(int64_t us);
+
 bool getStartupCommandReceived();
 void setStartupCommandReceived(bool startupCommandReceived);
 
@@ -21,4 +40,9 @@ void setStartupPaused(bool startupPaused);
 bool getUsbHandoverDone();
 void setUsbHandoverDone(bool done);
 
+// Camera bring-up may run in parallel with the rest of startup, anything that needs the sensor waits for it.
+// Set once setupCamera() returned, whether or not it succeeded.
+void setCameraInitDone();
+bool waitForCameraInit(TickType_t timeout);
+
 #endif
\ No newline at end of file
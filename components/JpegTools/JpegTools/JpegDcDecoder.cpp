@@ -0,0 +1,493 @@
+#include "JpegDcDecoder.hpp"
+#include <algorithm>
+
+namespace
+{
+  // MSB-first bit reader over entropy coded data, undoes 0xFF00 stuffing and stops at markers
+  class BitReader
+  {
+  public:
+    BitReader(const uint8_t *data, const uint8_t *end) : data(data), end(end) {}
+
+    uint32_t peek(const int bits)
+    {
+      fill();
+      return accumulator >> (32 - bits);
+    }
+
+    void consume(const int bits)
+    {
+      fill();
+      accumulator <<= bits;
+      count -= bits;
+    }
+
+    uint32_t read(const int bits)
+    {
+      const uint32_t value = peek(bits);
+      consume(bits);
+      return value;
+    }
+
+    // true once we've consumed zero padding, i.e. the data ran out in the middle of something
+    bool exhausted() const { return padded > count; }
+
+    // drops the partial byte and steps over the RSTn marker we should be sitting at
+    bool restart()
+    {
+      accumulator = 0;
+      count = 0;
+      padded = 0;
+      atMarker = false;
+      if (data + 1 < end && data[0] == 0xFF && data[1] >= 0xD0 && data[1] <= 0xD7)
+      {
+        data += 2;
+        return true;
+      }
+      return false;
+    }
+
+  private:
+    void fill()
+    {
+      while (count <= 24)
+      {
+        uint32_t byte = 0;
+        if (!atMarker && data < end)
+        {
+          byte = *data;
+          if (byte == 0xFF)
+          {
+            const uint8_t next = data + 1 < end ? data[1] : 0xD9;
+            if (next == 0x00)
+            {
+              data += 2;
+            }
+            else
+            {
+              // leave the marker for restart() or the caller, pad with zeros from here on
+              atMarker = true;
+              byte = 0;
+            }
+          }
+          else
+          {
+            data++;
+          }
+        }
+        else
+        {
+          atMarker = true;
+        }
+        if (atMarker)
+          padded += 8;
+        accumulator |= byte << (24 - count);
+        count += 8;
+      }
+    }
+
+    const uint8_t *data;
+    const uint8_t *end;
+    uint32_t accumulator = 0;
+    int count = 0;
+    int padded = 0;
+    bool atMarker = false;
+  };
+
+  inline int extend(const uint32_t value, const int bits)
+  {
+    // JPEG magnitude categories, a leading 0 bit means negative
+    return value < (1u << (bits - 1)) ? static_cast<int>(value) - (1 << bits) + 1 : static_cast<int>(value);
+  }
+
+  inline uint16_t readU16(const uint8_t *p)
+  {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+  }
+}
+
+bool JpegDcDecoder::HuffmanTable::build(const uint8_t *counts, const uint8_t *symbols, const size_t symbolCount)
+{
+  // a code that overflows its length would land past the end of the lookup arrays
+  defined = false;
+  if (symbolCount > values.size() || !huffmanCountsValid(counts))
+    return false;
+
+  std::copy(symbols, symbols + symbolCount, values.begin());
+  lookupLength.fill(0);
+  maxCode.fill(-1);
+
+  int32_t code = 0;
+  int32_t index = 0;
+  for (int length = 1; length <= 16; length++)
+  {
+    const int n = counts[length - 1];
+    valueOffset[length] = index - code;
+    for (int i = 0; i < n; i++, code++, index++)
+    {
+      if (length <= LOOKUP_BITS)
+      {
+        // every lookup index starting with this code maps to it
+        const int shift = LOOKUP_BITS - length;
+        const int first = code << shift;
+        for (int fillIndex = 0; fillIndex < (1 << shift); fillIndex++)
+        {
+          lookupLength[first + fillIndex] = static_cast<uint8_t>(length);
+          lookupValue[first + fillIndex] = values[index];
+        }
+      }
+    }
+    if (n > 0)
+      maxCode[length] = code - 1;
+    code <<= 1;
+  }
+  maxCode[17] = INT32_MAX; // sentinel, anything that gets here is a broken stream
+
+  defined = static_cast<size_t>(index) == symbolCount;
+  return defined;
+}
+
+bool JpegDcDecoder::parseHeaders(const uint8_t *buf, const size_t len, size_t &scanOffset)
+{
+  if (len < 4 || buf[0] != 0xFF || buf[1] != 0xD8)
+    return false;
+
+  restartInterval = 0;
+  componentCount = 0;
+  scanComponentCount = 0;
+  for (auto &table : dcTables)
+    table.defined = false;
+  for (auto &table : acTables)
+    table.defined = false;
+
+  size_t pos = 2;
+  while (pos + 4 <= len)
+  {
+    if (buf[pos] != 0xFF)
+      return false;
+
+    const uint8_t marker = buf[pos + 1];
+    if (marker == 0xFF)
+    {
+      pos++;
+      continue;
+    }
+
+    const size_t segmentLength = readU16(buf + pos + 2);
+    if (segmentLength < 2 || pos + 2 + segmentLength > len)
+      return false;
+
+    const uint8_t *segment = buf + pos + 4;
+    const size_t payloadLength = segmentLength - 2;
+
+    switch (marker)
+    {
+    case 0xDB: // DQT, we only need each table's DC entry
+    {
+      size_t offset = 0;
+      while (offset < payloadLength)
+      {
+        const uint8_t precision = segment[offset] >> 4;
+        const uint8_t id = segment[offset] & 0x0F;
+        const size_t tableSize = precision ? 128 : 64;
+        if (id >= quantDc.size() || offset + 1 + tableSize > payloadLength)
+          return false;
+        quantDc[id] = precision ? readU16(segment + offset + 1) : segment[offset + 1];
+        offset += 1 + tableSize;
+      }
+      break;
+    }
+    case 0xC0: // baseline
+    case 0xC1: // extended sequential, same thing for 8 bit data
+    {
+      if (payloadLength < 6)
+        return false;
+      height = readU16(segment + 1);
+      width = readU16(segment + 3);
+      componentCount = segment[5];
+      if (componentCount == 0 || componentCount > components.size() || payloadLength < 6 + componentCount * 3u)
+        return false;
+      for (uint8_t i = 0; i < componentCount; i++)
+      {
+        const uint8_t *c = segment + 6 + i * 3;
+        components[i] = Component{c[0], static_cast<uint8_t>(c[1] >> 4), static_cast<uint8_t>(c[1] & 0x0F), static_cast<uint8_t>(c[2] & 0x03), 0, 0, 0};
+        if (components[i].h == 0 || components[i].v == 0)
+          return false;
+      }
+      break;
+    }
+    case 0xC2: // progressive and friends, the camera never produces those
+    case 0xC3:
+    case 0xC5:
+    case 0xC6:
+    case 0xC7:
+    case 0xC9:
+    case 0xCA:
+    case 0xCB:
+    case 0xCD:
+    case 0xCE:
+    case 0xCF:
+      return false;
+    case 0xC4: // DHT
+    {
+      size_t offset = 0;
+      while (offset + 17 <= payloadLength)
+      {
+        const uint8_t tableClass = segment[offset] >> 4;
+        const uint8_t id = segment[offset] & 0x0F;
+        const uint8_t *counts = segment + offset + 1;
+        size_t symbolCount = 0;
+        for (int i = 0; i < 16; i++)
+          symbolCount += counts[i];
+        if (id > 1 || offset + 17 + symbolCount > payloadLength)
+          return false;
+
+        auto &table = tableClass == 0 ? dcTables[id] : acTables[id];
+        if (!table.build(counts, segment + offset + 17, symbolCount))
+        {
+          lastError = JpegError::BadHuffmanTable;
+          return false;
+        }
+        offset += 17 + symbolCount;
+      }
+      break;
+    }
+    case 0xDD: // DRI
+      if (payloadLength < 2)
+        return false;
+      restartInterval = readU16(segment);
+      break;
+    case 0xDA: // SOS
+    {
+      if (componentCount == 0 || payloadLength < 1)
+        return false;
+      scanComponentCount = segment[0];
+      if (scanComponentCount == 0 || scanComponentCount > componentCount || payloadLength < 1 + scanComponentCount * 2u)
+        return false;
+      for (uint8_t i = 0; i < scanComponentCount; i++)
+      {
+        const uint8_t id = segment[1 + i * 2];
+        const uint8_t tables = segment[2 + i * 2];
+        const auto *match = std::find_if(components.begin(), components.begin() + componentCount, [id](const Component &c)
+                                         { return c.id == id; });
+        if (match == components.begin() + componentCount)
+          return false;
+        const auto index = static_cast<uint8_t>(match - components.begin());
+        components[index].dcTable = (tables >> 4) & 0x01;
+        components[index].acTable = tables & 0x01;
+        components[index].predictor = 0;
+        if (!dcTables[components[index].dcTable].defined || !acTables[components[index].acTable].defined)
+          return false;
+        scanOrder[i] = index;
+      }
+      scanOffset = pos + 2 + segmentLength;
+      return width > 0 && height > 0;
+    }
+    default:
+      break;
+    }
+
+    pos += 2 + segmentLength;
+  }
+
+  return false;
+}
+
+namespace
+{
+  template <typename Table>
+  inline int decodeHuffman(BitReader &reader, const Table &table)
+  {
+    const uint32_t look = reader.peek(Table::LOOKUP_BITS);
+    if (const int length = table.lookupLength[look]; length != 0)
+    {
+      reader.consume(length);
+      return table.lookupValue[look];
+    }
+
+    // long code, walk the remaining lengths
+    for (int length = Table::LOOKUP_BITS + 1; length <= 16; length++)
+    {
+      const auto code = static_cast<int32_t>(reader.peek(length));
+      if (code <= table.maxCode[length])
+      {
+        reader.consume(length);
+        return table.values[table.valueOffset[length] + code];
+      }
+    }
+    return -1;
+  }
+}
+
+bool JpegDcDecoder::decodeScan(const uint8_t *buf, const size_t len, const size_t scanOffset, LumaGrid &grid)
+{
+  // non-interleaved scans (grayscale) are one block per MCU, interleaved ones follow the sampling factors
+  const bool interleaved = scanComponentCount > 1;
+  uint8_t maxH = 1;
+  uint8_t maxV = 1;
+  for (uint8_t i = 0; i < componentCount; i++)
+  {
+    maxH = std::max(maxH, components[i].h);
+    maxV = std::max(maxV, components[i].v);
+  }
+
+  const Component &luma = components[0];
+  const int blockW = (width + 7) / 8;
+  const int blockH = (height + 7) / 8;
+  const int mcuW = interleaved ? 8 * maxH : 8;
+  const int mcuH = interleaved ? 8 * maxV : 8;
+  const int mcusX = (width + mcuW - 1) / mcuW;
+  const int mcusY = (height + mcuH - 1) / mcuH;
+
+  grid.width = static_cast<uint16_t>(blockW);
+  grid.height = static_cast<uint16_t>(blockH);
+  grid.pixels.assign(static_cast<size_t>(blockW) * blockH, 0);
+
+  BitReader reader(buf + scanOffset, buf + len);
+  int restartsLeft = restartInterval;
+
+  for (int mcuY = 0; mcuY < mcusY; mcuY++)
+  {
+    for (int mcuX = 0; mcuX < mcusX; mcuX++)
+    {
+      if (restartInterval)
+      {
+        if (restartsLeft == 0)
+        {
+          if (!reader.restart())
+            return false;
+          for (uint8_t i = 0; i < componentCount; i++)
+            components[i].predictor = 0;
+          restartsLeft = restartInterval;
+        }
+        restartsLeft--;
+      }
+
+      for (uint8_t s = 0; s < scanComponentCount; s++)
+      {
+        Component &component = components[scanOrder[s]];
+        const int blocksH = interleaved ? component.h : 1;
+        const int blocksV = interleaved ? component.v : 1;
+        const auto &dcTable = dcTables[component.dcTable];
+        const auto &acTable = acTables[component.acTable];
+        const bool isLuma = scanOrder[s] == 0;
+
+        for (int v = 0; v < blocksV; v++)
+        {
+          for (int h = 0; h < blocksH; h++)
+          {
+            const int category = decodeHuffman(reader, dcTable);
+            if (category < 0 || category > 11)
+              return false;
+            if (category)
+              component.predictor += extend(reader.read(category), category);
+
+            // skip the AC coefficients, we only need to know how many bits they take
+            for (int k = 1; k < 64;)
+            {
+              const int symbol = decodeHuffman(reader, acTable);
+              if (symbol < 0)
+                return false;
+              const int run = symbol >> 4;
+              const int size = symbol & 0x0F;
+              if (size)
+              {
+                k += run + 1;
+                reader.consume(size);
+              }
+              else
+              {
+                if (run != 15)
+                  break;
+                k += 16;
+              }
+            }
+
+            if (!isLuma)
+              continue;
+
+            const int bx = interleaved ? mcuX * luma.h + h : mcuX;
+            const int by = interleaved ? mcuY * luma.v + v : mcuY;
+            if (bx >= blockW || by >= blockH)
+              continue;
+
+            // the DC coefficient is 8x the block's mean, level shifted by 128
+            const int value = component.predictor * quantDc[component.quantTable] / 8 + 128;
+            grid.pixels[by * blockW + bx] = static_cast<uint8_t>(std::clamp(value, 0, 255));
+          }
+        }
+      }
+
+      if (reader.exhausted())
+        return false;
+    }
+  }
+
+  return true;
+}
+
+bool JpegDcDecoder::decode(const uint8_t *buf, const size_t len, LumaGrid &grid)
+{
+  size_t scanOffset = 0;
+  lastError = JpegError::None;
+  if (buf == nullptr || !parseHeaders(buf, len, scanOffset))
+    return false;
+  return decodeScan(buf, len, scanOffset, grid);
+}
+
+LumaStats computeLumaStats(const LumaGrid &grid)
+{
+  LumaStats stats{};
+  if (grid.pixels.empty())
+    return stats;
+
+  uint64_t sum = 0;
+  for (const uint8_t pixel : grid.pixels)
+  {
+    stats.histogram[pixel]++;
+    sum += pixel;
+  }
+
+  const size_t total = grid.pixels.size();
+  stats.mean = static_cast<float>(sum) / static_cast<float>(total);
+
+  // percentiles straight off the histogram, no sorting
+  const size_t p5Rank = total * 5 / 100;
+  const size_t p50Rank = total / 2;
+  const size_t p95Rank = total * 95 / 100;
+  size_t seen = 0;
+  bool haveMin = false;
+  bool haveP5 = false;
+  bool haveP50 = false;
+  bool haveP95 = false;
+  for (int value = 0; value < 256; value++)
+  {
+    const uint32_t count = stats.histogram[value];
+    if (count == 0)
+      continue;
+    if (!haveMin)
+    {
+      stats.min = static_cast<uint8_t>(value);
+      haveMin = true;
+    }
+    stats.max = static_cast<uint8_t>(value);
+    seen += count;
+    if (!haveP5 && seen > p5Rank)
+    {
+      stats.p5 = static_cast<uint8_t>(value);
+      haveP5 = true;
+    }
+    if (!haveP50 && seen > p50Rank)
+    {
+      stats.p50 = static_cast<uint8_t>(value);
+      haveP50 = true;
+    }
+    if (!haveP95 && seen > p95Rank)
+    {
+      stats.p95 = static_cast<uint8_t>(value);
+      haveP95 = true;
+    }
+  }
+
+  return stats;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef JPEGDCDECODER_HPP
+#define JPEGDCDECODER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "JpegValidator.hpp"
+
+// One value per 8x8 luminance block, i.e. the frame at 1/8 scale
+struct LumaGrid
+{
+  uint16_t width = 0;
+  uint16_t height = 0;
+  std::vector<uint8_t> pixels;
+};
+
+struct LumaStats
+{
+  float mean;
+  uint8_t min;
+  uint8_t max;
+  uint8_t p5;
+  uint8_t p50;
+  uint8_t p95;
+  std::array<uint32_t, 256> histogram;
+};
+
+LumaStats computeLumaStats(const LumaGrid &grid);
+
+// Decodes only the DC coefficients of a baseline JPEG. AC coefficients still have to be
+// Huffman decoded to find where the next block starts, but there's no dequantization
+// or IDCT, which is where a full decode spends its time.
+class JpegDcDecoder
+{
+public:
+  bool decode(const uint8_t *buf, size_t len, LumaGrid &grid);
+  // BadHuffmanTable if the last decode() stopped at a table that doesn't fit its code lengths
+  JpegError getLastError() const { return lastError; }
+
+private:
+  struct HuffmanTable
+  {
+    static constexpr int LOOKUP_BITS = 9;
+
+    bool defined = false;
+    // codes up to LOOKUP_BITS long resolve with one lookup, 0 length means "longer than that"
+    std::array<uint8_t, 1 << LOOKUP_BITS> lookupLength;
+    std::array<uint8_t, 1 << LOOKUP_BITS> lookupValue;
+    std::array<int32_t, 18> maxCode;
+    std::array<int32_t, 17> valueOffset;
+    std::array<uint8_t, 256> values;
+
+    bool build(const uint8_t *counts, const uint8_t *symbols, size_t symbolCount);
+  };
+
+  struct Component
+  {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t quantTable;
+    uint8_t dcTable;
+    uint8_t acTable;
+    int predictor;
+  };
+
+  bool parseHeaders(const uint8_t *buf, size_t len, size_t &scanOffset);
+  bool decodeScan(const uint8_t *buf, size_t len, size_t scanOffset, LumaGrid &grid);
+
+  std::array<HuffmanTable, 2> dcTables;
+  std::array<HuffmanTable, 2> acTables;
+  std::array<uint16_t, 4> quantDc{};
+  std::array<Component, 3> components{};
+  uint8_t componentCount = 0;
+  JpegError lastError = JpegError::None;
+  // components in the order the scan interleaves them
+  std::array<uint8_t, 3> scanOrder{};
+  uint8_t scanComponentCount = 0;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  uint16_t restartInterval = 0;
+};
+
+#endif // JPEGDCDECODER_HPP
@@ -0,0 +1,230 @@
+#include "JpegValidator.hpp"
+#include <cstring>
+
+const char *jpegErrorToString(const JpegError error)
+{
+  switch (error)
+  {
+  case JpegError::None:
+    return "none";
+  case JpegError::TooShort:
+    return "too_short";
+  case JpegError::MissingSOI:
+    return "missing_soi";
+  case JpegError::BadSegment:
+    return "bad_segment";
+  case JpegError::MissingSOS:
+    return "missing_sos";
+  case JpegError::UnexpectedMarker:
+    return "unexpected_marker";
+  case JpegError::Truncated:
+    return "truncated";
+  case JpegError::BadHuffmanTable:
+    return "bad_huffman_table";
+  default:
+    return "unknown";
+  }
+}
+
+bool huffmanCountsValid(const uint8_t *counts)
+{
+  // canonical codes of each length follow the last one of the length before, shifted left
+  uint32_t code = 0;
+  for (int length = 1; length <= 16; length++)
+  {
+    code += counts[length - 1];
+    if (code > (1u << length))
+      return false;
+    code <<= 1;
+  }
+  return true;
+}
+
+// walks the tables of one DHT segment payload, each is a class/id byte, 16 counts and the symbols
+static bool dhtTablesValid(const uint8_t *payload, const size_t payloadLength)
+{
+  size_t offset = 0;
+  while (offset < payloadLength)
+  {
+    if (offset + 17 > payloadLength)
+      return false;
+
+    const uint8_t *counts = payload + offset + 1;
+    if (!huffmanCountsValid(counts))
+      return false;
+
+    size_t symbolCount = 0;
+    for (int i = 0; i < 16; i++)
+      symbolCount += counts[i];
+    offset += 17 + symbolCount;
+  }
+  return offset == payloadLength;
+}
+
+// non-zero if any byte of the word is 0xFF
+static inline uint32_t hasFFByte(const uint32_t word)
+{
+  const uint32_t inverted = ~word;
+  return (inverted - 0x01010101u) & ~inverted & 0x80808080u;
+}
+
+// What the byte after an 0xFF inside entropy coded data means
+enum class ScanMarker
+{
+  Data, // 0xFF00 stuffing or an RSTn marker, keep going
+  EOI,
+  Invalid,
+};
+
+static inline ScanMarker classifyScanMarker(const uint8_t next)
+{
+  if (next == 0x00 || (next >= 0xD0 && next <= 0xD7))
+    return ScanMarker::Data;
+  if (next == 0xD9)
+    return ScanMarker::EOI;
+  return ScanMarker::Invalid;
+}
+
+// Walks the entropy coded data from `pos`, returns the offset of the EOI marker.
+// Most of the data has no 0xFF at all, so we look at a word at a time and only
+// drop to bytes for words that have one.
+static JpegError scanForEOI(const uint8_t *buf, const size_t len, size_t pos, size_t *eoi)
+{
+  while (pos + 1 < len)
+  {
+    if (buf[pos] != 0xFF)
+    {
+      if ((reinterpret_cast<uintptr_t>(buf + pos) & 3u) == 0 && pos + 4 <= len)
+      {
+        uint32_t word;
+        std::memcpy(&word, buf + pos, sizeof(word));
+        if (!hasFFByte(word))
+        {
+          pos += 4;
+          continue;
+        }
+      }
+      pos++;
+      continue;
+    }
+
+    const uint8_t next = buf[pos + 1];
+    if (next == 0xFF)
+    {
+      // fill byte, the marker follows
+      pos++;
+      continue;
+    }
+
+    switch (classifyScanMarker(next))
+    {
+    case ScanMarker::Data:
+      pos += 2;
+      break;
+    case ScanMarker::EOI:
+      *eoi = pos;
+      return JpegError::None;
+    case ScanMarker::Invalid:
+      return JpegError::UnexpectedMarker;
+    }
+  }
+
+  return JpegError::Truncated;
+}
+
+JpegCheck validateJpeg(const uint8_t *buf, const size_t len)
+{
+  JpegCheck result{JpegError::None, 0, 0};
+
+  // SOI + the smallest possible SOS segment + EOI
+  if (buf == nullptr || len < 12)
+  {
+    result.error = JpegError::TooShort;
+    return result;
+  }
+
+  if (buf[0] != 0xFF || buf[1] != 0xD8)
+  {
+    result.error = JpegError::MissingSOI;
+    return result;
+  }
+
+  size_t pos = 2;
+  while (true)
+  {
+    if (pos + 4 > len)
+    {
+      result.error = JpegError::MissingSOS;
+      return result;
+    }
+
+    if (buf[pos] != 0xFF)
+    {
+      result.error = JpegError::BadSegment;
+      return result;
+    }
+
+    const uint8_t marker = buf[pos + 1];
+    if (marker == 0xFF)
+    {
+      pos++;
+      continue;
+    }
+
+    // standalone markers carry no length
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+    {
+      pos += 2;
+      continue;
+    }
+
+    if (marker == 0xD8 || marker == 0xD9)
+    {
+      result.error = marker == 0xD9 ? JpegError::MissingSOS : JpegError::BadSegment;
+      return result;
+    }
+
+    const size_t segment_length = (static_cast<size_t>(buf[pos + 2]) << 8) | buf[pos + 3];
+    if (segment_length < 2 || pos + 2 + segment_length > len)
+    {
+      result.error = JpegError::BadSegment;
+      return result;
+    }
+
+    // the DC decoder builds lookup tables straight from these, a broken one must not get that far
+    if (marker == 0xC4 && !dhtTablesValid(buf + pos + 4, segment_length - 2))
+    {
+      result.error = JpegError::BadHuffmanTable;
+      return result;
+    }
+
+    pos += 2 + segment_length;
+    if (marker == 0xDA)
+      break;
+  }
+
+  result.scanOffset = pos;
+
+  size_t eoi = 0;
+  result.error = scanForEOI(buf, len, pos, &eoi);
+  if (result.error == JpegError::None)
+    result.length = eoi + 2;
+
+  return result;
+}
+
+void JpegValidationStats::record(const JpegCheck &check, const size_t originalLength)
+{
+  if (check.error != JpegError::None)
+  {
+    failures[static_cast<size_t>(check.error)]++;
+    return;
+  }
+
+  valid++;
+  if (check.length < originalLength)
+  {
+    trimmedFrames++;
+    trimmedBytes += static_cast<uint32_t>(originalLength - check.length);
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef JPEGVALIDATOR_HPP
+#define JPEGVALIDATOR_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class JpegError : uint8_t
+{
+  None = 0,
+  TooShort,
+  MissingSOI,
+  BadSegment,       // header segment with an impossible length, or running past the buffer
+  MissingSOS,       // headers ended without a scan
+  UnexpectedMarker, // a marker other than RSTn/EOI inside the entropy coded data
+  Truncated,        // no EOI, the frame got cut off
+  BadHuffmanTable,  // DHT with more codes of some length than that length can hold
+  Count,
+};
+
+const char *jpegErrorToString(JpegError error);
+
+// True if the 16 code counts of a DHT table describe a valid canonical Huffman code,
+// i.e. no length is handed more codes than it has room for.
+bool huffmanCountsValid(const uint8_t *counts);
+
+struct JpegCheck
+{
+  JpegError error;
+  // length up to and including the EOI marker, anything past it is padding or garbage
+  size_t length;
+  // offset of the first byte of entropy coded data, 0 if we didn't get that far
+  size_t scanOffset;
+};
+
+// Structural check of a baseline JPEG: SOI, well formed header segments up to SOS,
+// then a word-at-a-time scan of the entropy coded data for the EOI marker.
+// Doesn't decode anything, a frame with a sane structure can still have broken pixels.
+JpegCheck validateJpeg(const uint8_t *buf, size_t len);
+
+class JpegValidationStats
+{
+public:
+  void record(const JpegCheck &check, size_t originalLength);
+
+  uint32_t getValid() const { return valid.load(); }
+  uint32_t getFailures(JpegError error) const { return failures[static_cast<size_t>(error)].load(); }
+  uint32_t getTrimmedFrames() const { return trimmedFrames.load(); }
+  uint32_t getTrimmedBytes() const { return trimmedBytes.load(); }
+
+private:
+  std::atomic<uint32_t> valid{0};
+  std::array<std::atomic<uint32_t>, static_cast<size_t>(JpegError::Count)> failures{};
+  std::atomic<uint32_t> trimmedFrames{0};
+  std::atomic<uint32_t> trimmedBytes{0};
+};
+
+#endif // JPEGVALIDATOR_HPP
@@ -0,0 +1,110 @@
+#include "LEDCurrentRegulator.hpp"
+
+static const char *LED_CURRENT_REGULATOR_TAG = "[LED_CURRENT_REGULATOR]";
+
+#if CONFIG_MONITORING_LED_REGULATION
+static constexpr int32_t REGULATION_KP = CONFIG_MONITORING_LED_REGULATION_KP;
+static constexpr int32_t REGULATION_KI = CONFIG_MONITORING_LED_REGULATION_KI;
+#else
+static constexpr int32_t REGULATION_KP = 0;
+static constexpr int32_t REGULATION_KI = 0;
+#endif
+
+#if CONFIG_MONITORING_LED_OVERCURRENT_MA
+static constexpr int32_t OVERCURRENT_MA = CONFIG_MONITORING_LED_OVERCURRENT_MA;
+#else
+static constexpr int32_t OVERCURRENT_MA = 0;
+#endif
+
+// gains are in 1/1024 % per mA, the duty is kept in Q16.16 %
+static constexpr int GAIN_TO_Q16_SHIFT = 16 - 10;
+
+LEDCurrentRegulator::LEDCurrentRegulator(std::shared_ptr<LEDManager> ledManager) : ledManager(ledManager) {}
+
+void LEDCurrentRegulator::setTarget(const int32_t target)
+{
+    std::lock_guard lock(this->mutex);
+#if !CONFIG_MONITORING_LED_REGULATION
+    if (target > 0)
+    {
+        ESP_LOGW(LED_CURRENT_REGULATOR_TAG, "LED current regulation not built in (CONFIG_MONITORING_LED_REGULATION)");
+    }
+#endif
+
+    const bool wasRegulating = this->targetMilliAmps > 0 || this->tripped;
+    this->targetMilliAmps = std::max<int32_t>(0, target);
+    this->tripped = false;
+    this->ledManager->setExternalLEDCut(false);
+    this->peakSampleMilliAmps = 0;
+
+    if (this->targetMilliAmps > 0 && REGULATION_KI > 0)
+    {
+        // start from whatever duty is running now so switching over doesn't flash the LED
+        this->integralQ16 = static_cast<int32_t>(this->ledManager->getEffectiveExternalLEDDuty()) << 16;
+        this->ledManager->setExternalLEDRegulated(true);
+        ESP_LOGI(LED_CURRENT_REGULATOR_TAG, "Regulating external LED to %ld mA", static_cast<long>(this->targetMilliAmps));
+    }
+    else if (wasRegulating)
+    {
+        this->ledManager->setExternalLEDRegulated(false);
+        this->ledManager->clearExternalLEDDutyOverride();
+        ESP_LOGI(LED_CURRENT_REGULATOR_TAG, "LED current regulation off");
+    }
+}
+
+void LEDCurrentRegulator::update(const int32_t filtered, const int32_t sample)
+{
+    std::lock_guard lock(this->mutex);
+    this->filteredMilliAmps = filtered;
+    this->sampleMilliAmps = sample;
+    this->peakSampleMilliAmps = std::max(this->peakSampleMilliAmps, sample);
+
+    // checked on the unfiltered on-current, the filter would take several readings to notice
+    if (OVERCURRENT_MA > 0 && sample > OVERCURRENT_MA && !this->tripped)
+    {
+        this->trip(sample);
+        return;
+    }
+
+    // the strobe drives the pin itself and has its own average current check
+    if (this->tripped || this->targetMilliAmps <= 0 || REGULATION_KI <= 0 || this->ledManager->isExternalLEDDetached())
+        return;
+
+    const int64_t error = this->targetMilliAmps - filtered;
+    // anti-windup, the integrator never goes past what the PWM can actually do
+    const int64_t ceilingQ16 = static_cast<int64_t>(this->ledManager->getExternalLEDDutyLimit()) << 16;
+    const int64_t integral = this->integralQ16 + REGULATION_KI * error * (1 << GAIN_TO_Q16_SHIFT);
+    this->integralQ16 = static_cast<int32_t>(std::clamp<int64_t>(integral, 0, ceilingQ16));
+    const int64_t outputQ16 = std::clamp<int64_t>(this->integralQ16 + REGULATION_KP * error * (1 << GAIN_TO_Q16_SHIFT), 0, ceilingQ16);
+
+    // round to the nearest percent, the override skips re-applying an unchanged duty
+    this->ledManager->setExternalLEDDutyOverride(static_cast<uint8_t>((outputQ16 + (1 << 15)) >> 16));
+}
+
+void LEDCurrentRegulator::trip(const int32_t sample)
+{
+    // the cut covers the strobe as well, it drives the pin itself and never looks at the PWM duty
+    this->ledManager->setExternalLEDCut(true);
+    this->ledManager->setExternalLEDDutyOverride(0);
+    this->ledManager->setExternalLEDRegulated(true);
+    this->tripped = true;
+    this->trips++;
+    this->integralQ16 = 0;
+    ESP_LOGE(LED_CURRENT_REGULATOR_TAG, "Over-current: %ld mA > %ld mA, external LED cut", static_cast<long>(sample),
+             static_cast<long>(OVERCURRENT_MA));
+}
+
+LEDCurrentStatus LEDCurrentRegulator::getStatus()
+{
+    std::lock_guard lock(this->mutex);
+    return {
+        .regulating = this->targetMilliAmps > 0 && REGULATION_KI > 0 && !this->tripped,
+        .tripped = this->tripped,
+        .targetMilliAmps = this->targetMilliAmps,
+        .filteredMilliAmps = this->filteredMilliAmps,
+        .sampleMilliAmps = this->sampleMilliAmps,
+        .peakSampleMilliAmps = this->peakSampleMilliAmps,
+        .dutyPercent = this->ledManager->getEffectiveExternalLEDDuty(),
+        .trips = this->trips,
+    };
+}
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef _LEDCURRENTREGULATOR_HPP_
+#define _LEDCURRENTREGULATOR_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "sdkconfig.h"
+#include "LEDManager.hpp"
+
+struct LEDCurrentStatus
+{
+  // a target is set and the loop is driving the duty
+  bool regulating;
+  bool tripped;
+  int32_t targetMilliAmps;
+  int32_t filteredMilliAmps;
+  // unfiltered on-current of the last reading and the highest one since the target was last set
+  int32_t sampleMilliAmps;
+  int32_t peakSampleMilliAmps;
+  uint8_t dutyPercent;
+  uint32_t trips;
+};
+
+// Keeps the external IR LED at a target current rather than a fixed duty. Fed by the monitoring task with every
+// current reading, a fixed-point PI loop on the filtered average sets the PWM duty through the LEDManager override,
+// and an on-current above the over-current limit cuts the LED right away.
+class LEDCurrentRegulator
+{
+public:
+  explicit LEDCurrentRegulator(std::shared_ptr<LEDManager> ledManager);
+
+  // 0 stops regulating and hands the LED back to the configured duty, any target also re-arms a trip
+  void setTarget(int32_t targetMilliAmps);
+  int32_t getTarget() const { return targetMilliAmps; }
+
+  // monitoring task, once per sample
+  void update(int32_t filteredMilliAmps, int32_t sampleMilliAmps);
+  LEDCurrentStatus getStatus();
+
+private:
+  void trip(int32_t sampleMilliAmps);
+
+  std::shared_ptr<LEDManager> ledManager;
+  std::mutex mutex;
+
+  int32_t targetMilliAmps = 0;
+  // integrator, duty percent in Q16.16
+  int32_t integralQ16 = 0;
+  bool tripped = false;
+  uint32_t trips = 0;
+  int32_t filteredMilliAmps = 0;
+  int32_t sampleMilliAmps = 0;
+  int32_t peakSampleMilliAmps = 0;
+};
+
+#endif
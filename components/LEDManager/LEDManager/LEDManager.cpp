@@ -146,13 +146,13 @@ void LEDManager::updateState(const LEDStates_e newState)
     }
     else if (wasError && !willBeError)
     {
-        // restore duty
-        if (hasStoredExternalDuty)
+        // restore duty, unless an over-current trip holds the LED dark meanwhile
+        if (hasStoredExternalDuty && !externalCut)
         {
             ESP_ERROR_CHECK_WITHOUT_ABORT(ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, storedExternalDuty));
             ESP_ERROR_CHECK_WITHOUT_ABORT(ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0));
-            hasStoredExternalDuty = false;
         }
+        hasStoredExternalDuty = false;
     }
 #endif
 
@@ -168,8 +168,8 @@ void LEDManager::toggleLED(const bool state) const
 #endif
 
 #if defined(CONFIG_LED_EXTERNAL_CONTROL) && defined(CONFIG_LED_EXTERNAL_AS_DEBUG)
-    // Mirror only for error states
-    if (ledStateMap.contains(this->currentState) && ledStateMap.at(this->currentState).isError)
+    // Mirror only for error states, and never past an over-current trip
+    if (!externalCut && ledStateMap.contains(this->currentState) && ledStateMap.at(this->currentState).isError)
     {
         // For pattern ON use 50%, OFF use 0%
         uint32_t duty = (state == LED_ON) ? ((50 * 255) / 100) : 0;
@@ -182,8 +182,28 @@ void LEDManager::toggleLED(const bool state) const
 void LEDManager::setExternalLEDDutyCycle(uint8_t dutyPercent)
 {
 #ifdef CONFIG_LED_EXTERNAL_CONTROL
+    std::lock_guard lock(externalMutex);
+    // the regulator or auto exposure owns the PWM (a tripped regulator holds it at 0), the configured duty is
+    // picked up again once they let go of it
+    if (hasDutyOverride)
+    {
+        ESP_LOGI(LED_MANAGER_TAG, "External LED duty override active, %u%% applies once it's cleared", dutyPercent);
+        return;
+    }
+    ESP_LOGI(LED_MANAGER_TAG, "Updating external LED duty to %u%%", std::min(dutyPercent, dutyLimitPercent.load()));
+    applyExternalLEDDuty(dutyPercent);
+#else
+    (void)dutyPercent; // unused
+    ESP_LOGW(LED_MANAGER_TAG, "CONFIG_LED_EXTERNAL_CONTROL not enabled; ignoring duty update");
+#endif
+}
+
+void LEDManager::applyExternalLEDDuty(uint8_t dutyPercent)
+{
+#ifdef CONFIG_LED_EXTERNAL_CONTROL
+    dutyPercent = externalCut ? 0 : std::min(dutyPercent, dutyLimitPercent.load());
     const uint32_t dutyCycle = (static_cast<uint32_t>(dutyPercent) * 255) / 100;
-    ESP_LOGI(LED_MANAGER_TAG, "Updating external LED duty to %u%% (raw %lu)", dutyPercent, dutyCycle);
+    ESP_LOGD(LED_MANAGER_TAG, "External LED duty %u%% (raw %lu)", dutyPercent, dutyCycle);
 
     // Apply to LEDC hardware live
     // We configured channel 0 in setup with LEDC_LOW_SPEED_MODE
@@ -191,10 +211,103 @@ void LEDManager::setExternalLEDDutyCycle(uint8_t dutyPercent)
     ESP_ERROR_CHECK_WITHOUT_ABORT(ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0));
 #else
     (void)dutyPercent; // unused
-    ESP_LOGW(LED_MANAGER_TAG, "CONFIG_LED_EXTERNAL_CONTROL not enabled; ignoring duty update");
 #endif
 }
 
+void LEDManager::setExternalLEDDutyOverride(uint8_t dutyPercent)
+{
+    std::lock_guard lock(externalMutex);
+    dutyPercent = std::min<uint8_t>(dutyPercent, 100);
+    if (hasDutyOverride && dutyPercent == dutyOverridePercent)
+        return;
+
+    hasDutyOverride = true;
+    dutyOverridePercent = dutyPercent;
+    applyExternalLEDDuty(dutyPercent);
+}
+
+void LEDManager::clearExternalLEDDutyOverride()
+{
+    std::lock_guard lock(externalMutex);
+    if (!hasDutyOverride)
+        return;
+
+    hasDutyOverride = false;
+    ESP_LOGI(LED_MANAGER_TAG, "Updating external LED duty to %u%%", std::min(getExternalLEDDutyCycle(), dutyLimitPercent.load()));
+    applyExternalLEDDuty(getExternalLEDDutyCycle());
+}
+
+void LEDManager::setExternalLEDCut(const bool cut)
+{
+    std::lock_guard lock(externalMutex);
+    if (cut == externalCut)
+        return;
+
+    externalCut = cut;
+#ifdef CONFIG_LED_EXTERNAL_CONTROL
+    // a pulse already running ends on its own, the strobe won't start another one
+    if (externalDetached)
+        gpio_set_level(illumninator_led_pin, 0);
+    else
+        applyExternalLEDDuty(hasDutyOverride ? dutyOverridePercent.load() : getExternalLEDDutyCycle());
+#endif
+}
+
+bool LEDManager::detachExternalLED()
+{
+#ifdef CONFIG_LED_EXTERNAL_CONTROL
+    std::lock_guard lock(externalMutex);
+    if (externalDetached)
+        return true;
+
+    ESP_ERROR_CHECK_WITHOUT_ABORT(ledc_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0));
+    // routes the pin back to the GPIO output register
+    gpio_reset_pin(illumninator_led_pin);
+    gpio_set_direction(illumninator_led_pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(illumninator_led_pin, 0);
+    externalDetached = true;
+    ESP_LOGI(LED_MANAGER_TAG, "External LED detached from PWM");
+    return true;
+#else
+    ESP_LOGW(LED_MANAGER_TAG, "CONFIG_LED_EXTERNAL_CONTROL not enabled; cannot detach external LED");
+    return false;
+#endif
+}
+
+void LEDManager::attachExternalLED()
+{
+#ifdef CONFIG_LED_EXTERNAL_CONTROL
+    std::lock_guard lock(externalMutex);
+    if (!externalDetached)
+        return;
+
+    const uint8_t dutyPercent = getEffectiveExternalLEDDuty();
+    ledc_channel_config_t ledc_channel = {
+        .gpio_num = this->illumninator_led_pin,
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .channel = LEDC_CHANNEL_0,
+        .intr_type = LEDC_INTR_DISABLE,
+        .timer_sel = LEDC_TIMER_0,
+        .duty = (static_cast<uint32_t>(dutyPercent) * 255) / 100,
+        .hpoint = 0};
+    ESP_ERROR_CHECK_WITHOUT_ABORT(ledc_channel_config(&ledc_channel));
+    externalDetached = false;
+    ESP_LOGI(LED_MANAGER_TAG, "External LED back on PWM at %u%%", dutyPercent);
+#endif
+}
+
+void LEDManager::setExternalLEDDutyLimit(uint8_t limitPercent)
+{
+    std::lock_guard lock(externalMutex);
+    limitPercent = std::min<uint8_t>(limitPercent, 100);
+    if (limitPercent == dutyLimitPercent)
+        return;
+
+    ESP_LOGI(LED_MANAGER_TAG, "External LED duty limit set to %u%%", limitPercent);
+    dutyLimitPercent = limitPercent;
+    applyExternalLEDDuty(hasDutyOverride ? dutyOverridePercent.load() : getExternalLEDDutyCycle());
+}
+
 void HandleLEDDisplayTask(void *pvParameter)
 {
     auto *ledManager = static_cast<LEDManager *>(pvParameter);
@@ -12,7 +12,9 @@
 
 #include <esp_log.h>
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 #include <StateManager.hpp>
@@ -52,10 +54,46 @@ public:
   void setExternalLEDDutyCycle(uint8_t dutyPercent);
   uint8_t getExternalLEDDutyCycle() const { return deviceConfig ? deviceConfig->getDeviceConfig().led_external_pwm_duty_cycle : 0; }
 
+  // Upper bound (0-100) for the external LED duty, used by thermal throttling. The configured duty is kept as is
+  // and re-applied through the limit.
+  void setExternalLEDDutyLimit(uint8_t limitPercent);
+  uint8_t getExternalLEDDutyLimit() const { return dutyLimitPercent; }
+
+  // Runtime duty (0-100) set by the auto exposure loop in place of the configured one, not persisted.
+  // Still goes through the duty limit.
+  void setExternalLEDDutyOverride(uint8_t dutyPercent);
+  void clearExternalLEDDutyOverride();
+  bool hasExternalLEDDutyOverride() const { return hasDutyOverride; }
+  // duty the PWM is actually running at, override or configured, after the limit and the cut
+  uint8_t getEffectiveExternalLEDDuty() const
+  {
+    if (externalCut)
+      return 0;
+    return std::min<uint8_t>(hasDutyOverride ? dutyOverridePercent.load() : getExternalLEDDutyCycle(), dutyLimitPercent);
+  }
+
+  // set while the current regulator owns the override, auto exposure keeps its hands off the LED then
+  void setExternalLEDRegulated(bool regulated) { externalRegulated = regulated; }
+  bool isExternalLEDRegulated() const { return externalRegulated; }
+
+  // An over-current trip, holds the LED dark whoever drives it until it's lifted: the PWM runs at 0 whatever
+  // duty is asked for, and a frame-synchronous driver checks it before every pulse. Safe to read from an ISR.
+  void setExternalLEDCut(bool cut);
+  bool isExternalLEDCut() const { return externalCut; }
+
+  // Hands the external LED pin over to a frame-synchronous driver, the pin is left as a plain GPIO output, off.
+  // attachExternalLED() puts the PWM back with the current duty.
+  bool detachExternalLED();
+  void attachExternalLED();
+  bool isExternalLEDDetached() const { return externalDetached; }
+  gpio_num_t getExternalLEDPin() const { return illumninator_led_pin; }
+
 private:
   void toggleLED(bool state) const;
   void displayCurrentPattern();
   void updateState(LEDStates_e newState);
+  // callers hold externalMutex
+  void applyExternalLEDDuty(uint8_t dutyPercent);
 
   gpio_num_t blink_led_pin;
   gpio_num_t illumninator_led_pin;
@@ -70,6 +108,15 @@ private:
   size_t currentPatternIndex = 0;
   size_t timeToDelayFor = 100;
   bool finishedPattern = false;
+  // the regulator, auto exposure, the strobe and the commands all drive the external LED from their own tasks,
+  // every change and the PWM update that goes with it happen under the lock
+  std::mutex externalMutex;
+  std::atomic<uint8_t> dutyLimitPercent{100};
+  std::atomic<bool> hasDutyOverride{false};
+  std::atomic<uint8_t> dutyOverridePercent{0};
+  std::atomic<bool> externalDetached{false};
+  std::atomic<bool> externalRegulated{false};
+  std::atomic<bool> externalCut{false};
 
 #if defined(CONFIG_LED_EXTERNAL_CONTROL) && defined(CONFIG_LED_EXTERNAL_AS_DEBUG)
   bool hasStoredExternalDuty = false;
@@ -52,4 +52,17 @@ esp_err_t MDNSManager::start()
   xQueueSend(this->eventQueue, &event, 10);
 
   return result;
-}
\ No newline at end of file
+}
+
+void MDNSManager::stop()
+{
+  {
+    SystemEvent event = {EventSource::MDNS, MDNSState_e::MDNSState_Stopping};
+    xQueueSend(this->eventQueue, &event, 10);
+  }
+
+  mdns_free();
+
+  SystemEvent event = {EventSource::MDNS, MDNSState_e::MDNSState_Stopped};
+  xQueueSend(this->eventQueue, &event, 10);
+}
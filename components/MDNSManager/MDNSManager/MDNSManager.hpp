@@ -18,6 +18,7 @@ private:
 public:
   MDNSManager(std::shared_ptr<ProjectConfig> projectConfig, QueueHandle_t eventQueue);
   esp_err_t start();
+  void stop();
 };
 
 #endif // MDNSMANAGER_HPP
@@ -1,21 +1,32 @@
 #include "CurrentMonitor.hpp"
 #include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <climits>
 #include <cmath>
 
 #if CONFIG_MONITORING_LED_CURRENT
-#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
+#include "freertos/FreeRTOS.h"
 #endif
 
 static const char *TAG_CM = "[CurrentMonitor]";
 
-CurrentMonitor::CurrentMonitor()
-{
 #if CONFIG_MONITORING_LED_CURRENT
-    samples_.assign(CONFIG_MONITORING_LED_SAMPLES, 0);
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define CM_ADC_OUTPUT_TYPE ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define CM_ADC_GET_DATA(p_data) ((p_data)->type1.data)
+#else
+#define CM_ADC_OUTPUT_TYPE ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define CM_ADC_GET_DATA(p_data) ((p_data)->type2.data)
+#endif
+
+static constexpr uint32_t BLOCKS_PER_READING = CONFIG_MONITORING_LED_BLOCKS;
+// below this spread between the low and high level of a block the LED isn't being switched
+static constexpr int ON_LEVEL_MIN_SPREAD_RAW = 64;
 #endif
-}
 
 void CurrentMonitor::setup()
 {
@@ -34,12 +45,24 @@ float CurrentMonitor::getCurrentMilliAmps() const
         return 0.0f;
     // Physically correct scaling:
     // I[mA] = 1000 * Vshunt[mV] / R[mΩ]
-    return (1000.0f * static_cast<float>(filtered_mv_)) / static_cast<float>(shunt_milliohm);
+    return (1000.0f * (static_cast<float>(filtered_mv_q8_) / 256.0f)) / static_cast<float>(shunt_milliohm);
 #else
     return 0.0f;
 #endif
 }
 
+int32_t CurrentMonitor::millivoltsToMilliAmps(const int millivolts)
+{
+#if CONFIG_MONITORING_LED_CURRENT
+    if (CONFIG_MONITORING_LED_SHUNT_MILLIOHM <= 0)
+        return 0;
+    return static_cast<int32_t>((1000LL * millivolts) / CONFIG_MONITORING_LED_SHUNT_MILLIOHM);
+#else
+    (void)millivolts;
+    return 0;
+#endif
+}
+
 float CurrentMonitor::pollAndGetMilliAmps()
 {
     sampleOnce();
@@ -49,28 +72,32 @@ float CurrentMonitor::pollAndGetMilliAmps()
 void CurrentMonitor::sampleOnce()
 {
 #if CONFIG_MONITORING_LED_CURRENT
-    int mv = read_mv_once();
+    int mean_raw = 0;
+    int on_raw = 0;
+    if (!read_blocks(mean_raw, on_raw))
+        return;
+
     // Divide by analog gain/divider factor to get shunt voltage
+    int mv = raw_to_mv(mean_raw);
+    int on_mv = raw_to_mv(on_raw);
     if (CONFIG_MONITORING_LED_GAIN > 0)
+    {
         mv = mv / CONFIG_MONITORING_LED_GAIN;
+        on_mv = on_mv / CONFIG_MONITORING_LED_GAIN;
+    }
+    sample_mv_ = on_mv;
 
-    // Moving average over N samples
-    if (samples_.empty())
+    // first order low-pass in Q8, y += (x - y) / N
+    const int32_t mv_q8 = static_cast<int32_t>(mv) << 8;
+    if (!filter_primed_)
     {
-        samples_.assign(CONFIG_MONITORING_LED_SAMPLES, 0);
-        sample_sum_ = 0;
-        sample_idx_ = 0;
-        sample_count_ = 0;
+        filtered_mv_q8_ = mv_q8;
+        filter_primed_ = true;
+    }
+    else
+    {
+        filtered_mv_q8_ += (mv_q8 - filtered_mv_q8_) / CONFIG_MONITORING_LED_SAMPLES;
     }
-
-    sample_sum_ -= samples_[sample_idx_];
-    samples_[sample_idx_] = mv;
-    sample_sum_ += mv;
-    sample_idx_ = (sample_idx_ + 1) % samples_.size();
-    if (sample_count_ < samples_.size())
-        sample_count_++;
-
-    filtered_mv_ = sample_sum_ / static_cast<int>(sample_count_ > 0 ? sample_count_ : 1);
 #else
     (void)0;
 #endif
@@ -78,34 +105,27 @@ void CurrentMonitor::sampleOnce()
 
 #if CONFIG_MONITORING_LED_CURRENT
 
-static adc_oneshot_unit_handle_t s_adc_handle = nullptr;
+static adc_continuous_handle_t s_adc_handle = nullptr;
 static adc_cali_handle_t s_cali_handle = nullptr;
 static bool s_cali_inited = false;
 static adc_channel_t s_channel;
 static adc_unit_t s_unit;
+// one DMA frame is one block
+static uint8_t *s_block_buf = nullptr;
+static uint32_t s_block_bytes = 0;
+
+static bool IRAM_ATTR on_pool_overflow(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data)
+{
+    (void)handle;
+    static_cast<std::atomic<uint32_t> *>(user_data)->fetch_add(edata->size / SOC_ADC_DIGI_RESULT_BYTES);
+    return false;
+}
 
 void CurrentMonitor::init_adc()
 {
     // Derive ADC unit/channel from GPIO
     int gpio = CONFIG_MONITORING_LED_ADC_GPIO;
 
-    esp_err_t err;
-    adc_oneshot_unit_init_cfg_t unit_cfg = {
-        .unit_id = ADC_UNIT_1,
-    };
-    err = adc_oneshot_new_unit(&unit_cfg, &s_adc_handle);
-    if (err != ESP_OK)
-    {
-        ESP_LOGE(TAG_CM, "adc_oneshot_new_unit failed: %s", esp_err_to_name(err));
-        return;
-    }
-
-    // Try to map GPIO to ADC channel automatically if helper exists; otherwise guess for ESP32-S3 ADC1
-#ifdef ADC1_GPIO1_CHANNEL
-    (void)0; // placeholder for potential future macros
-#endif
-
-    // Use IO-to-channel helper where available
 #ifdef CONFIG_IDF_TARGET_ESP32S3
     // ESP32-S3: ADC1 channels on GPIO1..GPIO10 map to CH0..CH9
     if (gpio >= 1 && gpio <= 10)
@@ -125,21 +145,74 @@ void CurrentMonitor::init_adc()
     s_channel = ADC_CHANNEL_0;
 #endif
 
-    adc_oneshot_chan_cfg_t chan_cfg = {
+    // pick the rate and block length, with PWM sync both line up with whole PWM periods
+    sample_rate_hz_ = CONFIG_MONITORING_LED_SAMPLE_RATE_HZ;
+    block_samples_ = CONFIG_MONITORING_LED_BLOCK_SAMPLES;
+#if CONFIG_MONITORING_LED_SYNC_PWM
+    {
+        const uint32_t pwm_hz = CONFIG_LED_EXTERNAL_PWM_FREQ;
+        uint32_t per_period = (sample_rate_hz_ + pwm_hz / 2) / pwm_hz;
+        per_period = std::max<uint32_t>(per_period, (SOC_ADC_SAMPLE_FREQ_THRES_LOW + pwm_hz - 1) / pwm_hz);
+        per_period = std::max<uint32_t>(per_period, 1);
+        while (per_period > 1 && per_period * pwm_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH)
+            per_period--;
+        sample_rate_hz_ = per_period * pwm_hz;
+        // whole periods per block, at least one
+        block_samples_ = std::max<uint32_t>(per_period, (block_samples_ / per_period) * per_period);
+    }
+#endif
+    sample_rate_hz_ = std::clamp<uint32_t>(sample_rate_hz_, SOC_ADC_SAMPLE_FREQ_THRES_LOW, SOC_ADC_SAMPLE_FREQ_THRES_HIGH);
+
+    s_block_bytes = block_samples_ * SOC_ADC_DIGI_RESULT_BYTES;
+    s_block_buf = static_cast<uint8_t *>(heap_caps_malloc(s_block_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    if (s_block_buf == nullptr)
+    {
+        ESP_LOGE(TAG_CM, "Failed to allocate ADC block buffer");
+        return;
+    }
+
+    adc_continuous_handle_cfg_t handle_cfg = {
+        .max_store_buf_size = s_block_bytes * (BLOCKS_PER_READING + 1),
+        .conv_frame_size = s_block_bytes,
+    };
+    esp_err_t err = adc_continuous_new_handle(&handle_cfg, &s_adc_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG_CM, "adc_continuous_new_handle failed: %s", esp_err_to_name(err));
+        s_adc_handle = nullptr;
+        return;
+    }
+
+    adc_digi_pattern_config_t pattern = {
         .atten = ADC_ATTEN_DB_11,
-        .bitwidth = ADC_BITWIDTH_DEFAULT,
+        .channel = static_cast<uint8_t>(s_channel),
+        .unit = static_cast<uint8_t>(s_unit),
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
     };
-    err = adc_oneshot_config_channel(s_adc_handle, s_channel, &chan_cfg);
+    adc_continuous_config_t dig_cfg = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = sample_rate_hz_,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = CM_ADC_OUTPUT_TYPE,
+    };
+    err = adc_continuous_config(s_adc_handle, &dig_cfg);
     if (err != ESP_OK)
     {
-        ESP_LOGE(TAG_CM, "adc_oneshot_config_channel failed: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG_CM, "adc_continuous_config failed: %s", esp_err_to_name(err));
     }
 
+    adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = nullptr,
+        .on_pool_ovf = &on_pool_overflow,
+    };
+    ESP_ERROR_CHECK_WITHOUT_ABORT(adc_continuous_register_event_callbacks(s_adc_handle, &cbs, &overflows_));
+
     // Calibration using curve fitting if available
     adc_cali_curve_fitting_config_t cal_cfg = {
         .unit_id = s_unit,
-        .atten = chan_cfg.atten,
-        .bitwidth = chan_cfg.bitwidth,
+        .atten = pattern.atten,
+        .bitwidth = ADC_BITWIDTH_12,
     };
     if (adc_cali_create_scheme_curve_fitting(&cal_cfg, &s_cali_handle) == ESP_OK)
     {
@@ -151,16 +224,87 @@ void CurrentMonitor::init_adc()
         s_cali_inited = false;
         ESP_LOGW(TAG_CM, "ADC calibration not available; using raw-to-mV approximation");
     }
+
+    ESP_LOGI(TAG_CM, "Continuous ADC at %lu Hz, %lu samples per block, %lu blocks per reading",
+             static_cast<unsigned long>(sample_rate_hz_), static_cast<unsigned long>(block_samples_),
+             static_cast<unsigned long>(BLOCKS_PER_READING));
 }
 
-int CurrentMonitor::read_mv_once()
+bool CurrentMonitor::read_blocks(int &mean_raw, int &on_raw)
 {
-    if (!s_adc_handle)
-        return 0;
-    int raw = 0;
-    if (adc_oneshot_read(s_adc_handle, s_channel, &raw) != ESP_OK)
-        return 0;
+    if (!s_adc_handle || !s_block_buf)
+        return false;
+
+    // the converter only runs while we're reading, between readings it's idle and nothing piles up
+    if (adc_continuous_start(s_adc_handle) != ESP_OK)
+        return false;
+
+    // a block takes block_samples_ / rate, give it twice that
+    const uint32_t timeout_ms = std::max<uint32_t>(2, 2000 * block_samples_ / sample_rate_hz_);
+    int64_t sum = 0;
+    uint32_t count = 0;
+    int64_t on_sum = 0;
+    uint32_t on_count = 0;
+    uint32_t blocks = 0;
+    // the first block may hold whatever was left in the DMA buffer when we last stopped, skip it
+    for (uint32_t attempt = 0; attempt < BLOCKS_PER_READING + 1; attempt++)
+    {
+        uint32_t got = 0;
+        if (adc_continuous_read(s_adc_handle, s_block_buf, s_block_bytes, &got, timeout_ms) != ESP_OK)
+            break;
+        if (attempt == 0)
+            continue;
+
+        // one pass for the block's range and sum, a second one for the samples taken with the LED on
+        int block_min = INT32_MAX;
+        int block_max = 0;
+        int64_t block_sum = 0;
+        const uint32_t samples = got / SOC_ADC_DIGI_RESULT_BYTES;
+        for (uint32_t i = 0; i < samples; i++)
+        {
+            const auto *p = reinterpret_cast<const adc_digi_output_data_t *>(&s_block_buf[i * SOC_ADC_DIGI_RESULT_BYTES]);
+            const int raw = CM_ADC_GET_DATA(p);
+            block_sum += raw;
+            block_min = std::min(block_min, raw);
+            block_max = std::max(block_max, raw);
+        }
+        if (samples == 0)
+            continue;
 
+        sum += block_sum;
+        count += samples;
+        blocks++;
+
+        if (block_max - block_min < ON_LEVEL_MIN_SPREAD_RAW)
+        {
+            on_sum += block_sum;
+            on_count += samples;
+            continue;
+        }
+        const int threshold = (block_min + block_max) / 2;
+        for (uint32_t i = 0; i < samples; i++)
+        {
+            const auto *p = reinterpret_cast<const adc_digi_output_data_t *>(&s_block_buf[i * SOC_ADC_DIGI_RESULT_BYTES]);
+            const int raw = CM_ADC_GET_DATA(p);
+            if (raw > threshold)
+            {
+                on_sum += raw;
+                on_count++;
+            }
+        }
+    }
+    adc_continuous_stop(s_adc_handle);
+
+    if (blocks == 0 || count == 0)
+        return false;
+
+    mean_raw = static_cast<int>(sum / count);
+    on_raw = on_count > 0 ? static_cast<int>(on_sum / on_count) : mean_raw;
+    return true;
+}
+
+int CurrentMonitor::raw_to_mv(const int raw) const
+{
     int mv = 0;
     if (s_cali_inited)
     {
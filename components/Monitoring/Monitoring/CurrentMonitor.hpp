@@ -1,27 +1,39 @@
 #ifndef CURRENT_MONITOR_HPP
 #define CURRENT_MONITOR_HPP
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <memory>
-#include <vector>
 #include "sdkconfig.h"
 
 class CurrentMonitor {
 public:
-    CurrentMonitor();
+    CurrentMonitor() = default;
     ~CurrentMonitor() = default;
 
     void setup();
+    // Reads the latest DMA blocks and updates the filtered value, blocks for about one reading's worth of samples
     void sampleOnce();
 
     // Returns filtered voltage in millivolts at shunt (after dividing by gain)
-    int getFilteredMillivolts() const { return filtered_mv_; }
+    int getFilteredMillivolts() const { return filtered_mv_q8_ >> 8; }
     // Returns current in milliamps computed as Vshunt[mV] / R[mΩ]
     float getCurrentMilliAmps() const;
 
+    // Shunt voltage while the LED was on during the last reading (average of the samples above the
+    // midpoint between the block's low and high level), unfiltered. Same as the average for a steady LED.
+    int getSampleMillivolts() const { return sample_mv_; }
+    // Integer Vshunt[mV] -> I[mA], for the fixed-point regulation loop
+    static int32_t millivoltsToMilliAmps(int millivolts);
+
     // convenience: combined sampling and compute; returns mA
     float pollAndGetMilliAmps();
 
+    // ADC samples per second actually configured, after rounding to the PWM frequency
+    uint32_t getSampleRateHz() const { return sample_rate_hz_; }
+    // samples lost because the task didn't read the DMA buffer in time
+    uint32_t getOverflows() const { return overflows_.load(); }
+
     // Whether monitoring is enabled by Kconfig
     static constexpr bool isEnabled()
     {
@@ -35,15 +47,18 @@ public:
 private:
 #if CONFIG_MONITORING_LED_CURRENT
     void init_adc();
-    int read_mv_once();
-    int gpio_to_adc_channel(int gpio);
+    // averages whole blocks from the DMA buffer, false if none came in time
+    bool read_blocks(int &mean_raw, int &on_raw);
+    int raw_to_mv(int raw) const;
 #endif
 
-    int filtered_mv_ = 0;
-    int sample_sum_ = 0;
-    std::vector<int> samples_;
-    size_t sample_idx_ = 0;
-    size_t sample_count_ = 0;
+    // fixed point, millivolts << 8
+    int32_t filtered_mv_q8_ = 0;
+    bool filter_primed_ = false;
+    int sample_mv_ = 0;
+    uint32_t sample_rate_hz_ = 0;
+    uint32_t block_samples_ = 0;
+    std::atomic<uint32_t> overflows_{0};
 };
 
 #endif
@@ -1,29 +1,64 @@
 #include "MonitoringManager.hpp"
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cmath>
 #include "sdkconfig.h"
 
 static const char* TAG_MM = "[MonitoringManager]";
 
+#if CONFIG_MONITORING_LED_CURRENT || CONFIG_MONITORING_THERMAL || CONFIG_MONITORING_SYSTEM
+#define MONITORING_TASK_ENABLED 1
+#endif
+
+// the task wakes at the current sampling rate when that's enabled, thermal and system checks piggyback on it
+#if CONFIG_MONITORING_LED_CURRENT
+static constexpr int MONITORING_TICK_MS = CONFIG_MONITORING_LED_INTERVAL_MS;
+#elif CONFIG_MONITORING_THERMAL && CONFIG_MONITORING_SYSTEM
+static constexpr int MONITORING_TICK_MS = std::min(CONFIG_MONITORING_THERMAL_INTERVAL_MS, CONFIG_MONITORING_SYSTEM_INTERVAL_MS);
+#elif CONFIG_MONITORING_THERMAL
+static constexpr int MONITORING_TICK_MS = CONFIG_MONITORING_THERMAL_INTERVAL_MS;
+#elif CONFIG_MONITORING_SYSTEM
+static constexpr int MONITORING_TICK_MS = CONFIG_MONITORING_SYSTEM_INTERVAL_MS;
+#endif
+
 void MonitoringManager::setup()
 {
+    tm_.setup();
 #if CONFIG_MONITORING_LED_CURRENT
     cm_.setup();
-    ESP_LOGI(TAG_MM, "Monitoring enabled. Interval=%dms, Samples=%d, Gain=%d, R=%dmΩ",
+    ESP_LOGI(TAG_MM, "Monitoring enabled. Interval=%dms, ADC=%luHz, Filter=%d, Gain=%d, R=%dmΩ",
              CONFIG_MONITORING_LED_INTERVAL_MS,
+             static_cast<unsigned long>(cm_.getSampleRateHz()),
              CONFIG_MONITORING_LED_SAMPLES,
              CONFIG_MONITORING_LED_GAIN,
              CONFIG_MONITORING_LED_SHUNT_MILLIOHM);
 #else
     ESP_LOGI(TAG_MM, "Monitoring disabled by Kconfig");
 #endif
+#if CONFIG_MONITORING_THERMAL
+    ESP_LOGI(TAG_MM, "Thermal monitoring enabled. Interval=%dms, Warm=%d°C, Critical=%d°C, Hysteresis=%d°C",
+             CONFIG_MONITORING_THERMAL_INTERVAL_MS,
+             CONFIG_MONITORING_THERMAL_WARM_C,
+             CONFIG_MONITORING_THERMAL_CRITICAL_C,
+             CONFIG_MONITORING_THERMAL_HYSTERESIS_C);
+#endif
+#if CONFIG_MONITORING_SYSTEM
+    ESP_LOGI(TAG_MM, "System statistics enabled. Interval=%dms, History=%d, Tasks=%s, CPU=%s",
+             CONFIG_MONITORING_SYSTEM_INTERVAL_MS,
+             CONFIG_MONITORING_SYSTEM_HISTORY,
+             SystemMonitor::hasTaskStats() ? "yes" : "no",
+             SystemMonitor::hasCpuStats() ? "yes" : "no");
+#endif
 }
 
 void MonitoringManager::start()
 {
-#if CONFIG_MONITORING_LED_CURRENT
+#ifdef MONITORING_TASK_ENABLED
     if (task_ == nullptr)
     {
-        xTaskCreate(&MonitoringManager::taskEntry, "MonitoringTask", 2048, this, 1, &task_);
+        // thermal callbacks may re-initialize the camera from this task, hence the larger stack
+        xTaskCreate(&MonitoringManager::taskEntry, "MonitoringTask", 4096, this, 1, &task_);
     }
 #endif
 }
@@ -43,14 +78,58 @@ void MonitoringManager::taskEntry(void* arg)
     static_cast<MonitoringManager*>(arg)->run();
 }
 
+void MonitoringManager::updateThermal()
+{
+    const float celsius = tm_.readCelsius();
+    last_temp_c_.store(celsius);
+
+    const ThermalState current = thermal_state_.load();
+    const ThermalState next = TemperatureMonitor::evaluate(current, celsius);
+    if (next == current)
+        return;
+
+    ESP_LOGW(TAG_MM, "Thermal state %s -> %s at %.1f°C",
+             thermalStateToString(current), thermalStateToString(next), celsius);
+    thermal_state_.store(next);
+    thermal_transitions_++;
+
+    if (thermal_cb_)
+        thermal_cb_(next);
+}
+
 void MonitoringManager::run()
 {
-#if CONFIG_MONITORING_LED_CURRENT
+#ifdef MONITORING_TASK_ENABLED
+#if CONFIG_MONITORING_THERMAL
+    int64_t next_thermal_us = 0;
+#endif
+#if CONFIG_MONITORING_SYSTEM
+    int64_t next_system_us = 0;
+#endif
     while (true)
     {
+#if CONFIG_MONITORING_LED_CURRENT
         float ma = cm_.pollAndGetMilliAmps();
         last_current_ma_.store(ma);
-        vTaskDelay(pdMS_TO_TICKS(CONFIG_MONITORING_LED_INTERVAL_MS));
+        if (current_cb_)
+            current_cb_(CurrentMonitor::millivoltsToMilliAmps(cm_.getFilteredMillivolts()),
+                        CurrentMonitor::millivoltsToMilliAmps(cm_.getSampleMillivolts()));
+#endif
+#if CONFIG_MONITORING_THERMAL
+        if (const int64_t now_us = esp_timer_get_time(); now_us >= next_thermal_us)
+        {
+            updateThermal();
+            next_thermal_us = now_us + static_cast<int64_t>(CONFIG_MONITORING_THERMAL_INTERVAL_MS) * 1000;
+        }
+#endif
+#if CONFIG_MONITORING_SYSTEM
+        if (const int64_t now_us = esp_timer_get_time(); now_us >= next_system_us)
+        {
+            sm_.sample();
+            next_system_us = now_us + static_cast<int64_t>(CONFIG_MONITORING_SYSTEM_INTERVAL_MS) * 1000;
+        }
+#endif
+        vTaskDelay(pdMS_TO_TICKS(MONITORING_TICK_MS));
     }
 #else
     vTaskDelete(nullptr);
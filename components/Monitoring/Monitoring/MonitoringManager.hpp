@@ -2,10 +2,17 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <atomic>
+#include <cmath>
+#include <functional>
 #include "CurrentMonitor.hpp"
+#include "SystemMonitor.hpp"
+#include "TemperatureMonitor.hpp"
 
 class MonitoringManager {
 public:
+    using ThermalCallback = std::function<void(ThermalState)>;
+    // filtered average and latest unfiltered on-current of the LED, in mA
+    using CurrentCallback = std::function<void(int32_t, int32_t)>;
 
     void setup();
     void start();
@@ -14,11 +21,38 @@ public:
     // Latest filtered current in mA
     float getCurrentMilliAmps() const { return last_current_ma_.load(); }
 
+    // Internal die temperature in °C, NAN if the sensor is unavailable
+    float getChipTemperatureCelsius() { return tm_.readCelsius(); }
+
+    // Last temperature seen by the background task, NAN until the first sample
+    float getLastChipTemperatureCelsius() const { return last_temp_c_.load(); }
+    ThermalState getThermalState() const { return thermal_state_.load(); }
+    uint32_t getThermalTransitions() const { return thermal_transitions_.load(); }
+
+    // Called from the monitoring task whenever the throttle state changes, set it before start()
+    void setThermalCallback(ThermalCallback callback) { thermal_cb_ = std::move(callback); }
+
+    // Latest CPU/stack/heap sample and per-task figures, zeroed until the first sample
+    void getSystemSnapshot(SystemSnapshot& out) const { sm_.getSnapshot(out); }
+    // Copies up to max samples of the system history, oldest first
+    size_t copySystemHistory(SystemSample* out, size_t max) const { return sm_.copyHistory(out, max); }
+
+    // Called from the monitoring task after every current sample, set it before start()
+    void setCurrentCallback(CurrentCallback callback) { current_cb_ = std::move(callback); }
+
 private:
     static void taskEntry(void* arg);
     void run();
+    void updateThermal();
 
     TaskHandle_t task_{nullptr};
     std::atomic<float> last_current_ma_{0.0f};
+    std::atomic<float> last_temp_c_{NAN};
+    std::atomic<ThermalState> thermal_state_{ThermalState::Normal};
+    std::atomic<uint32_t> thermal_transitions_{0};
+    ThermalCallback thermal_cb_;
+    CurrentCallback current_cb_;
     CurrentMonitor cm_;
+    TemperatureMonitor tm_;
+    SystemMonitor sm_;
 };
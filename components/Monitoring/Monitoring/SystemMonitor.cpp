@@ -0,0 +1,129 @@
+#include "SystemMonitor.hpp"
+#include <algorithm>
+#include <cstring>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+void SystemMonitor::sample()
+{
+    SystemSample sample{};
+    sample.uptime_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    sampleHeap(sample);
+    sampleTasks(sample);
+
+    std::lock_guard lock(mutex_);
+    latest_ = sample;
+    history_[history_next_] = sample;
+    history_next_ = (history_next_ + 1) % history_.size();
+    history_count_ = std::min(history_count_ + 1, history_.size());
+}
+
+void SystemMonitor::sampleHeap(SystemSample &sample) const
+{
+    constexpr uint32_t internal_caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    sample.internal_free = heap_caps_get_free_size(internal_caps);
+    sample.internal_largest = heap_caps_get_largest_free_block(internal_caps);
+    sample.internal_min_free = heap_caps_get_minimum_free_size(internal_caps);
+    // both 0 on boards without PSRAM
+    sample.psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    sample.psram_largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+
+    sample.fragmentation_percent = sample.internal_free == 0
+        ? 0
+        : static_cast<uint8_t>(100 - static_cast<uint64_t>(sample.internal_largest) * 100 / sample.internal_free);
+}
+
+void SystemMonitor::sampleTasks(SystemSample &sample)
+{
+    std::fill(std::begin(sample.cpu_percent), std::end(sample.cpu_percent), -1);
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    const UBaseType_t count = uxTaskGetSystemState(status_.data(), status_.size(), &total);
+    if (count == 0)
+    {
+        // more tasks than slots, the next sample will try again
+        return;
+    }
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // the counter runs once per core in parallel, so a task pinned to one core tops out at 100 / cores
+    const configRUN_TIME_COUNTER_TYPE elapsed = total - prev_total_;
+    const bool have_delta = prev_total_ != 0 && elapsed > 0;
+#endif
+
+    // filled in place, a second copy would cost the monitoring task another kilobyte of stack
+    std::lock_guard lock(mutex_);
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t &status = status_[i];
+        TaskSample &task = tasks_[i];
+        task = {};
+        std::strncpy(task.name, status.pcTaskName, sizeof(task.name) - 1);
+        task.priority = status.uxCurrentPriority;
+        task.stack_free_min = status.usStackHighWaterMark;
+        task.cpu_percent = -1.0f;
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        if (!have_delta)
+            continue;
+
+        // tasks created since the last sample count from zero
+        configRUN_TIME_COUNTER_TYPE previous = 0;
+        for (size_t j = 0; j < prev_count_; j++)
+        {
+            if (prev_handles_[j] == status.xHandle)
+            {
+                previous = prev_runtime_[j];
+                break;
+            }
+        }
+        const configRUN_TIME_COUNTER_TYPE ran = status.ulRunTimeCounter - previous;
+        task.cpu_percent = static_cast<float>(ran) * 100.0f / (static_cast<float>(elapsed) * portNUM_PROCESSORS);
+
+        for (BaseType_t core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            if (status.xHandle == xTaskGetIdleTaskHandleForCore(core))
+            {
+                const float idle = std::min(100.0f, static_cast<float>(ran) * 100.0f / static_cast<float>(elapsed));
+                sample.cpu_percent[core] = static_cast<int8_t>(100.0f - idle + 0.5f);
+            }
+        }
+#endif
+    }
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        prev_handles_[i] = status_[i].xHandle;
+        prev_runtime_[i] = status_[i].ulRunTimeCounter;
+    }
+    prev_count_ = count;
+    prev_total_ = total;
+#endif
+
+    // busiest first so the interesting ones lead the list
+    std::sort(tasks_.begin(), tasks_.begin() + count, [](const TaskSample &a, const TaskSample &b)
+              { return a.cpu_percent > b.cpu_percent; });
+    task_count_ = count;
+#endif
+}
+
+void SystemMonitor::getSnapshot(SystemSnapshot &out) const
+{
+    std::lock_guard lock(mutex_);
+    out.latest = latest_;
+    out.tasks = tasks_;
+    out.task_count = task_count_;
+}
+
+size_t SystemMonitor::copyHistory(SystemSample *out, const size_t max) const
+{
+    std::lock_guard lock(mutex_);
+    const size_t count = std::min(max, history_count_);
+    // skip the oldest ones if the caller has less room than the ring
+    const size_t oldest = (history_next_ + history_.size() - history_count_) % history_.size();
+    const size_t first = oldest + (history_count_ - count);
+    for (size_t i = 0; i < count; i++)
+        out[i] = history_[(first + i) % history_.size()];
+    return count;
+}
@@ -0,0 +1,102 @@
+#ifndef SYSTEM_MONITOR_HPP
+#define SYSTEM_MONITOR_HPP
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "sdkconfig.h"
+
+#if CONFIG_MONITORING_SYSTEM
+static constexpr size_t SYSTEM_HISTORY_LENGTH = CONFIG_MONITORING_SYSTEM_HISTORY;
+#else
+static constexpr size_t SYSTEM_HISTORY_LENGTH = 1;
+#endif
+// tasks tracked per sample, anything past this is left out
+static constexpr size_t SYSTEM_MAX_TASKS = 32;
+
+// one point of the time series, kept small so the ring fits comfortably in internal RAM
+struct SystemSample {
+    uint32_t uptime_ms;
+    // 0-100 per core, -1 when run time stats aren't built in
+    int8_t cpu_percent[portNUM_PROCESSORS];
+    uint32_t internal_free;
+    uint32_t internal_largest;
+    uint32_t internal_min_free;
+    uint32_t psram_free;
+    uint32_t psram_largest;
+    // 100 - largest free block / total free, internal heap
+    uint8_t fragmentation_percent;
+};
+
+struct TaskSample {
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    // share of all cores over the last interval, -1 when run time stats aren't built in
+    float cpu_percent;
+    // smallest amount of stack the task has had left, in bytes
+    uint32_t stack_free_min;
+};
+
+struct SystemSnapshot {
+    SystemSample latest;
+    std::array<TaskSample, SYSTEM_MAX_TASKS> tasks;
+    size_t task_count;
+};
+
+// Samples CPU load per task and core, stack high-water marks and heap state. Runs from the monitoring task,
+// all buffers are allocated up front so sampling and reading don't touch the heap they're measuring.
+class SystemMonitor {
+public:
+    void sample();
+
+    // copies into the caller's buffer, a snapshot is too large to pass around by value on small task stacks
+    void getSnapshot(SystemSnapshot &out) const;
+    // oldest first, returns how many were copied
+    size_t copyHistory(SystemSample *out, size_t max) const;
+
+    // Whether the FreeRTOS build carries the per-task figures
+    static constexpr bool hasTaskStats()
+    {
+    #if CONFIG_FREERTOS_USE_TRACE_FACILITY
+        return true;
+    #else
+        return false;
+    #endif
+    }
+
+    static constexpr bool hasCpuStats()
+    {
+    #if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        return true;
+    #else
+        return false;
+    #endif
+    }
+
+private:
+    void sampleHeap(SystemSample &sample) const;
+    void sampleTasks(SystemSample &sample);
+
+    mutable std::mutex mutex_;
+    SystemSample latest_{};
+    std::array<SystemSample, SYSTEM_HISTORY_LENGTH> history_{};
+    size_t history_next_ = 0;
+    size_t history_count_ = 0;
+
+    std::array<TaskSample, SYSTEM_MAX_TASKS> tasks_{};
+    size_t task_count_ = 0;
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    // uxTaskGetSystemState() output and the run time counters of the previous sample, for the deltas
+    std::array<TaskStatus_t, SYSTEM_MAX_TASKS> status_{};
+    std::array<TaskHandle_t, SYSTEM_MAX_TASKS> prev_handles_{};
+    std::array<configRUN_TIME_COUNTER_TYPE, SYSTEM_MAX_TASKS> prev_runtime_{};
+    size_t prev_count_ = 0;
+    configRUN_TIME_COUNTER_TYPE prev_total_ = 0;
+#endif
+};
+
+#endif
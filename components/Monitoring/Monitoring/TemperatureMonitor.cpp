@@ -0,0 +1,102 @@
+#include "TemperatureMonitor.hpp"
+#include <esp_log.h>
+#include <cmath>
+
+#if CONFIG_SOC_TEMP_SENSOR_SUPPORTED
+#include "driver/temperature_sensor.h"
+#endif
+
+static const char *TAG_TM = "[TemperatureMonitor]";
+
+#if CONFIG_SOC_TEMP_SENSOR_SUPPORTED
+static temperature_sensor_handle_t s_temp_handle = nullptr;
+#endif
+
+void TemperatureMonitor::setup()
+{
+#if CONFIG_SOC_TEMP_SENSOR_SUPPORTED
+    if (ready_)
+        return;
+
+    // -10..80°C is the range with the best accuracy and covers a tracker sealed in a headset
+    temperature_sensor_config_t cfg = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
+    esp_err_t err = temperature_sensor_install(&cfg, &s_temp_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG_TM, "temperature_sensor_install failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+    err = temperature_sensor_enable(s_temp_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG_TM, "temperature_sensor_enable failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+    ready_ = true;
+    ESP_LOGI(TAG_TM, "Internal temperature sensor enabled");
+#else
+    ESP_LOGI(TAG_TM, "Internal temperature sensor not supported on this target");
+#endif
+}
+
+float TemperatureMonitor::readCelsius()
+{
+#if CONFIG_SOC_TEMP_SENSOR_SUPPORTED
+    if (!ready_)
+        return NAN;
+
+    float celsius = NAN;
+    if (temperature_sensor_get_celsius(s_temp_handle, &celsius) != ESP_OK)
+        return NAN;
+    return celsius;
+#else
+    return NAN;
+#endif
+}
+
+const char *thermalStateToString(const ThermalState state)
+{
+    switch (state)
+    {
+    case ThermalState::Normal:
+        return "normal";
+    case ThermalState::Warm:
+        return "warm";
+    case ThermalState::Critical:
+        return "critical";
+    }
+    return "unknown";
+}
+
+ThermalState TemperatureMonitor::evaluate(const ThermalState current, const float celsius)
+{
+#if CONFIG_MONITORING_THERMAL
+    if (std::isnan(celsius))
+        return current;
+
+    constexpr float warm_c = CONFIG_MONITORING_THERMAL_WARM_C;
+    constexpr float critical_c = CONFIG_MONITORING_THERMAL_CRITICAL_C;
+    constexpr float hysteresis_c = CONFIG_MONITORING_THERMAL_HYSTERESIS_C;
+
+    if (celsius >= critical_c)
+        return ThermalState::Critical;
+
+    switch (current)
+    {
+    case ThermalState::Critical:
+        if (celsius >= critical_c - hysteresis_c)
+            return ThermalState::Critical;
+        return celsius >= warm_c - hysteresis_c ? ThermalState::Warm : ThermalState::Normal;
+    case ThermalState::Warm:
+        return celsius >= warm_c - hysteresis_c ? ThermalState::Warm : ThermalState::Normal;
+    case ThermalState::Normal:
+    default:
+        return celsius >= warm_c ? ThermalState::Warm : ThermalState::Normal;
+    }
+#else
+    (void)celsius;
+    return current;
+#endif
+}
@@ -0,0 +1,36 @@
+#ifndef TEMPERATURE_MONITOR_HPP
+#define TEMPERATURE_MONITOR_HPP
+#pragma once
+#include <cstdint>
+#include "sdkconfig.h"
+
+enum class ThermalState : uint8_t
+{
+    Normal = 0,
+    Warm,
+    Critical,
+};
+
+const char *thermalStateToString(ThermalState state);
+
+class TemperatureMonitor {
+public:
+    TemperatureMonitor() = default;
+    ~TemperatureMonitor() = default;
+
+    void setup();
+
+    // Reads the ESP32-S3 internal die temperature, returns NAN when the sensor is unavailable
+    float readCelsius();
+
+    bool isReady() const { return ready_; }
+
+    // Next throttle state for a reading. Entering a state happens at its threshold,
+    // leaving it only once we've cooled down by the hysteresis margin below it.
+    static ThermalState evaluate(ThermalState current, float celsius);
+
+private:
+    bool ready_ = false;
+};
+
+#endif
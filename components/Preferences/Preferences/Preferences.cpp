@@ -8,7 +8,7 @@ const char *nvs_errors[] = {"OTHER", "NOT_INITIALIZED", "NOT_FOUND", "TYPE_MISMA
                             "INVALID_HANDLE", "REMOVE_FAILED", "KEY_TOO_LONG", "PAGE_FULL", "INVALID_STATE", "INVALID_LENGTH"};
 #define nvs_error(e) (((e) > ESP_ERR_NVS_BASE) ? nvs_errors[(e) & ~(ESP_ERR_NVS_BASE)] : nvs_errors[0])
 
-Preferences::Preferences() : _handle(0), _started(false), _readOnly(false) {}
+Preferences::Preferences() : _handle(0), _started(false), _readOnly(false), _batching(false), _batchFailed(false), _keyWrites(0) {}
 bool Preferences::begin(const char *name, bool readOnly, const char *partition_label)
 {
   if (_started)
@@ -95,9 +95,46 @@ bool Preferences::remove(const char *key)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_erase_key fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return false;
   }
-  err = nvs_commit(_handle);
+  return commitUnlessBatched(key);
+}
+
+/*
+ * Defer the commits of put and remove calls, so a group of them is committed once
+ * */
+
+void Preferences::beginBatch()
+{
+  _batching = true;
+  _batchFailed = false;
+}
+
+bool Preferences::endBatch()
+{
+  _batching = false;
+  if (!_started || _readOnly)
+  {
+    return false;
+  }
+  esp_err_t err = nvs_commit(_handle);
+  if (err)
+  {
+    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s", nvs_error(err));
+    return false;
+  }
+  return !_batchFailed;
+}
+
+bool Preferences::commitUnlessBatched(const char *key)
+{
+  _keyWrites++;
+  if (_batching)
+  {
+    return true;
+  }
+  esp_err_t err = nvs_commit(_handle);
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
@@ -120,12 +157,11 @@ size_t Preferences::putChar(const char *key, int8_t value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_i8 fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return 1;
@@ -141,12 +177,11 @@ size_t Preferences::putUChar(const char *key, uint8_t value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_u8 fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return 1;
@@ -162,12 +197,11 @@ size_t Preferences::putShort(const char *key, int16_t value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_i16 fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return 2;
@@ -183,12 +217,11 @@ size_t Preferences::putUShort(const char *key, uint16_t value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_u16 fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return 2;
@@ -204,12 +237,11 @@ size_t Preferences::putInt(const char *key, int32_t value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_i32 fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return 4;
@@ -225,12 +257,11 @@ size_t Preferences::putUInt(const char *key, uint32_t value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_u32 fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return 4;
@@ -256,12 +287,11 @@ size_t Preferences::putLong64(const char *key, int64_t value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_i64 fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return 8;
@@ -277,12 +307,11 @@ size_t Preferences::putULong64(const char *key, uint64_t value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_u64 fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return 8;
@@ -313,12 +342,11 @@ size_t Preferences::putString(const char *key, const char *value)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_str fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return strlen(value);
@@ -339,12 +367,11 @@ size_t Preferences::putBytes(const char *key, const void *value, size_t len)
   if (err)
   {
     ESP_LOGE(PREFERENCES_TAG, "nvs_set_blob fail: %s %s", key, nvs_error(err));
+    _batchFailed = true;
     return 0;
   }
-  err = nvs_commit(_handle);
-  if (err)
+  if (!commitUnlessBatched(key))
   {
-    ESP_LOGE(PREFERENCES_TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
     return 0;
   }
   return len;
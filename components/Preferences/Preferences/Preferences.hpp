@@ -34,6 +34,11 @@ protected:
   uint32_t _handle;
   bool _started;
   bool _readOnly;
+  bool _batching;
+  bool _batchFailed;
+  uint32_t _keyWrites;
+
+  bool commitUnlessBatched(const char *key);
 
 public:
   Preferences();
@@ -42,6 +47,13 @@ public:
   bool begin(const char *name, bool readOnly = false, const char *partition_label = nullptr);
   void end();
 
+  // between these two, put and remove calls only set their keys and a single commit is made at the end.
+  // endBatch() is false if any of them, or the commit, failed
+  void beginBatch();
+  bool endBatch();
+  // keys set or removed since begin(), each is written to flash by NVS right away, committed or not
+  uint32_t getKeyWrites() const { return _keyWrites; }
+
   bool clear();
   bool remove(const char *key);
 
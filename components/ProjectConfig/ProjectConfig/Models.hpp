@@ -57,6 +57,14 @@ struct DeviceMode_t : BaseConfigModel
   }
 };
 
+// how the external IR LED is driven
+enum class LedMode
+{
+  PWM,    // constant PWM at led_external_pwm_duty_cycle
+  STROBE, // pulsed once per frame in sync with the sensor, see IlluminationSync
+  PATTERN, // strobed only on the frames led_pattern marks, e.g. "10" for lit/dark pairs
+};
+
 struct DeviceConfig_t : BaseConfigModel
 {
   DeviceConfig_t(Preferences *pref) : BaseConfigModel(pref) {}
@@ -65,6 +73,11 @@ struct DeviceConfig_t : BaseConfigModel
   std::string OTAPassword;
   int led_external_pwm_duty_cycle;
   int OTAPort;
+  LedMode led_mode;
+  // one character per frame, '1' lit and '0' dark, repeated
+  std::string led_pattern;
+  // regulated LED current, 0 runs the plain duty cycle
+  int led_current_ma;
 
   void load()
   {
@@ -75,6 +88,13 @@ struct DeviceConfig_t : BaseConfigModel
     this->led_external_pwm_duty_cycle = this->pref->getInt("led_ext_pwm", CONFIG_LED_EXTERNAL_PWM_DUTY_CYCLE);
 #else
     this->led_external_pwm_duty_cycle = this->pref->getInt("led_ext_pwm", 100);
+#endif
+    this->led_mode = static_cast<LedMode>(this->pref->getInt("led_mode", static_cast<int>(LedMode::PWM)));
+    this->led_pattern = this->pref->getString("led_pattern", "10");
+#if CONFIG_MONITORING_LED_REGULATION
+    this->led_current_ma = this->pref->getInt("led_current", CONFIG_MONITORING_LED_REGULATION_TARGET_MA);
+#else
+    this->led_current_ma = this->pref->getInt("led_current", 0);
 #endif
   };
 
@@ -84,14 +104,19 @@ struct DeviceConfig_t : BaseConfigModel
     this->pref->putString("OTAPassword", this->OTAPassword.c_str());
     this->pref->putInt("OTAPort", this->OTAPort);
     this->pref->putInt("led_ext_pwm", this->led_external_pwm_duty_cycle);
+    this->pref->putInt("led_mode", static_cast<int>(this->led_mode));
+    this->pref->putString("led_pattern", this->led_pattern.c_str());
+    this->pref->putInt("led_current", this->led_current_ma);
   };
 
   std::string toRepresentation() const
   {
     return Helpers::format_string(
         "\"device_config\": {\"OTALogin\": \"%s\", \"OTAPassword\": \"%s\", "
-        "\"OTAPort\": %u, \"led_external_pwm_duty_cycle\": %u}",
-        this->OTALogin.c_str(), this->OTAPassword.c_str(), this->OTAPort, this->led_external_pwm_duty_cycle);
+        "\"OTAPort\": %u, \"led_external_pwm_duty_cycle\": %u, \"led_mode\": %d, \"led_pattern\": \"%s\", "
+        "\"led_current_ma\": %d}",
+        this->OTALogin.c_str(), this->OTAPassword.c_str(), this->OTAPort, this->led_external_pwm_duty_cycle,
+        static_cast<int>(this->led_mode), this->led_pattern.c_str(), this->led_current_ma);
   };
 };
 
@@ -132,6 +157,14 @@ struct MDNSConfig_t : BaseConfigModel
   };
 };
 
+// the exposure loop stays off until set_auto_exposure turns it on, units keep the fixed exposure they had
+#define DEFAULT_AUTO_EXPOSURE false
+#ifdef CONFIG_CAMERA_AUTO_EXPOSURE
+#define DEFAULT_EXPOSURE_TARGET CONFIG_CAMERA_AUTO_EXPOSURE_TARGET
+#else
+#define DEFAULT_EXPOSURE_TARGET 110
+#endif
+
 struct CameraConfig_t : BaseConfigModel
 {
   CameraConfig_t(Preferences *pref) : BaseConfigModel(pref) {}
@@ -141,6 +174,14 @@ struct CameraConfig_t : BaseConfigModel
   uint8_t framesize;
   uint8_t quality;
   uint8_t brightness;
+  // fastest XCLK found stable by the calibration sweep, 0 means not calibrated (use Kconfig default)
+  uint32_t xclk_freq_hz;
+  // binned/subsampled high frame rate readout, only worth it at small output sizes
+  bool high_speed;
+  // firmware exposure loop, target mean luminance and whether it may dim the IR LED
+  bool auto_exposure;
+  uint8_t exposure_target;
+  bool exposure_led;
 
   void load()
   {
@@ -149,6 +190,11 @@ struct CameraConfig_t : BaseConfigModel
     this->framesize = this->pref->getInt("framesize", 4);
     this->quality = this->pref->getInt("quality", 7);
     this->brightness = this->pref->getInt("brightness", 2);
+    this->xclk_freq_hz = this->pref->getUInt("xclk_hz", 0);
+    this->high_speed = this->pref->getBool("high_speed", false);
+    this->auto_exposure = this->pref->getBool("auto_exp", DEFAULT_AUTO_EXPOSURE);
+    this->exposure_target = this->pref->getUInt("exp_target", DEFAULT_EXPOSURE_TARGET);
+    this->exposure_led = this->pref->getBool("exp_led", false);
   };
 
   void save() const
@@ -158,15 +204,24 @@ struct CameraConfig_t : BaseConfigModel
     this->pref->putInt("framesize", this->framesize);
     this->pref->putInt("quality", this->quality);
     this->pref->putInt("brightness", this->brightness);
+    this->pref->putUInt("xclk_hz", this->xclk_freq_hz);
+    this->pref->putBool("high_speed", this->high_speed);
+    this->pref->putBool("auto_exp", this->auto_exposure);
+    this->pref->putUInt("exp_target", this->exposure_target);
+    this->pref->putBool("exp_led", this->exposure_led);
   };
 
   std::string toRepresentation()
   {
     return Helpers::format_string(
         "\"camera_config\": {\"vflip\": %d,\"framesize\": %d,\"href\": "
-        "%d,\"quality\": %d,\"brightness\": %d}",
+        "%d,\"quality\": %d,\"brightness\": %d,\"xclk_freq_hz\": %lu,\"high_speed\": %s,"
+        "\"auto_exposure\": %s,\"exposure_target\": %d,\"exposure_led\": %s}",
         this->vflip, this->framesize, this->href, this->quality,
-        this->brightness);
+        this->brightness, static_cast<unsigned long>(this->xclk_freq_hz),
+        this->high_speed ? "true" : "false",
+        this->auto_exposure ? "true" : "false", this->exposure_target,
+        this->exposure_led ? "true" : "false");
   };
 };
 
@@ -24,8 +24,19 @@ ProjectConfig::ProjectConfig(Preferences *pref) : pref(pref),
 
 ProjectConfig::~ProjectConfig() = default;
 
-void ProjectConfig::save() const
+void ProjectConfig::save()
 {
+  std::lock_guard lock(this->transactionMutex);
+  if (this->inTransaction())
+  {
+    ESP_LOGD(CONFIGURATION_TAG, "Staging the whole project config");
+    for (size_t section = 0; section < static_cast<size_t>(ConfigSection::Count); section++)
+    {
+      this->stageSection(static_cast<ConfigSection>(section));
+    }
+    return;
+  }
+
   ESP_LOGD(CONFIGURATION_TAG, "Saving project config");
   this->config.device.save();
   this->config.device_mode.save();
@@ -84,10 +95,192 @@ void ProjectConfig::load()
 
 bool ProjectConfig::reset()
 {
+  std::lock_guard lock(this->transactionMutex);
   ESP_LOGW(CONFIGURATION_TAG, "Resetting project config");
   return this->pref->clear();
 }
 
+//**********************************************************************************************************************
+//*
+//!                                                Transactions
+//*
+//**********************************************************************************************************************
+void ProjectConfig::beginTransaction()
+{
+  // released by endTransaction(), so no setter of another task saves or stages in the middle of it
+  this->transactionMutex.lock();
+  ESP_LOGD(CONFIGURATION_TAG, "Beginning config transaction");
+  this->transactionOwner = xTaskGetCurrentTaskHandle();
+  this->transactionSnapshot.emplace(this->config);
+  this->stagedSections = 0;
+  this->stagedSaves = 0;
+}
+
+ConfigCommitStats ProjectConfig::commitTransaction()
+{
+  ConfigCommitStats stats{
+      .committed = true,
+      .stagedSaves = this->stagedSaves,
+      .sectionsWritten = 0,
+      .keysWritten = 0,
+  };
+
+  if (this->stagedSections == 0)
+  {
+    this->endTransaction();
+    return stats;
+  }
+
+  const uint32_t keyWritesBefore = this->pref->getKeyWrites();
+  this->pref->beginBatch();
+  for (size_t section = 0; section < static_cast<size_t>(ConfigSection::Count); section++)
+  {
+    if (this->stagedSections & (1u << section))
+    {
+      this->writeSection(static_cast<ConfigSection>(section));
+      stats.sectionsWritten++;
+    }
+  }
+
+  const bool written = this->pref->endBatch();
+  stats.keysWritten = this->pref->getKeyWrites() - keyWritesBefore;
+  if (!written)
+  {
+    // NVS stores every key as soon as it's set, so whatever made it to flash is written back as well
+    ESP_LOGE(CONFIGURATION_TAG, "Failed to write the config transaction, restoring the previous config");
+    this->restoreSnapshot();
+    this->pref->beginBatch();
+    for (size_t section = 0; section < static_cast<size_t>(ConfigSection::Count); section++)
+    {
+      if (this->stagedSections & (1u << section))
+      {
+        this->writeSection(static_cast<ConfigSection>(section));
+      }
+    }
+    this->pref->endBatch();
+    this->endTransaction();
+    stats.committed = false;
+    return stats;
+  }
+
+  ESP_LOGI(CONFIGURATION_TAG, "Committed %lu staged saves as %lu sections, %lu keys",
+           static_cast<unsigned long>(stats.stagedSaves), static_cast<unsigned long>(stats.sectionsWritten),
+           static_cast<unsigned long>(stats.keysWritten));
+  this->endTransaction();
+  return stats;
+}
+
+void ProjectConfig::rollbackTransaction()
+{
+  ESP_LOGW(CONFIGURATION_TAG, "Rolling back config transaction");
+  this->restoreSnapshot();
+  this->endTransaction();
+}
+
+void ProjectConfig::restoreSnapshot()
+{
+  // only the sections the transaction changed, no other task could touch the config meanwhile
+  const auto &snapshot = *this->transactionSnapshot;
+  for (size_t section = 0; section < static_cast<size_t>(ConfigSection::Count); section++)
+  {
+    if (!(this->stagedSections & (1u << section)))
+    {
+      continue;
+    }
+    switch (static_cast<ConfigSection>(section))
+    {
+    case ConfigSection::Device:
+      this->config.device = snapshot.device;
+      break;
+    case ConfigSection::DeviceMode:
+      this->config.device_mode = snapshot.device_mode;
+      break;
+    case ConfigSection::Camera:
+      this->config.camera = snapshot.camera;
+      break;
+    case ConfigSection::Networks:
+      this->config.networks = snapshot.networks;
+      break;
+    case ConfigSection::AccessPoint:
+      this->config.ap_network = snapshot.ap_network;
+      break;
+    case ConfigSection::MDNS:
+      this->config.mdns = snapshot.mdns;
+      break;
+    case ConfigSection::TxPower:
+      this->config.txpower = snapshot.txpower;
+      break;
+    case ConfigSection::Count:
+      break;
+    }
+  }
+}
+
+void ProjectConfig::endTransaction()
+{
+  this->transactionOwner = nullptr;
+  this->transactionSnapshot.reset();
+  this->transactionMutex.unlock();
+}
+
+bool ProjectConfig::inTransaction() const
+{
+  return this->transactionOwner != nullptr && xTaskGetCurrentTaskHandle() == this->transactionOwner;
+}
+
+bool ProjectConfig::stageSection(const ConfigSection section)
+{
+  if (!this->inTransaction())
+  {
+    return false;
+  }
+  this->stagedSections |= 1u << static_cast<size_t>(section);
+  this->stagedSaves++;
+  return true;
+}
+
+void ProjectConfig::saveSection(const ConfigSection section)
+{
+  if (!this->stageSection(section))
+  {
+    this->writeSection(section);
+  }
+}
+
+void ProjectConfig::writeSection(const ConfigSection section) const
+{
+  switch (section)
+  {
+  case ConfigSection::Device:
+    this->config.device.save();
+    break;
+  case ConfigSection::DeviceMode:
+    this->config.device_mode.save();
+    break;
+  case ConfigSection::Camera:
+    this->config.camera.save();
+    break;
+  case ConfigSection::Networks:
+    for (const auto &network : this->config.networks)
+    {
+      network.save();
+    }
+    saveNetworkCount(this->pref, static_cast<int>(this->config.networks.size()));
+    break;
+  case ConfigSection::AccessPoint:
+    this->config.ap_network.save();
+    break;
+  case ConfigSection::MDNS:
+    this->config.mdns.save();
+    break;
+  case ConfigSection::TxPower:
+    this->config.txpower.save();
+    break;
+  case ConfigSection::Count:
+    break;
+  }
+}
+
 //**********************************************************************************************************************
 //*
 //!                                                DeviceConfig
@@ -97,25 +290,45 @@ void ProjectConfig::setOTAConfig(const std::string &OTALogin,
                                  const std::string &OTAPassword,
                                  const int OTAPort)
 {
+  std::lock_guard lock(this->transactionMutex);
   ESP_LOGD(CONFIGURATION_TAG, "Updating device config");
   this->config.device.OTALogin.assign(OTALogin);
   this->config.device.OTAPassword.assign(OTAPassword);
   this->config.device.OTAPort = OTAPort;
-  this->config.device.save();
+  this->saveSection(ConfigSection::Device);
 }
 
 void ProjectConfig::setLEDDUtyCycleConfig(int led_external_pwm_duty_cycle)
 {
+  std::lock_guard lock(this->transactionMutex);
   this->config.device.led_external_pwm_duty_cycle = led_external_pwm_duty_cycle;
   ESP_LOGI(CONFIGURATION_TAG, "Setting duty cycle to %d", led_external_pwm_duty_cycle);
-  this->config.device.save();
+  this->saveSection(ConfigSection::Device);
+}
+
+void ProjectConfig::setLEDModeConfig(const LedMode led_mode, const std::string &led_pattern)
+{
+  std::lock_guard lock(this->transactionMutex);
+  this->config.device.led_mode = led_mode;
+  this->config.device.led_pattern.assign(led_pattern);
+  ESP_LOGI(CONFIGURATION_TAG, "Setting LED mode to %d, pattern %s", static_cast<int>(led_mode), led_pattern.c_str());
+  this->saveSection(ConfigSection::Device);
+}
+
+void ProjectConfig::setLEDCurrentConfig(const int led_current_ma)
+{
+  std::lock_guard lock(this->transactionMutex);
+  this->config.device.led_current_ma = led_current_ma;
+  ESP_LOGI(CONFIGURATION_TAG, "Setting LED current target to %d mA", led_current_ma);
+  this->saveSection(ConfigSection::Device);
 }
 
 void ProjectConfig::setMDNSConfig(const std::string &hostname)
 {
+  std::lock_guard lock(this->transactionMutex);
   ESP_LOGD(CONFIGURATION_TAG, "Updating MDNS config");
   this->config.mdns.hostname.assign(hostname);
-  this->config.mdns.save();
+  this->saveSection(ConfigSection::MDNS);
 }
 
 void ProjectConfig::setCameraConfig(const uint8_t vflip,
@@ -124,23 +337,51 @@ void ProjectConfig::setCameraConfig(const uint8_t vflip,
                                     const uint8_t quality,
                                     const uint8_t brightness)
 {
+  std::lock_guard lock(this->transactionMutex);
   ESP_LOGD(CONFIGURATION_TAG, "Updating camera config");
   this->config.camera.vflip = vflip;
   this->config.camera.href = href;
   this->config.camera.framesize = framesize;
   this->config.camera.quality = quality;
   this->config.camera.brightness = brightness;
-  this->config.camera.save();
+  this->saveSection(ConfigSection::Camera);
 
   ESP_LOGD(CONFIGURATION_TAG, "Updating Camera config");
 }
 
+void ProjectConfig::setCameraXclkConfig(const uint32_t xclk_freq_hz)
+{
+  std::lock_guard lock(this->transactionMutex);
+  ESP_LOGI(CONFIGURATION_TAG, "Setting calibrated XCLK to %lu Hz", static_cast<unsigned long>(xclk_freq_hz));
+  this->config.camera.xclk_freq_hz = xclk_freq_hz;
+  this->saveSection(ConfigSection::Camera);
+}
+
+void ProjectConfig::setCameraHighSpeedConfig(const bool high_speed)
+{
+  std::lock_guard lock(this->transactionMutex);
+  ESP_LOGD(CONFIGURATION_TAG, "Updating camera high speed mode");
+  this->config.camera.high_speed = high_speed;
+  this->saveSection(ConfigSection::Camera);
+}
+
+void ProjectConfig::setCameraAutoExposureConfig(const bool enabled, const uint8_t target, const bool use_led)
+{
+  std::lock_guard lock(this->transactionMutex);
+  ESP_LOGD(CONFIGURATION_TAG, "Updating camera auto exposure");
+  this->config.camera.auto_exposure = enabled;
+  this->config.camera.exposure_target = target;
+  this->config.camera.exposure_led = use_led;
+  this->saveSection(ConfigSection::Camera);
+}
+
 void ProjectConfig::setWifiConfig(const std::string &networkName,
                                   const std::string &ssid,
                                   const std::string &password,
                                   uint8_t channel,
                                   uint8_t power)
 {
+  std::lock_guard lock(this->transactionMutex);
   const auto size = this->config.networks.size();
 
   const auto it = std::ranges::find_if(this->config.networks,
@@ -159,7 +400,10 @@ void ProjectConfig::setWifiConfig(const std::string &networkName,
     it->channel = channel;
     it->power = power;
     // Save the updated network immediately
-    it->save();
+    if (!this->stageSection(ConfigSection::Networks))
+    {
+      it->save();
+    }
     return;
   }
 
@@ -169,8 +413,11 @@ void ProjectConfig::setWifiConfig(const std::string &networkName,
     this->config.networks.emplace_back(this->pref, static_cast<uint8_t>(0), networkName, ssid, password, channel,
                                        power);
     // Save the new network immediately
-    this->config.networks.back().save();
-    saveNetworkCount(this->pref, 1);
+    if (!this->stageSection(ConfigSection::Networks))
+    {
+      this->config.networks.back().save();
+      saveNetworkCount(this->pref, 1);
+    }
     return;
   }
 
@@ -181,12 +428,16 @@ void ProjectConfig::setWifiConfig(const std::string &networkName,
     // we don't have that network yet, we can add it as we still have some
     // space we're using emplace_back as push_back will create a copy of it,
     // we want to avoid that
-    uint8_t last_index = getNetworkCount(this->pref);
+    // what's saved may still lag behind a delete staged in the same transaction
+    const auto last_index = static_cast<uint8_t>(size);
     this->config.networks.emplace_back(this->pref, last_index, networkName, ssid, password, channel,
                                        power);
     // Save the new network immediately
-    this->config.networks.back().save();
-    saveNetworkCount(this->pref, static_cast<int>(this->config.networks.size()));
+    if (!this->stageSection(ConfigSection::Networks))
+    {
+      this->config.networks.back().save();
+      saveNetworkCount(this->pref, static_cast<int>(this->config.networks.size()));
+    }
   }
   else
   {
@@ -196,6 +447,7 @@ void ProjectConfig::setWifiConfig(const std::string &networkName,
 
 void ProjectConfig::deleteWifiConfig(const std::string &networkName)
 {
+  std::lock_guard lock(this->transactionMutex);
   if (const auto size = this->config.networks.size(); size == 0)
   {
     ESP_LOGI(CONFIGURATION_TAG, "No networks, nothing to delete");
@@ -209,14 +461,21 @@ void ProjectConfig::deleteWifiConfig(const std::string &networkName)
   {
     ESP_LOGI(CONFIGURATION_TAG, "Found network %s", it->name.c_str());
     this->config.networks.erase(it);
+    // the ones after it move up a slot, so the saved list has no gap
+    for (size_t i = 0; i < this->config.networks.size(); i++)
+    {
+      this->config.networks[i].index = static_cast<uint8_t>(i);
+    }
+    this->saveSection(ConfigSection::Networks);
     ESP_LOGI(CONFIGURATION_TAG, "Deleted network %s", networkName.c_str());
   }
 }
 
 void ProjectConfig::setWiFiTxPower(uint8_t power)
 {
+  std::lock_guard lock(this->transactionMutex);
   this->config.txpower.power = power;
-  this->config.txpower.save();
+  this->saveSection(ConfigSection::TxPower);
   ESP_LOGD(CONFIGURATION_TAG, "Updating wifi tx power");
 }
 
@@ -224,17 +483,19 @@ void ProjectConfig::setAPWifiConfig(const std::string &ssid,
                                     const std::string &password,
                                     const uint8_t channel)
 {
+  std::lock_guard lock(this->transactionMutex);
   this->config.ap_network.ssid.assign(ssid);
   this->config.ap_network.password.assign(password);
   this->config.ap_network.channel = channel;
-  this->config.ap_network.save();
+  this->saveSection(ConfigSection::AccessPoint);
   ESP_LOGD(CONFIGURATION_TAG, "Updating access point config");
 }
 
 void ProjectConfig::setDeviceMode(const StreamingMode deviceMode)
 {
+  std::lock_guard lock(this->transactionMutex);
   this->config.device_mode.mode = deviceMode;
-  this->config.device_mode.save(); // Save immediately
+  this->saveSection(ConfigSection::DeviceMode); // Save immediately
 }
 
 //**********************************************************************************************************************
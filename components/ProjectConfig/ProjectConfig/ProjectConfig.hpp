@@ -3,8 +3,13 @@
 #define PROJECT_CONFIG_HPP
 #include "esp_log.h"
 #include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <optional>
 #include <vector>
 #include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include <helpers.hpp>
 #include "Models.hpp"
 #include <Preferences.hpp>
@@ -13,6 +18,29 @@ int getNetworkCount(Preferences *pref);
 
 void saveNetworkCount(Preferences *pref, int count);
 
+// the parts of the config that are saved on their own, a transaction keeps track of which ones it changed
+enum class ConfigSection : uint8_t
+{
+  Device,
+  DeviceMode,
+  Camera,
+  Networks,
+  AccessPoint,
+  MDNS,
+  TxPower,
+  Count,
+};
+
+struct ConfigCommitStats
+{
+  bool committed;
+  // saves the setters asked for, without a transaction each one writes and commits its section right away
+  uint32_t stagedSaves;
+  uint32_t sectionsWritten;
+  // NVS keys the commit set, each setter's own save would have set every key of its section each time
+  uint32_t keysWritten;
+};
+
 class ProjectConfig
 {
 public:
@@ -20,10 +48,17 @@ public:
   virtual ~ProjectConfig();
 
   void load();
-  void save() const;
+  void save();
 
   bool reset();
 
+  // Until the transaction is committed or rolled back, the setters called from this task only change the config in
+  // memory. commitTransaction() then writes every section they touched once, and puts the old values back if that
+  // fails. Setters called from other tasks wait for the transaction to end and then save right away.
+  void beginTransaction();
+  ConfigCommitStats commitTransaction();
+  void rollbackTransaction();
+
   DeviceConfig_t &getDeviceConfig();
   DeviceMode_t &getDeviceModeConfig();
   CameraConfig_t &getCameraConfig();
@@ -37,12 +72,17 @@ public:
                     const std::string &OTAPassword,
                     int OTAPort);
   void setLEDDUtyCycleConfig(int led_external_pwm_duty_cycle);
+  void setLEDModeConfig(LedMode led_mode, const std::string &led_pattern);
+  void setLEDCurrentConfig(int led_current_ma);
   void setMDNSConfig(const std::string &hostname);
   void setCameraConfig(uint8_t vflip,
                        uint8_t framesize,
                        uint8_t href,
                        uint8_t quality,
                        uint8_t brightness);
+  void setCameraXclkConfig(uint32_t xclk_freq_hz);
+  void setCameraHighSpeedConfig(bool high_speed);
+  void setCameraAutoExposureConfig(bool enabled, uint8_t target, bool use_led);
   void setWifiConfig(const std::string &networkName,
                      const std::string &ssid,
                      const std::string &password,
@@ -59,9 +99,26 @@ public:
   StreamingMode getDeviceMode();
 
 private:
+  // writes the section now, or only stages it when this task has a transaction open
+  void saveSection(ConfigSection section);
+  // true if the section was staged rather than to be written by the caller
+  bool stageSection(ConfigSection section);
+  void writeSection(ConfigSection section) const;
+  bool inTransaction() const;
+  void restoreSnapshot();
+  void endTransaction();
+
   Preferences *pref;
   bool _already_loaded;
   TrackerConfig_t config;
+
+  // held by every setter, and by a transaction from begin to commit or rollback
+  std::recursive_mutex transactionMutex;
+  TaskHandle_t transactionOwner = nullptr;
+  // the config as it was when the transaction began, what a rollback restores
+  std::optional<TrackerConfig_t> transactionSnapshot;
+  uint32_t stagedSections = 0;
+  uint32_t stagedSaves = 0;
 };
 
 #endif
\ No newline at end of file
@@ -1,8 +1,18 @@
 #include "RestAPI.hpp"
 
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
 #include <utility>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
 
 #define POST_METHOD "POST"
+#define METRICS_RESPONSE "Content-Type: text/plain; version=0.0.4\r\n"
+
+extern std::shared_ptr<CameraManager> cameraHandler;
+extern std::shared_ptr<MonitoringManager> monitoringManager;
 
 bool getIsSuccess(const nlohmann::json &response)
 {
@@ -30,6 +40,7 @@ RestAPI::RestAPI(std::string url, std::shared_ptr<CommandManager> commandManager
   routes.emplace("/api/reset/config/", &RestAPI::handle_reset_config);
   // gets
   routes.emplace("/api/get/config/", &RestAPI::handle_get_config);
+  routes.emplace("/api/get/thumbnail/", &RestAPI::handle_get_thumbnail);
 
   // reboots
   routes.emplace("/api/reboot/device/", &RestAPI::handle_reboot);
@@ -38,6 +49,9 @@ RestAPI::RestAPI(std::string url, std::shared_ptr<CommandManager> commandManager
   // heartbeat
   routes.emplace("/api/ping/", &RestAPI::pong);
 
+  // monitoring
+  routes.emplace("/metrics", &RestAPI::handle_metrics);
+
   // special
   routes.emplace("/api/save/", &RestAPI::handle_save);
 }
@@ -58,14 +72,16 @@ void RestAPI::handle_request(struct mg_connection *connection, int event, void *
     auto const *message = static_cast<struct mg_http_message *>(event_data);
     auto const uri = std::string(message->uri.buf, message->uri.len);
 
-    if (auto const handler = this->routes[uri])
+    // find() rather than [], which would add every unknown URI to the map.
+    // handlers reply before returning, so the context can live on the stack
+    if (auto const route = this->routes.find(uri); route != this->routes.end())
     {
-      auto *context = new RequestContext{
+      RequestContext context{
           .connection = connection,
           .method = std::string(message->method.buf, message->method.len),
           .body = std::string(message->body.buf, message->body.len),
       };
-      (*this.*handler)(context);
+      (*this.*(route->second))(&context);
     }
     else
     {
@@ -85,14 +101,49 @@ void RestAPI::poll()
   mg_mgr_poll(&mgr, 100);
 }
 
-void HandleRestAPIPollTask(void *pvParameter)
+void RestAPI::run()
 {
-  auto *rest_api_handler = static_cast<RestAPI *>(pvParameter);
-  while (true)
+  this->poll_task = xTaskGetCurrentTaskHandle();
+  while (!this->stop_requested)
   {
-    rest_api_handler->poll();
-    vTaskDelay(1000);
+    this->poll();
+    // doubles as the idle delay, stop() wakes us up early
+    ulTaskNotifyTake(pdTRUE, 1000);
   }
+
+  // one more round so the reply to the request that asked for the stop still goes out
+  this->poll();
+  // mongoose isn't safe to touch from two tasks, so the manager is torn down here rather than in stop()
+  mg_mgr_free(&mgr);
+  heap_caps_free(this->metrics_buffer);
+  this->metrics_buffer = nullptr;
+  this->metrics_snapshot.reset();
+
+  this->stop_requested = false;
+  this->poll_task = nullptr;
+}
+
+void RestAPI::stop()
+{
+  TaskHandle_t task = this->poll_task;
+  if (task == nullptr)
+    return;
+
+  this->stop_requested = true;
+  xTaskNotifyGive(task);
+  // a poll round waits 100ms on the sockets plus whatever the handlers it runs take
+  for (int waited = 0; this->poll_task != nullptr && waited < REST_API_STOP_TIMEOUT_MS; waited += 10)
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+  if (this->poll_task != nullptr)
+    ESP_LOGW("[REST_API]", "Poll task did not stop in time");
+}
+
+void HandleRestAPIPollTask(void *pvParameter)
+{
+  auto *rest_api_handler = static_cast<RestAPI *>(pvParameter);
+  rest_api_handler->run();
+  vTaskDelete(nullptr);
 }
 
 // COMMANDS
@@ -145,6 +196,26 @@ void RestAPI::handle_get_config(RequestContext *context)
   mg_http_reply(context->connection, 200, JSON_RESPONSE, "{%m:%m}", MG_ESC("result"), jsonResult.dump().c_str());
 }
 
+void RestAPI::handle_get_thumbnail(RequestContext *context)
+{
+  // the thumbnail is the 1/8 scale luma grid built from the DC coefficients only,
+  // served as a binary PGM so it can be opened without any extra tooling
+  LumaGrid grid;
+  if (!cameraHandler || !cameraHandler->captureLumaGrid(grid))
+  {
+    mg_http_reply(context->connection, 503, JSON_RESPONSE, "{%m:%m}", MG_ESC("error"), MG_ESC("Failed to capture frame"));
+    return;
+  }
+
+  char header[32];
+  const int headerLength = snprintf(header, sizeof(header), "P5\n%u %u\n255\n", grid.width, grid.height);
+  mg_printf(context->connection,
+            "HTTP/1.1 200 OK\r\nContent-Type: image/x-portable-graymap\r\nContent-Length: %d\r\n\r\n",
+            headerLength + static_cast<int>(grid.pixels.size()));
+  mg_send(context->connection, header, headerLength);
+  mg_send(context->connection, grid.pixels.data(), grid.pixels.size());
+}
+
 // resets
 
 void RestAPI::handle_reset_config(RequestContext *context)
@@ -189,3 +260,178 @@ void RestAPI::handle_save(RequestContext *context)
   const auto code = getIsSuccess(result) ? 200 : 500;
   mg_http_reply(context->connection, code, JSON_RESPONSE, result.dump().c_str());
 }
+
+// monitoring
+
+void RestAPI::handle_metrics(RequestContext *context)
+{
+  // allocated on the first scrape and kept, so scraping doesn't fragment the heap the stream needs.
+  // PSRAM when there is some, the page is only touched a few times a minute
+  if (this->metrics_buffer == nullptr)
+  {
+    this->metrics_buffer = static_cast<char *>(heap_caps_malloc(METRICS_BUFFER_SIZE, MALLOC_CAP_SPIRAM));
+    if (this->metrics_buffer == nullptr)
+      this->metrics_buffer = static_cast<char *>(heap_caps_malloc(METRICS_BUFFER_SIZE, MALLOC_CAP_8BIT));
+    this->metrics_snapshot = std::make_unique<SystemSnapshot>();
+  }
+  if (this->metrics_buffer == nullptr || !this->metrics_snapshot)
+  {
+    mg_http_reply(context->connection, 503, JSON_RESPONSE, "{%m:%m}", MG_ESC("error"), MG_ESC("Out of memory"));
+    return;
+  }
+
+  this->render_metrics();
+  mg_printf(context->connection,
+            "HTTP/1.1 200 OK\r\n" METRICS_RESPONSE "Content-Length: %d\r\n\r\n",
+            static_cast<int>(this->metrics_length));
+  mg_send(context->connection, this->metrics_buffer, this->metrics_length);
+}
+
+void RestAPI::append_metric(const char *format, ...)
+{
+  if (this->metrics_truncated)
+    return;
+
+  va_list args;
+  va_start(args, format);
+  const size_t room = METRICS_BUFFER_SIZE - this->metrics_length;
+  const int written = vsnprintf(this->metrics_buffer + this->metrics_length, room, format, args);
+  va_end(args);
+
+  // drop a line that didn't fit whole rather than send half of it
+  if (written < 0 || static_cast<size_t>(written) >= room)
+  {
+    this->metrics_truncated = true;
+    return;
+  }
+  this->metrics_length += written;
+}
+
+void RestAPI::render_metrics()
+{
+  this->metrics_length = 0;
+  this->metrics_truncated = false;
+
+  append_metric("# HELP openiris_uptime_seconds Time since boot.\n"
+                "# TYPE openiris_uptime_seconds gauge\n"
+                "openiris_uptime_seconds %.3f\n",
+                static_cast<double>(esp_timer_get_time()) / 1000000.0);
+
+  if (cameraHandler)
+  {
+    append_metric("# HELP openiris_stream_fps Rate at which the stream is getting frames.\n"
+                  "# TYPE openiris_stream_fps gauge\n"
+                  "openiris_stream_fps %.1f\n"
+                  "# HELP openiris_stream_target_fps Frame rate the stream is paced to, 0 when unpaced.\n"
+                  "# TYPE openiris_stream_target_fps gauge\n"
+                  "openiris_stream_target_fps %d\n",
+                  static_cast<double>(cameraHandler->getMeasuredFps()), cameraHandler->getTargetFrameRate());
+    append_metric("# HELP openiris_frames_total Frames handed to the stream.\n"
+                  "# TYPE openiris_frames_total counter\n"
+                  "openiris_frames_total %lu\n"
+                  "# HELP openiris_frame_bytes_total JPEG bytes handed to the stream.\n"
+                  "# TYPE openiris_frame_bytes_total counter\n"
+                  "openiris_frame_bytes_total %llu\n"
+                  "# HELP openiris_frame_bytes Size of the last frame.\n"
+                  "# TYPE openiris_frame_bytes gauge\n"
+                  "openiris_frame_bytes %lu\n",
+                  static_cast<unsigned long>(cameraHandler->getFramesDelivered()),
+                  static_cast<unsigned long long>(cameraHandler->getBytesDelivered()),
+                  static_cast<unsigned long>(cameraHandler->getLastFrameBytes()));
+
+    const auto &jpegStats = cameraHandler->getJpegStats();
+    append_metric("# HELP openiris_frames_dropped_total Frames dropped before reaching the stream.\n"
+                  "# TYPE openiris_frames_dropped_total counter\n"
+                  "openiris_frames_dropped_total{reason=\"capture_timeout\"} %lu\n",
+                  static_cast<unsigned long>(cameraHandler->getCaptureFailures()));
+    for (size_t i = static_cast<size_t>(JpegError::None) + 1; i < static_cast<size_t>(JpegError::Count); i++)
+    {
+      const auto error = static_cast<JpegError>(i);
+      append_metric("openiris_frames_dropped_total{reason=\"%s\"} %lu\n", jpegErrorToString(error),
+                    static_cast<unsigned long>(jpegStats.getFailures(error)));
+    }
+  }
+
+  if (wifi_ap_record_t ap; esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+  {
+    append_metric("# HELP openiris_wifi_rssi_dbm Signal strength of the access point we're connected to.\n"
+                  "# TYPE openiris_wifi_rssi_dbm gauge\n"
+                  "openiris_wifi_rssi_dbm %d\n",
+                  ap.rssi);
+  }
+
+  // live values rather than the last system sample, they're cheap to read
+  append_metric("# HELP openiris_heap_free_bytes Free heap.\n"
+                "# TYPE openiris_heap_free_bytes gauge\n"
+                "openiris_heap_free_bytes{region=\"internal\"} %u\n"
+                "openiris_heap_free_bytes{region=\"psram\"} %u\n"
+                "# HELP openiris_heap_largest_free_block_bytes Largest block that can be allocated.\n"
+                "# TYPE openiris_heap_largest_free_block_bytes gauge\n"
+                "openiris_heap_largest_free_block_bytes{region=\"internal\"} %u\n"
+                "openiris_heap_largest_free_block_bytes{region=\"psram\"} %u\n"
+                "# HELP openiris_heap_min_free_bytes Lowest free heap since boot.\n"
+                "# TYPE openiris_heap_min_free_bytes gauge\n"
+                "openiris_heap_min_free_bytes{region=\"internal\"} %u\n"
+                "openiris_heap_min_free_bytes{region=\"psram\"} %u\n",
+                heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT),
+                heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+                heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT),
+                heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM),
+                heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT),
+                heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+
+  if (!monitoringManager)
+    return;
+
+#if CONFIG_MONITORING_SYSTEM
+  monitoringManager->getSystemSnapshot(*this->metrics_snapshot);
+  const auto &snapshot = *this->metrics_snapshot;
+  if (SystemMonitor::hasCpuStats() && snapshot.latest.uptime_ms > 0)
+  {
+    append_metric("# HELP openiris_cpu_percent Load per core over the last monitoring interval.\n"
+                  "# TYPE openiris_cpu_percent gauge\n");
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+      if (snapshot.latest.cpu_percent[core] >= 0)
+        append_metric("openiris_cpu_percent{core=\"%d\"} %d\n", core, snapshot.latest.cpu_percent[core]);
+    }
+    append_metric("# HELP openiris_task_cpu_percent Share of all cores per task over the last monitoring interval.\n"
+                  "# TYPE openiris_task_cpu_percent gauge\n");
+    for (size_t i = 0; i < snapshot.task_count; i++)
+    {
+      if (snapshot.tasks[i].cpu_percent >= 0)
+        append_metric("openiris_task_cpu_percent{task=\"%s\"} %.1f\n", snapshot.tasks[i].name,
+                      static_cast<double>(snapshot.tasks[i].cpu_percent));
+    }
+  }
+  if (snapshot.task_count > 0)
+  {
+    append_metric("# HELP openiris_task_stack_free_min_bytes Stack high-water mark per task.\n"
+                  "# TYPE openiris_task_stack_free_min_bytes gauge\n");
+    for (size_t i = 0; i < snapshot.task_count; i++)
+      append_metric("openiris_task_stack_free_min_bytes{task=\"%s\"} %lu\n", snapshot.tasks[i].name,
+                    static_cast<unsigned long>(snapshot.tasks[i].stack_free_min));
+  }
+#endif
+
+#if CONFIG_MONITORING_LED_CURRENT
+  append_metric("# HELP openiris_led_current_milliamps Filtered external IR LED current.\n"
+                "# TYPE openiris_led_current_milliamps gauge\n"
+                "openiris_led_current_milliamps %.1f\n",
+                static_cast<double>(monitoringManager->getCurrentMilliAmps()));
+#endif
+
+#if CONFIG_MONITORING_THERMAL
+  if (const float celsius = monitoringManager->getLastChipTemperatureCelsius(); !std::isnan(celsius))
+  {
+    append_metric("# HELP openiris_chip_temperature_celsius Internal die temperature.\n"
+                  "# TYPE openiris_chip_temperature_celsius gauge\n"
+                  "openiris_chip_temperature_celsius %.1f\n",
+                  static_cast<double>(celsius));
+  }
+  append_metric("# HELP openiris_thermal_state Throttle state, 0 normal, 1 warm, 2 critical.\n"
+                "# TYPE openiris_thermal_state gauge\n"
+                "openiris_thermal_state %d\n",
+                static_cast<int>(monitoringManager->getThermalState()));
+#endif
+}
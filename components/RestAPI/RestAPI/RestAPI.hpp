@@ -1,16 +1,24 @@
 #pragma once
 #ifndef RESTAPI_HPP
 #define RESTAPI_HPP
+#include <atomic>
 #include <string>
 #include <memory>
 #include <unordered_map>
 #include <mongoose.h>
 #include <CommandManager.hpp>
+#include <CameraManager.hpp>
+#include <MonitoringManager.hpp>
 
 #include "esp_log.h"
 
 #define JSON_RESPONSE "Content-Type: application/json\r\n"
 
+// room for the whole /metrics page, lines that don't fit are left out
+constexpr size_t METRICS_BUFFER_SIZE = 8192;
+// how long stop() waits for the poll task to wind down
+constexpr int REST_API_STOP_TIMEOUT_MS = 2000;
+
 struct RequestContext
 {
   mg_connection *connection;
@@ -28,6 +36,9 @@ class RestAPI
   mg_mgr mgr;
   std::shared_ptr<CommandManager> command_manager;
 
+  std::atomic<TaskHandle_t> poll_task = nullptr;
+  std::atomic<bool> stop_requested = false;
+
 private:
   // updates
   void handle_update_wifi(RequestContext *context);
@@ -36,6 +47,7 @@ private:
 
   // gets
   void handle_get_config(RequestContext *context);
+  void handle_get_thumbnail(RequestContext *context);
 
   // resets
   void handle_reset_config(RequestContext *context);
@@ -47,6 +59,15 @@ private:
   // heartbeat
   void pong(RequestContext *context);
 
+  // Prometheus text exposition, rendered into a buffer that lives as long as the server
+  void handle_metrics(RequestContext *context);
+  void render_metrics();
+  void append_metric(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  char *metrics_buffer = nullptr;
+  size_t metrics_length = 0;
+  bool metrics_truncated = false;
+  std::unique_ptr<SystemSnapshot> metrics_snapshot;
+
   // special
   void handle_save(RequestContext *context);
 
@@ -56,6 +77,10 @@ public:
   void begin();
   void handle_request(struct mg_connection *connection, int event, void *event_data);
   void poll();
+  // body of the poll task, returns once stop() asked it to, with the listener closed and its buffers freed
+  void run();
+  // blocks until the poll task has wound down, begin() and a new poll task bring the API back
+  void stop();
 };
 
 namespace RestAPIHelpers
@@ -0,0 +1,112 @@
+#include "CommandFramer.hpp"
+#include "esp_timer.h"
+
+bool CommandFramer::writeHeader(uint8_t (&header)[COMMAND_FRAME_HEADER_SIZE], const size_t payloadLength)
+{
+  if (payloadLength > UINT16_MAX)
+    return false;
+
+  header[0] = COMMAND_FRAME_MAGIC[0];
+  header[1] = COMMAND_FRAME_MAGIC[1];
+  header[2] = static_cast<uint8_t>(payloadLength >> 8);
+  header[3] = static_cast<uint8_t>(payloadLength & 0xFF);
+  return true;
+}
+
+void CommandFramer::dropStalledFrame()
+{
+  const int64_t now = esp_timer_get_time();
+  // a JSON line ends at its newline anyway, and may well be typed by hand
+  const bool binary = state == State::Magic || state == State::Length || state == State::Payload || state == State::Discard;
+  if (binary && now - lastByteUs > COMMAND_FRAME_GAP_TIMEOUT_US)
+    state = State::Idle;
+  lastByteUs = now;
+}
+
+bool CommandFramer::push(const uint8_t byte, CommandFrame &frame)
+{
+  switch (state)
+  {
+  case State::Idle:
+    // blank lines and the \n of a \r\n ending aren't requests
+    if (byte == '\n' || byte == '\r')
+      return false;
+    if (byte == COMMAND_FRAME_MAGIC[0])
+    {
+      state = State::Magic;
+      return false;
+    }
+    state = State::Text;
+    position = 0;
+    buffer[position++] = byte;
+    return false;
+
+  case State::Magic:
+    if (byte == COMMAND_FRAME_MAGIC[1])
+    {
+      state = State::Length;
+      expected = 0;
+      lengthBytes = 0;
+      return false;
+    }
+    // not a frame after all, let the JSON parser reject it
+    state = State::Text;
+    position = 0;
+    buffer[position++] = COMMAND_FRAME_MAGIC[0];
+    return push(byte, frame);
+
+  case State::Length:
+    expected = (expected << 8) | byte;
+    if (++lengthBytes < 2)
+      return false;
+    position = 0;
+    if (expected > COMMAND_FRAME_MAX_SIZE)
+    {
+      state = State::Discard;
+      return false;
+    }
+    if (expected == 0)
+    {
+      state = State::Idle;
+      frame = {CommandFrameFormat::Cbor, {}};
+      return true;
+    }
+    state = State::Payload;
+    return false;
+
+  case State::Payload:
+    buffer[position++] = byte;
+    if (position < expected)
+      return false;
+    state = State::Idle;
+    frame = {CommandFrameFormat::Cbor, {buffer.data(), position}};
+    return true;
+
+  case State::Discard:
+    if (++position < expected)
+      return false;
+    state = State::Idle;
+    frame = {CommandFrameFormat::Cbor, {}};
+    return true;
+
+  case State::Text:
+    if (byte == '\n' || byte == '\r')
+    {
+      state = State::Idle;
+      buffer[position] = '\0';
+      frame = {CommandFrameFormat::Json, {buffer.data(), position}};
+      return true;
+    }
+    buffer[position++] = byte;
+    // a full buffer goes out as is, like it always did
+    if (position >= COMMAND_FRAME_MAX_SIZE)
+    {
+      state = State::Idle;
+      buffer[position] = '\0';
+      frame = {CommandFrameFormat::Json, {buffer.data(), position}};
+      return true;
+    }
+    return false;
+  }
+  return false;
+}
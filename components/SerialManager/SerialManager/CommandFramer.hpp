@@ -0,0 +1,77 @@
+#pragma once
+#ifndef COMMANDFRAMER_HPP
+#define COMMANDFRAMER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Binary frames start with these two bytes, which can't begin a JSON text, followed by the CBOR payload length
+// (big endian u16) and the payload itself. The device answers in whichever format the request came in.
+constexpr uint8_t COMMAND_FRAME_MAGIC[2] = {0xA5, 0x4F};
+constexpr size_t COMMAND_FRAME_HEADER_SIZE = 4;
+// longest request either format can carry, a longer JSON line is cut here and a longer frame is refused
+constexpr size_t COMMAND_FRAME_MAX_SIZE = 1024;
+// a binary frame that goes this long without a byte was cut short, the framer starts over with the next byte
+constexpr int64_t COMMAND_FRAME_GAP_TIMEOUT_US = 100 * 1000;
+
+enum class CommandFrameFormat
+{
+  Json,
+  Cbor,
+};
+
+struct CommandFrame
+{
+  CommandFrameFormat format;
+  // empty for a binary frame that was empty or didn't fit, in which case its bytes were dropped
+  std::span<const uint8_t> payload;
+};
+
+// Splits the serial byte stream into requests, newline terminated JSON or length prefixed CBOR
+class CommandFramer
+{
+public:
+  // calls onFrame(const CommandFrame &) for every request completed by these bytes
+  template <typename OnFrame>
+  void feed(const uint8_t *data, const size_t len, OnFrame &&onFrame)
+  {
+    if (len > 0)
+      dropStalledFrame();
+    for (size_t i = 0; i < len; i++)
+    {
+      CommandFrame frame;
+      if (push(data[i], frame))
+        onFrame(frame);
+    }
+  }
+
+  // writes the binary frame header for a payload of the given length, false if it's too long for one
+  static bool writeHeader(uint8_t (&header)[COMMAND_FRAME_HEADER_SIZE], size_t payloadLength);
+
+private:
+  enum class State
+  {
+    Idle,
+    Text,
+    Magic,
+    Length,
+    Payload,
+    Discard,
+  };
+
+  // one byte in, true with the frame filled in when it completed one
+  bool push(uint8_t byte, CommandFrame &frame);
+  // back to Idle if a binary frame stopped arriving partway, its length would otherwise swallow the next requests
+  void dropStalledFrame();
+
+  State state = State::Idle;
+  std::array<uint8_t, COMMAND_FRAME_MAX_SIZE + 1> buffer{};
+  size_t position = 0;
+  size_t expected = 0;
+  uint8_t lengthBytes = 0;
+  int64_t lastByteUs = 0;
+};
+
+#endif
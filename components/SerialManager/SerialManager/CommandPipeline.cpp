@@ -0,0 +1,184 @@
+#include "CommandPipeline.hpp"
+#include <algorithm>
+#include "esp_log.h"
+
+// parsing and the replies are built here, the handlers themselves run on the command executor
+#define COMMAND_PIPELINE_STACK_SIZE (1024 * 4)
+// longest the worker sleeps before looking at the telemetry subscription again
+#define COMMAND_PIPELINE_TELEMETRY_RECHECK_MS (1000)
+
+bool CommandPipeline::start()
+{
+  if (this->task != nullptr)
+  {
+    return true;
+  }
+
+  if (this->queue == nullptr)
+  {
+    this->queue = xQueueCreate(COMMAND_PIPELINE_DEPTH, sizeof(Request));
+    if (this->queue == nullptr)
+    {
+      ESP_LOGE("[SERIAL]", "Failed to create the %s queue", this->channel.taskName);
+      return false;
+    }
+  }
+
+  this->stopping = false;
+  TaskHandle_t handle = nullptr;
+  if (xTaskCreate(&CommandPipeline::taskEntry, this->channel.taskName, COMMAND_PIPELINE_STACK_SIZE, this, 1, &handle) != pdPASS)
+  {
+    ESP_LOGE("[SERIAL]", "Failed to start %s", this->channel.taskName);
+    return false;
+  }
+  this->task = handle;
+  return true;
+}
+
+void CommandPipeline::stop()
+{
+  if (this->task == nullptr)
+  {
+    return;
+  }
+
+  this->stopping = true;
+  // wakes the worker up if it's waiting for a request, it's never answered
+  const Request wakeUp{CommandFrameFormat::Cbor, nullptr};
+  xQueueSendToFront(this->queue, &wakeUp, 0);
+  // a job can keep the worker busy for a while, it still writes its reply to the channel once it's done
+  for (int waited = 0; this->task != nullptr; waited += 10)
+  {
+    if (waited == COMMAND_PIPELINE_STOP_TIMEOUT_MS)
+    {
+      ESP_LOGW("[SERIAL]", "%s is still answering a request, waiting for it", this->channel.taskName);
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
+void CommandPipeline::feed(const uint8_t *data, const size_t len)
+{
+  this->framer.feed(data, len, [this](const CommandFrame &frame)
+                    {
+    // the framer reuses its buffer for the next request, the queued one needs a copy of its own
+    Request request{frame.format, nullptr};
+    if (!frame.payload.empty())
+    {
+      request.payload = new std::vector<uint8_t>(frame.payload.begin(), frame.payload.end());
+    }
+
+    if (this->task == nullptr || xQueueSend(this->queue, &request, 0) != pdTRUE)
+    {
+      delete request.payload;
+      this->reject(frame);
+    } });
+}
+
+// answered from the reading task right away, ahead of the replies still to come for the queued ones
+void CommandPipeline::reject(const CommandFrame &frame)
+{
+  const bool binary = frame.format == CommandFrameFormat::Cbor;
+  nlohmann::json response = {{"error", "Too many requests in flight"}};
+
+  // parsed only for the id, so the host can tell which one to send again
+  CommandEnvelope envelope;
+  if (binary)
+  {
+    parseCommandEnvelope(frame.payload, envelope);
+  }
+  else
+  {
+    parseCommandEnvelope(std::string_view(reinterpret_cast<const char *>(frame.payload.data()), frame.payload.size()), envelope);
+  }
+  if (!envelope.id.is_null())
+  {
+    response["id"] = envelope.id;
+  }
+
+  this->write(response, binary);
+}
+
+void CommandPipeline::taskEntry(void *arg)
+{
+  static_cast<CommandPipeline *>(arg)->serve();
+  vTaskDelete(nullptr);
+}
+
+void CommandPipeline::serve()
+{
+  const auto telemetry = this->commandManager.getTelemetry();
+
+  Request request;
+  while (!this->stopping)
+  {
+    // wake up for the next telemetry frame, and now and then in case another channel subscribed meanwhile
+    const auto wait = std::min(telemetry->ticksUntilDue(), pdMS_TO_TICKS(COMMAND_PIPELINE_TELEMETRY_RECHECK_MS));
+    if (xQueueReceive(this->queue, &request, wait) == pdTRUE)
+    {
+      if (!this->stopping)
+      {
+        this->answer(request);
+      }
+      delete request.payload;
+    }
+
+    // nobody to read it without a host, and the writes would only wait for one
+    if (!this->stopping && this->channel.connected())
+    {
+      if (const auto frame = telemetry->takeDue())
+      {
+        this->write(frame->data, frame->binary);
+      }
+    }
+  }
+
+  // whatever was left unanswered goes with the channel
+  while (xQueueReceive(this->queue, &request, 0) == pdTRUE)
+  {
+    delete request.payload;
+  }
+  this->task = nullptr;
+}
+
+// runs one request and answers in the format it came in
+void CommandPipeline::answer(const Request &request)
+{
+  if (request.format == CommandFrameFormat::Json)
+  {
+    const auto &payload = *request.payload;
+    const nlohmann::json result = this->commandManager.executeFromJson(
+        std::string_view(reinterpret_cast<const char *>(payload.data()), payload.size()));
+    this->write(result, false);
+    return;
+  }
+
+  const nlohmann::json result = request.payload == nullptr
+                                    ? nlohmann::json{{"error", "Frame empty or too large"}}
+                                    : nlohmann::json(this->commandManager.executeFromCbor(*request.payload));
+  this->write(result, true);
+}
+
+// one message as a JSON line, or CBOR in the binary framing
+void CommandPipeline::write(const nlohmann::json &message, const bool binary)
+{
+  if (!binary)
+  {
+    // newline terminated, so a client can tell telemetry frames and responses apart as they arrive
+    const auto text = message.dump() + "\n";
+    std::lock_guard lock(this->writeMutex);
+    this->channel.write(reinterpret_cast<const uint8_t *>(text.c_str()), text.length());
+    return;
+  }
+
+  auto encoded = nlohmann::json::to_cbor(message);
+  uint8_t header[COMMAND_FRAME_HEADER_SIZE];
+  if (!CommandFramer::writeHeader(header, encoded.size()))
+  {
+    encoded = nlohmann::json::to_cbor(nlohmann::json{{"error", "Response too large"}});
+    CommandFramer::writeHeader(header, encoded.size());
+  }
+  std::lock_guard lock(this->writeMutex);
+  this->channel.write(header, sizeof(header));
+  this->channel.write(encoded.data(), encoded.size());
+}
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef COMMANDPIPELINE_HPP
+#define COMMANDPIPELINE_HPP
+
+#include <atomic>
+#include <mutex>
+#include <CommandManager.hpp>
+#include "CommandFramer.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+// requests a channel holds between reading them and answering them, one more is turned away right away
+constexpr size_t COMMAND_PIPELINE_DEPTH = 16;
+// how long stop() waits for the request being run to be answered before it warns that it's still waiting
+constexpr int COMMAND_PIPELINE_STOP_TIMEOUT_MS = 2000;
+
+// the byte stream a pipeline reads from and answers on
+struct CommandChannel
+{
+  const char *taskName;
+  void (*write)(const uint8_t *data, size_t len);
+  // whether a host has the port open, telemetry is only pushed then
+  bool (*connected)();
+};
+
+// Lets a host send requests back to back without waiting for each reply. The channel's reading task only frames
+// the bytes and queues the requests, a worker task of the pipeline runs them in order and writes the replies, so
+// the driver's receive buffer keeps being drained while a command runs. Replies, telemetry frames and the
+// rejections of requests that didn't fit all go through one lock and never cut into each other.
+class CommandPipeline
+{
+public:
+  CommandPipeline(const CommandManager &commandManager, const CommandChannel &channel)
+      : commandManager(commandManager), channel(channel) {}
+
+  // starts the worker task, false if it couldn't be
+  bool start();
+  // the worker finishes the request it's on and exits, queued ones are dropped. Returns once it has exited,
+  // however long the request takes, so the caller can take the channel away afterwards
+  void stop();
+
+  // reading task side, every request these bytes complete is queued
+  void feed(const uint8_t *data, size_t len);
+
+private:
+  struct Request
+  {
+    CommandFrameFormat format;
+    // heap copy of the payload, nullptr for a binary frame that was empty or too large
+    std::vector<uint8_t> *payload;
+  };
+
+  static void taskEntry(void *arg);
+  void serve();
+  void answer(const Request &request);
+  void reject(const CommandFrame &frame);
+  void write(const nlohmann::json &message, bool binary);
+
+  const CommandManager &commandManager;
+  CommandChannel channel;
+  CommandFramer framer;
+  QueueHandle_t queue = nullptr;
+  std::atomic<TaskHandle_t> task = nullptr;
+  std::atomic<bool> stopping = false;
+  std::mutex writeMutex;
+};
+
+#endif
@@ -4,11 +4,34 @@
 #include "tusb.h"
 
 #define BUF_SIZE (1024)
+// how many times a CDC write may make no progress before the rest of the response is dropped
+#define CDC_WRITE_RETRIES (100)
+
+static void usb_serial_jtag_write_bytes_chunked(const uint8_t *data, size_t len)
+{
+  while (len > 0)
+  {
+    auto to_write = len > BUF_SIZE ? BUF_SIZE : len;
+    auto written = usb_serial_jtag_write_bytes(data, to_write, 1000 / 20);
+    // nothing went out in time, or the driver is gone, the rest of the message goes with it
+    if (written <= 0)
+    {
+      return;
+    }
+    data += written;
+    len -= written;
+  }
+}
+
+static const CommandChannel SERIAL_COMMAND_CHANNEL = {
+    .taskName = "SerialCommandTask",
+    .write = usb_serial_jtag_write_bytes_chunked,
+    .connected = usb_serial_jtag_is_connected,
+};
 
 SerialManager::SerialManager(std::shared_ptr<CommandManager> commandManager, esp_timer_handle_t *timerHandle)
-    : commandManager(commandManager), timerHandle(timerHandle)
+    : commandManager(commandManager), timerHandle(timerHandle), pipeline(*commandManager, SERIAL_COMMAND_CHANNEL)
 {
-  this->data = static_cast<uint8_t *>(malloc(BUF_SIZE));
   this->temp_data = static_cast<uint8_t *>(malloc(256));
 }
 
@@ -18,11 +41,11 @@ void SerialManager::setup()
   usb_serial_jtag_config.rx_buffer_size = BUF_SIZE;
   usb_serial_jtag_config.tx_buffer_size = BUF_SIZE;
   usb_serial_jtag_driver_install(&usb_serial_jtag_config);
+  this->pipeline.start();
 }
 
 void SerialManager::try_receive()
 {
-  static auto current_position = 0;
   int len = usb_serial_jtag_read_bytes(this->temp_data, 256, 1000 / 20);
 
   // If driver is uninstalled or an error occurs, abort read gracefully
@@ -38,34 +61,10 @@ void SerialManager::try_receive()
   }
 
   // since we've got something on the serial port
-  // we gotta keep reading until we've got the whole message
-  // we will submit the command once we get a newline, a return or the buffer is full
-  for (auto i = 0; i < len; i++)
-  {
-    this->data[current_position++] = this->temp_data[i];
-    // if we're at the end of the buffer, try to process the command anyway
-    // if we've got a new line, we've finished sending the commands, process them
-    if (current_position >= BUF_SIZE || this->data[current_position - 1] == '\n' || this->data[current_position - 1] == '\r')
-    {
-      data[current_position] = '\0';
-      current_position = 0;
-
-      const nlohmann::json result = this->commandManager->executeFromJson(std::string_view(reinterpret_cast<const char *>(this->data)));
-      const auto resultMessage = result.dump();
-      usb_serial_jtag_write_bytes_chunked(resultMessage.c_str(), resultMessage.length(), 1000 / 20);
-    }
-  }
-}
-
-void SerialManager::usb_serial_jtag_write_bytes_chunked(const char *data, size_t len, size_t timeout)
-{
-  while (len > 0)
-  {
-    auto to_write = len > BUF_SIZE ? BUF_SIZE : len;
-    auto written = usb_serial_jtag_write_bytes(data, to_write, timeout);
-    data += written;
-    len -= written;
-  }
+  // we gotta keep reading until we've got the whole message,
+  // the pipeline queues each request once its newline or its last frame byte arrives and answers it on its own task,
+  // so we're back to draining the driver while a slow command runs
+  this->pipeline.feed(this->temp_data, len);
 }
 
 // Function to notify that a command was received during startup
@@ -83,9 +82,22 @@ void SerialManager::notify_startup_command_received()
   }
 }
 
+void SerialManager::stop_reading()
+{
+  this->readerStopping = true;
+  // the read times out every 50ms, so the task notices between two reads and never while it holds the write lock
+  while (!this->readerExited)
+  {
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
 void SerialManager::shutdown()
 {
   // Stop heartbeats; timer will be deleted by main if needed.
+  // The request being run is answered before the port goes away, the ones queued behind it are dropped.
+  // stop() only returns once the worker is gone, nothing writes to the driver after this.
+  this->pipeline.stop();
   // Uninstall the USB Serial JTAG driver to free the internal USB for TinyUSB.
   esp_err_t err = usb_serial_jtag_driver_uninstall();
   if (err == ESP_OK)
@@ -98,42 +110,58 @@ void SerialManager::shutdown()
   }
 }
 
-// we can cancel this task once we're in cdc
+// we can stop this task once we're in cdc, see stop_reading()
 void HandleSerialManagerTask(void *pvParameters)
 {
   auto const serialManager = static_cast<SerialManager *>(pvParameters);
-  while (true)
+  while (serialManager->keep_reading())
   {
     serialManager->try_receive();
   }
+  serialManager->reader_exited();
+  vTaskDelete(nullptr);
+}
+
+// tud_cdc_write() only takes what fits in the FIFO, flush and retry until the whole response is out
+static void cdc_write_all(const uint8_t *data, size_t len)
+{
+  auto retries = 0;
+  while (len > 0 && retries < CDC_WRITE_RETRIES)
+  {
+    const auto written = tud_cdc_write(data, len);
+    data += written;
+    len -= written;
+    tud_cdc_write_flush();
+    if (len > 0)
+    {
+      retries = written > 0 ? 0 : retries + 1;
+      vTaskDelay(1);
+    }
+  }
+}
+
+// tud_cdc_connected() is an inline in the TinyUSB headers, it needs a function of our own to be pointed at
+static bool cdc_connected()
+{
+  return tud_cdc_connected();
 }
 
 void HandleCDCSerialManagerTask(void *pvParameters)
 {
   auto const commandManager = static_cast<CommandManager *>(pvParameters);
-  static char buffer[BUF_SIZE];
-  auto idx = 0;
+  static CommandPipeline pipeline(*commandManager, CommandChannel{
+                                                       .taskName = "CDCCommandTask",
+                                                       .write = cdc_write_all,
+                                                       .connected = cdc_connected,
+                                                   });
+  pipeline.start();
 
   cdc_command_packet_t packet;
   while (true)
   {
     if (xQueueReceive(cdcMessageQueue, &packet, portMAX_DELAY) == pdTRUE)
     {
-      for (auto i = 0; i < packet.len; i++)
-      {
-        buffer[idx++] = packet.data[i];
-        // if we're at the end of the buffer, try to process the command anyway
-        // if we've got a new line, we've finished sending the commands, process them
-        if (idx >= BUF_SIZE || buffer[idx - 1] == '\n' || buffer[idx - 1] == '\r')
-        {
-          buffer[idx - 1] = '\0';
-          const nlohmann::json result = commandManager->executeFromJson(std::string_view(reinterpret_cast<const char *>(buffer)));
-          const auto resultMessage = result.dump();
-          tud_cdc_write(resultMessage.c_str(), resultMessage.length());
-          tud_cdc_write_flush();
-          idx = 0;
-        }
-      }
+      pipeline.feed(packet.data, packet.len);
     }
   }
 }
@@ -146,17 +174,18 @@ extern "C" void tud_cdc_rx_cb(uint8_t itf)
   // we can void the interface number
   (void)itf;
   cdc_command_packet_t packet;
-  auto len = tud_cdc_available();
 
-  if (len > 0)
+  // a host pipelining requests can leave more than one packet's worth waiting, take all of it
+  while (tud_cdc_available() > 0)
   {
     auto read = tud_cdc_read(packet.data, sizeof(packet.data));
-    if (read > 0)
+    if (read == 0)
     {
-      // we should be safe here, given that the max buffer size is 64
-      packet.len = static_cast<uint8_t>(read);
-      xQueueSend(cdcMessageQueue, &packet, 1);
+      break;
     }
+    // we should be safe here, given that the max buffer size is 64
+    packet.len = static_cast<uint8_t>(read);
+    xQueueSend(cdcMessageQueue, &packet, 1);
   }
 }
 
@@ -5,8 +5,10 @@
 #include <stdio.h>
 #include <string>
 #include <memory>
+#include <atomic>
 #include <CommandManager.hpp>
 #include <ProjectConfig.hpp>
+#include "CommandPipeline.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -36,15 +38,20 @@ public:
   void setup();
   void try_receive();
   void notify_startup_command_received();
+  // whether HandleSerialManagerTask should keep reading
+  bool keep_reading() const { return !this->readerStopping; }
+  void reader_exited() { this->readerExited = true; }
+  // asks the reading task to leave and waits until it has, its last bytes are handed to the pipeline first
+  void stop_reading();
   void shutdown();
 
 private:
-  void usb_serial_jtag_write_bytes_chunked(const char *data, size_t len, size_t timeout);
-
   std::shared_ptr<CommandManager> commandManager;
   esp_timer_handle_t *timerHandle;
-  uint8_t *data;
+  CommandPipeline pipeline;
   uint8_t *temp_data;
+  std::atomic<bool> readerStopping = false;
+  std::atomic<bool> readerExited = false;
 };
 
 void HandleSerialManagerTask(void *pvParameters);
@@ -2,10 +2,14 @@
 
 constexpr static const char *STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
 constexpr static const char *STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-constexpr static const char *STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %lli.%06li\r\n\r\n";
+constexpr static const char *STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %lli.%06li\r\n"
+                                           "X-LED-State: %s\r\nX-Frame-Sequence: %lu\r\n\r\n";
 
 static const char *STREAM_SERVER_TAG = "[STREAM_SERVER]";
 
+// open streams never return on their own, this ends them so httpd_stop() doesn't wait on a client forever
+static std::atomic<bool> s_stopping = false;
+
 StreamServer::StreamServer(const int STREAM_PORT, StateManager *stateManager) : STREAM_SERVER_PORT(STREAM_PORT), stateManager(stateManager)
 {
 }
@@ -15,6 +19,7 @@ esp_err_t StreamHelpers::stream(httpd_req_t *req)
   long last_request_time = 0;
   camera_fb_t *fb = nullptr;
   struct timeval _timestamp;
+  FrameIllumination illumination{FrameLedState::Unknown, 0};
 
   esp_err_t response = ESP_OK;
   size_t _jpg_buf_len = 0;
@@ -33,15 +38,24 @@ esp_err_t StreamHelpers::stream(httpd_req_t *req)
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
   httpd_resp_set_hdr(req, "X-Framerate", "60");
 
-  while (true)
+  while (!s_stopping)
   {
-    fb = esp_camera_fb_get();
+    // trim to the target rate, the sensor timing gets us most of the way there
+    if (const int fps_cap = cameraHandler->getTargetFrameRate(); fps_cap > 0)
+    {
+      const int64_t next_frame = last_frame + 1000000 / fps_cap;
+      if (const int64_t now = esp_timer_get_time(); now < next_frame)
+        vTaskDelay(pdMS_TO_TICKS((next_frame - now) / 1000));
+    }
+    last_frame = esp_timer_get_time();
+
+    fb = cameraHandler->acquireFrame();
 
     if (!fb)
     {
-      ESP_LOGE(STREAM_SERVER_TAG, "Camera capture failed");
-      response = ESP_FAIL;
-      // Don't break immediately, try to recover
+      // either the capture failed or the frame was rejected as broken, skip it rather than
+      // ending the stream, the next one is usually fine
+      ESP_LOGW(STREAM_SERVER_TAG, "Camera capture failed");
       vTaskDelay(pdMS_TO_TICKS(10));
       continue;
     }
@@ -51,19 +65,24 @@ esp_err_t StreamHelpers::stream(httpd_req_t *req)
       _timestamp.tv_usec = fb->timestamp.tv_usec;
       _jpg_buf_len = fb->len;
       _jpg_buf = fb->buf;
+      if (illuminationSync)
+        illumination = illuminationSync->getFrameIllumination(fb);
     }
+    TRACE_BEGIN(TRACE_HTTP_SEND, _jpg_buf_len);
     if (response == ESP_OK)
       response = httpd_resp_send_chunk(req, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY));
     if (response == ESP_OK)
     {
-      size_t hlen = snprintf((char *)part_buf, sizeof(part_buf), STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
+      size_t hlen = snprintf((char *)part_buf, sizeof(part_buf), STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec,
+                             frameLedStateToString(illumination.state), static_cast<unsigned long>(illumination.sequence));
       response = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
     }
     if (response == ESP_OK)
       response = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
+    TRACE_END(TRACE_HTTP_SEND, response);
     if (fb)
     {
-      esp_camera_fb_return(fb);
+      cameraHandler->releaseFrame(fb);
       fb = NULL;
       _jpg_buf = NULL;
     }
@@ -94,8 +113,44 @@ esp_err_t StreamHelpers::ws_logs_handle(httpd_req_t *req)
   return ret;
 }
 
+esp_err_t StreamHelpers::trace_handle(httpd_req_t *req)
+{
+  if (!traceGetStatus().enabled)
+  {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Tracing disabled");
+    return ESP_FAIL;
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"openiris_trace.json\"");
+
+  // the recorder hands out one event at a time, batch them up so we don't send a chunk per event
+  char chunk[1024];
+  size_t used = 0;
+  const bool ok = traceWriteChromeJson(SIZE_MAX, [&](const char *data, const size_t length)
+                                       {
+    if (used + length > sizeof(chunk))
+    {
+      if (httpd_resp_send_chunk(req, chunk, used) != ESP_OK)
+        return false;
+      used = 0;
+    }
+    memcpy(chunk + used, data, length);
+    used += length;
+    return true; });
+
+  if (ok && used > 0)
+    httpd_resp_send_chunk(req, chunk, used);
+  return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
 esp_err_t StreamServer::startStreamServer()
 {
+  // fast start may have brought it up already by the time the setup window closes
+  if (camera_stream != nullptr)
+    return ESP_OK;
+
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.stack_size = 20480;
   // todo bring this back to 1 once we're done with logs over websockets
@@ -121,6 +176,13 @@ esp_err_t StreamServer::startStreamServer()
       .is_websocket = true,
   };
 
+  httpd_uri_t trace_page = {
+      .uri = "/trace",
+      .method = HTTP_GET,
+      .handler = &StreamHelpers::trace_handle,
+      .user_ctx = nullptr,
+  };
+
   int status = httpd_start(&camera_stream, &config);
 
   if (status != ESP_OK)
@@ -130,6 +192,7 @@ esp_err_t StreamServer::startStreamServer()
   }
 
   httpd_register_uri_handler(camera_stream, &logs_ws);
+  httpd_register_uri_handler(camera_stream, &trace_page);
   if (this->stateManager->GetCameraState() != CameraState_e::Camera_Success)
   {
     ESP_LOGE(STREAM_SERVER_TAG, "Camera not initialized. Cannot start stream server. Logs server will be running.");
@@ -142,4 +205,22 @@ esp_err_t StreamServer::startStreamServer()
   // todo add printing IP addr here
 
   return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t StreamServer::stopStreamServer()
+{
+  if (camera_stream == nullptr)
+    return ESP_OK;
+
+  // the logger pushes through the server handle, let go of it before the handle goes away
+  webSocketLogger.unregister_socket_client();
+
+  s_stopping = true;
+  // returns once the server task has finished, a running stream ends after the frame it's sending
+  const esp_err_t status = httpd_stop(camera_stream);
+  s_stopping = false;
+  camera_stream = nullptr;
+
+  ESP_LOGI(STREAM_SERVER_TAG, "Stream server stopped");
+  return status;
+}
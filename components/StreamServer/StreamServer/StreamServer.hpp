@@ -4,20 +4,27 @@
 
 #define PART_BOUNDARY "123456789000000000000987654321"
 
+#include <atomic>
 #include "esp_log.h"
 #include "esp_camera.h"
 #include "esp_http_server.h"
 #include "esp_timer.h"
 #include <StateManager.hpp>
+#include <CameraManager.hpp>
+#include <IlluminationSync.hpp>
+#include <TraceRecorder.h>
 #include <WebSocketLogger.hpp>
 #include <helpers.hpp>
 
 extern WebSocketLogger webSocketLogger;
+extern std::shared_ptr<CameraManager> cameraHandler;
+extern std::shared_ptr<IlluminationSync> illuminationSync;
 
 namespace StreamHelpers
 {
   esp_err_t stream(httpd_req_t *req);
   esp_err_t ws_logs_handle(httpd_req_t *req);
+  esp_err_t trace_handle(httpd_req_t *req);
 }
 
 class StreamServer
@@ -30,6 +37,8 @@ private:
 public:
   StreamServer(const int STREAM_PORT, StateManager *StateManager);
   esp_err_t startStreamServer();
+  // closes open streams and frees the server, startStreamServer() can bring it back
+  esp_err_t stopStreamServer();
 
   esp_err_t stream(httpd_req_t *req);
   esp_err_t ws_logs_handle(httpd_req_t *req);
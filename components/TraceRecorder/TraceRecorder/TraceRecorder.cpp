@@ -0,0 +1,224 @@
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <esp_cpu.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TRACE_RECORDER_TAG = "[TRACE]";
+
+#if CONFIG_GENERAL_TRACE
+struct TraceEntry
+{
+  int64_t timestampUs;
+  uint32_t arg;
+  uint8_t event;
+  char phase;
+  uint8_t core;
+};
+
+// a power of two so the slot is a mask rather than a division
+static constexpr size_t TRACE_CAPACITY = std::bit_floor<size_t>(CONFIG_GENERAL_TRACE_EVENTS);
+static constexpr int CALIBRATION_EVENTS = 1000;
+
+static constexpr const char *TRACE_EVENT_NAMES[TRACE_EVENT_COUNT] = {
+    "capture",
+    "uvc_fb_get",
+    "uvc_copy",
+    "uvc_xfer",
+    "http_send",
+    "command",
+};
+
+static TraceEntry *s_ring = nullptr;
+static std::atomic<uint32_t> s_head{0};
+static std::atomic<bool> s_paused{false};
+static uint32_t s_overhead_ns = 0;
+
+// writers check the flag before claiming a slot, give the ones that got past it a tick to finish
+static void pause_recording()
+{
+  s_paused.store(true);
+  vTaskDelay(1);
+}
+
+// the newest count events up to head, recording has to be paused
+static bool visit_events(const uint32_t head, const size_t count, const std::function<bool(const TraceEvent &)> &visit)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    const TraceEntry &entry = s_ring[(head - count + i) & (TRACE_CAPACITY - 1)];
+    // a slot claimed just before the pause may not have been filled in
+    if (entry.phase == 0 || entry.event >= TRACE_EVENT_COUNT)
+      continue;
+
+    const TraceEvent event = {
+        .name = TRACE_EVENT_NAMES[entry.event],
+        .phase = entry.phase,
+        .timestamp_us = entry.timestampUs,
+        .lane = entry.event,
+        .arg = entry.arg,
+        .core = entry.core,
+    };
+    if (!visit(event))
+      return false;
+  }
+  return true;
+}
+#endif
+
+void trace_init(void)
+{
+#if CONFIG_GENERAL_TRACE
+  if (s_ring != nullptr)
+    return;
+
+  auto *ring = static_cast<TraceEntry *>(heap_caps_calloc(TRACE_CAPACITY, sizeof(TraceEntry), MALLOC_CAP_SPIRAM));
+  if (ring == nullptr)
+  {
+    ESP_LOGW(TRACE_RECORDER_TAG, "No PSRAM for the trace ring, using internal RAM");
+    ring = static_cast<TraceEntry *>(heap_caps_calloc(TRACE_CAPACITY, sizeof(TraceEntry), MALLOC_CAP_8BIT));
+  }
+  if (ring == nullptr)
+  {
+    ESP_LOGE(TRACE_RECORDER_TAG, "Failed to allocate the trace ring, tracing disabled");
+    return;
+  }
+  s_ring = ring;
+
+  // the real path, ring writes and all, then start over with an empty ring
+  const int64_t start = esp_timer_get_time();
+  for (int i = 0; i < CALIBRATION_EVENTS; i++)
+    trace_record(TRACE_COMMAND, TRACE_PHASE_INSTANT, i);
+  s_overhead_ns = static_cast<uint32_t>((esp_timer_get_time() - start) * 1000 / CALIBRATION_EVENTS);
+  s_head.store(0);
+  memset(s_ring, 0, TRACE_CAPACITY * sizeof(TraceEntry));
+
+  ESP_LOGI(TRACE_RECORDER_TAG, "Tracing %u events, %lu ns per event", static_cast<unsigned>(TRACE_CAPACITY),
+           static_cast<unsigned long>(s_overhead_ns));
+#endif
+}
+
+void trace_record(const trace_event_t event, const trace_phase_t phase, const uint32_t arg)
+{
+#if CONFIG_GENERAL_TRACE
+  TraceEntry *ring = s_ring;
+  if (ring == nullptr || s_paused.load(std::memory_order_relaxed))
+    return;
+
+  // the only shared write is the slot claim, two writers never get the same slot
+  const uint32_t index = s_head.fetch_add(1, std::memory_order_relaxed);
+  TraceEntry &entry = ring[index & (TRACE_CAPACITY - 1)];
+  entry.timestampUs = esp_timer_get_time();
+  entry.arg = arg;
+  entry.event = static_cast<uint8_t>(event);
+  entry.phase = static_cast<char>(phase);
+  entry.core = static_cast<uint8_t>(esp_cpu_get_core_id());
+#else
+  (void)event;
+  (void)phase;
+  (void)arg;
+#endif
+}
+
+TraceStatus traceGetStatus()
+{
+#if CONFIG_GENERAL_TRACE
+  return {
+      .enabled = s_ring != nullptr,
+      .capacity = TRACE_CAPACITY,
+      .recorded = s_head.load(),
+      .overhead_ns = s_overhead_ns,
+  };
+#else
+  return {};
+#endif
+}
+
+void traceClear()
+{
+#if CONFIG_GENERAL_TRACE
+  if (s_ring == nullptr)
+    return;
+
+  pause_recording();
+  s_head.store(0);
+  memset(s_ring, 0, TRACE_CAPACITY * sizeof(TraceEntry));
+  s_paused.store(false);
+#endif
+}
+
+const char *traceEventName(const trace_event_t event)
+{
+#if CONFIG_GENERAL_TRACE
+  return event < TRACE_EVENT_COUNT ? TRACE_EVENT_NAMES[event] : "unknown";
+#else
+  (void)event;
+  return "unknown";
+#endif
+}
+
+bool traceForEachEvent(const size_t max_events, const std::function<bool(const TraceEvent &)> &visit)
+{
+#if CONFIG_GENERAL_TRACE
+  if (s_ring == nullptr)
+    return false;
+
+  pause_recording();
+  const uint32_t head = s_head.load();
+  const size_t count = std::min({static_cast<size_t>(head), TRACE_CAPACITY, max_events});
+  const bool ok = visit_events(head, count, visit);
+  s_paused.store(false);
+  return ok;
+#else
+  (void)max_events;
+  (void)visit;
+  return false;
+#endif
+}
+
+bool traceWriteChromeJson(const size_t max_events, const std::function<bool(const char *, size_t)> &write)
+{
+#if CONFIG_GENERAL_TRACE
+  if (s_ring == nullptr)
+    return false;
+
+  char line[160];
+  const auto emit = [&](const int length)
+  { return length > 0 && static_cast<size_t>(length) < sizeof(line) && write(line, length); };
+
+  pause_recording();
+  const uint32_t head = s_head.load();
+  const size_t available = std::min<size_t>(head, TRACE_CAPACITY);
+  const size_t count = std::min(available, max_events);
+
+  bool ok = emit(snprintf(line, sizeof(line), "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"overhead_ns\":%lu,\"recorded\":%lu,\"capacity\":%u},\"traceEvents\":[",
+                          static_cast<unsigned long>(s_overhead_ns), static_cast<unsigned long>(head), static_cast<unsigned>(TRACE_CAPACITY)));
+
+  // one named lane per event kind
+  for (int event = 0; ok && event < TRACE_EVENT_COUNT; event++)
+  {
+    ok = emit(snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                       event == 0 ? "" : ",", event, TRACE_EVENT_NAMES[event]));
+  }
+
+  ok = ok && visit_events(head, count, [&](const TraceEvent &event)
+                          { return emit(snprintf(line, sizeof(line), ",{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%lld,\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%lu,\"core\":%u}}",
+                                                 event.name, event.phase, event.phase == TRACE_PHASE_INSTANT ? "\"s\":\"t\"," : "",
+                                                 static_cast<long long>(event.timestamp_us), event.lane, static_cast<unsigned long>(event.arg), event.core)); });
+
+  ok = ok && write("]}", 2);
+  s_paused.store(false);
+  return ok;
+#else
+  (void)max_events;
+  (void)write;
+  return false;
+#endif
+}
@@ -0,0 +1,92 @@
+#pragma once
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+// Lock-free ring of timestamped hot path events, dumped as Chrome Trace Event JSON
+// (chrome://tracing, ui.perfetto.dev). Compiled out unless CONFIG_GENERAL_TRACE is set.
+// Plain C so the vendored UVC driver can record too.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  // each event gets its own lane (tid) in the trace, so a begin and its end may come from different tasks
+  typedef enum
+  {
+    TRACE_CAPTURE = 0,  // esp_camera_fb_get()
+    TRACE_UVC_FB_GET,   // camera_fb_get_cb, pacing and tagging included
+    TRACE_UVC_COPY,     // frame memcpy into the UVC transfer buffer
+    TRACE_UVC_XFER,     // tud_video_n_frame_xfer() until the transfer complete callback
+    TRACE_HTTP_SEND,    // one multipart frame sent on the MJPEG stream
+    TRACE_COMMAND,      // one command dispatched, arg is the CommandType
+    TRACE_EVENT_COUNT,
+  } trace_event_t;
+
+  typedef enum
+  {
+    TRACE_PHASE_BEGIN = 'B',
+    TRACE_PHASE_END = 'E',
+    TRACE_PHASE_INSTANT = 'i',
+  } trace_phase_t;
+
+  // allocates the ring and measures the cost of one event, call once early in app_main
+  void trace_init(void);
+  void trace_record(trace_event_t event, trace_phase_t phase, uint32_t arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if CONFIG_GENERAL_TRACE
+#define TRACE_BEGIN(event, arg) trace_record((event), TRACE_PHASE_BEGIN, (uint32_t)(arg))
+#define TRACE_END(event, arg) trace_record((event), TRACE_PHASE_END, (uint32_t)(arg))
+#define TRACE_INSTANT(event, arg) trace_record((event), TRACE_PHASE_INSTANT, (uint32_t)(arg))
+#else
+#define TRACE_BEGIN(event, arg) ((void)0)
+#define TRACE_END(event, arg) ((void)0)
+#define TRACE_INSTANT(event, arg) ((void)0)
+#endif
+
+#ifdef __cplusplus
+#include <functional>
+
+struct TraceStatus
+{
+  bool enabled;
+  size_t capacity;
+  // events recorded since boot or the last clear, anything past capacity overwrote older ones
+  uint32_t recorded;
+  // measured by trace_init(), average cost of one trace_record() call
+  uint32_t overhead_ns;
+};
+
+struct TraceEvent
+{
+  const char *name;
+  char phase;
+  int64_t timestamp_us;
+  // the trace_event_t, used as the lane
+  uint8_t lane;
+  uint32_t arg;
+  uint8_t core;
+};
+
+TraceStatus traceGetStatus();
+void traceClear();
+const char *traceEventName(trace_event_t event);
+
+// Visits the newest max_events events oldest first, recording is paused meanwhile.
+// The visitor returns false to stop early.
+bool traceForEachEvent(size_t max_events, const std::function<bool(const TraceEvent &)> &visit);
+
+// Writes the newest max_events events as a Chrome trace JSON object in small pieces, recording is paused meanwhile.
+// The writer returns false to abort, e.g. when the client went away.
+bool traceWriteChromeJson(size_t max_events, const std::function<bool(const char *, size_t)> &write);
+#endif
+
+#endif
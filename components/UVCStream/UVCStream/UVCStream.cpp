@@ -1,4 +1,5 @@
 #include "UVCStream.hpp"
+#include <atomic>
 #include <cstdio> // for snprintf
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -6,10 +7,24 @@
 
 static const char *UVC_STREAM_TAG = "[UVC DEVICE]";
 
+// anything the host asks for above this needs the high speed readout
+static constexpr int UVC_NORMAL_MAX_FPS = 60;
 // Tracks whether a frame has been handed to TinyUSB and not yet returned.
 // File scope so both get_cb and return_cb can access it safely.
 static bool s_frame_inflight = false;
 
+// what the host negotiated, applied by the setup task rather than inside TinyUSB's commit callback
+struct StreamSetup
+{
+  framesize_t frame_size;
+  int rate;
+  uint32_t generation;
+};
+static QueueHandle_t s_stream_setup_queue = nullptr;
+// no frames go out until the sensor runs at the size of the latest stream start
+static std::atomic<uint32_t> s_stream_setup_requested = 0;
+static std::atomic<uint32_t> s_stream_setup_applied = 0;
+
 extern "C"
 {
   static char serial_number_str[13];
@@ -41,6 +56,29 @@ extern "C"
 
 // single definition of shared framebuffer storage
 UVCStreamHelpers::fb_t UVCStreamHelpers::s_fb = {};
+// COM segment of the frame in flight, copied along with it
+static uint8_t s_frame_tag[48];
+
+size_t UVCStreamHelpers::build_frame_tag(const camera_fb_t *fb, uint8_t *out, const size_t size)
+{
+  if (!illuminationSync || size < 5)
+    return 0;
+
+  const FrameIllumination illumination = illuminationSync->getFrameIllumination(fb);
+  char *text = reinterpret_cast<char *>(out + 4);
+  const int text_len = snprintf(text, size - 4, "OpenIris led=%s seq=%lu", frameLedStateToString(illumination.state),
+                                static_cast<unsigned long>(illumination.sequence));
+  if (text_len <= 0 || static_cast<size_t>(text_len) >= size - 4)
+    return 0;
+
+  // COM marker, then the big endian length which counts itself but not the marker
+  const size_t segment_len = 2 + text_len;
+  out[0] = 0xFF;
+  out[1] = 0xFE;
+  out[2] = static_cast<uint8_t>(segment_len >> 8);
+  out[3] = static_cast<uint8_t>(segment_len & 0xFF);
+  return 2 + segment_len;
+}
 
 static esp_err_t UVCStreamHelpers::camera_start_cb(uvc_format_t format, int width, int height, int rate, void *cb_ctx)
 {
@@ -58,13 +96,27 @@ static esp_err_t UVCStreamHelpers::camera_start_cb(uvc_format_t format, int widt
   {
     frame_size = FRAMESIZE_240X240;
   }
+  else if (width == 320 && height == 240)
+  {
+    frame_size = FRAMESIZE_QVGA;
+  }
+  else if (width == 176 && height == 144)
+  {
+    frame_size = FRAMESIZE_QCIF;
+  }
+  else if (width == 160 && height == 120)
+  {
+    frame_size = FRAMESIZE_QQVGA;
+  }
   else
   {
     ESP_LOGE(UVC_STREAM_TAG, "Unsupported frame size %dx%d", width, height);
     return ESP_ERR_NOT_SUPPORTED;
   }
 
-  cameraHandler->setCameraResolution(frame_size);
+  // reconfiguring the sensor measures its frame rate over a dozen frames, far too long for a USB callback
+  const StreamSetup setup = {frame_size, rate, ++s_stream_setup_requested};
+  xQueueOverwrite(s_stream_setup_queue, &setup);
 
   constexpr SystemEvent event = {EventSource::STREAM, StreamState_e::Stream_ON};
   xQueueSend(eventQueue, &event, 10);
@@ -72,12 +124,41 @@ static esp_err_t UVCStreamHelpers::camera_start_cb(uvc_format_t format, int widt
   return ESP_OK;
 }
 
+void UVCStreamHelpers::stream_setup_task(void *arg)
+{
+  (void)arg;
+  StreamSetup setup;
+  while (true)
+  {
+    if (xQueueReceive(s_stream_setup_queue, &setup, portMAX_DELAY) != pdTRUE)
+    {
+      continue;
+    }
+
+    // the host can enumerate and open the stream while the camera is still coming up, nothing waits on us meanwhile
+    waitForCameraInit(portMAX_DELAY);
+    if (cameraHandler->getSensorPID() == 0)
+    {
+      ESP_LOGE(UVC_STREAM_TAG, "Camera not available");
+    }
+    else
+    {
+      // frame table entries above the normal rate are the high speed ones, otherwise stick to what's configured,
+      // and the sensor runs at the negotiated rate rather than capturing frames we'd drop
+      cameraHandler->setStreamFormat(setup.frame_size,
+                                     setup.rate > UVC_NORMAL_MAX_FPS || deviceConfig->getCameraConfig().high_speed,
+                                     setup.rate);
+    }
+    s_stream_setup_applied = setup.generation;
+  }
+}
+
 static void UVCStreamHelpers::camera_stop_cb(void *cb_ctx)
 {
   (void)cb_ctx;
   if (s_fb.cam_fb_p)
   {
-    esp_camera_fb_return(s_fb.cam_fb_p);
+    cameraHandler->releaseFrame(s_fb.cam_fb_p);
     s_fb.cam_fb_p = nullptr;
   }
 
@@ -96,10 +177,14 @@ static uvc_fb_t *UVCStreamHelpers::camera_fb_get_cb(void *cb_ctx)
   // --- Frame pacing BEFORE grabbing a new camera frame ---
   static int64_t next_deadline_us = 0;    // next permitted capture time
   static int rem_acc = 0;                 // fractional remainder accumulator
-  static const int target_fps = 60;          // desired FPS
+  static const int max_fps = UVC_NORMAL_MAX_FPS; // used when nobody asked for a rate
   static const int64_t us_per_sec = 1000000; // 1e6 microseconds
-  static const int base_interval_us = us_per_sec / target_fps; // 16666
-  static const int rem_us = us_per_sec % target_fps;           // 40 (distributed)
+
+  // the sensor already runs at roughly this rate, pacing here only trims what its timing couldn't hit exactly
+  const int requested_fps = cameraHandler->getTargetFrameRate();
+  const int target_fps = requested_fps > 0 ? requested_fps : max_fps;
+  const int base_interval_us = us_per_sec / target_fps; // 16666 at 60 fps
+  const int rem_us = us_per_sec % target_fps;           // 40 at 60 fps (distributed)
 
   const int64_t now_us = esp_timer_get_time();
   if (next_deadline_us == 0)
@@ -108,14 +193,15 @@ static uvc_fb_t *UVCStreamHelpers::camera_fb_get_cb(void *cb_ctx)
     next_deadline_us = now_us;
   }
 
-  // If a frame is still being transmitted or we are too early, just signal no frame
-  if (s_frame_inflight || now_us < next_deadline_us)
+  // If a frame is still being transmitted, the sensor isn't set up for this stream yet or we are too early,
+  // just signal no frame
+  if (s_frame_inflight || s_stream_setup_applied != s_stream_setup_requested || now_us < next_deadline_us)
   {
     return nullptr; // host will poll again
   }
 
   // Acquire a fresh frame only when allowed and no frame in flight
-  camera_fb_t *cam_fb = esp_camera_fb_get();
+  camera_fb_t *cam_fb = cameraHandler->acquireFrame();
   if (!cam_fb)
   {
     return nullptr;
@@ -128,12 +214,14 @@ static uvc_fb_t *UVCStreamHelpers::camera_fb_get_cb(void *cb_ctx)
   s_fb.uvc_fb.height = cam_fb->height;
   s_fb.uvc_fb.format = UVC_FORMAT_JPEG;
   s_fb.uvc_fb.timestamp = cam_fb->timestamp;
+  s_fb.uvc_fb.segment = s_frame_tag;
+  s_fb.uvc_fb.segment_len = build_frame_tag(cam_fb, s_frame_tag, sizeof(s_frame_tag));
 
   // Validate size fits into transfer buffer
-  if (mgr && s_fb.uvc_fb.len > mgr->getUvcBufferSize())
+  if (mgr && s_fb.uvc_fb.len + s_fb.uvc_fb.segment_len > mgr->getUvcBufferSize())
   {
     ESP_LOGE(UVC_STREAM_TAG, "Frame size %d exceeds UVC buffer size %u", (int)s_fb.uvc_fb.len, (unsigned)mgr->getUvcBufferSize());
-    esp_camera_fb_return(cam_fb);
+    cameraHandler->releaseFrame(cam_fb);
     s_fb.cam_fb_p = nullptr;
     return nullptr;
   }
@@ -159,7 +247,7 @@ static void UVCStreamHelpers::camera_fb_return_cb(uvc_fb_t *fb, void *cb_ctx)
   assert(fb == &s_fb.uvc_fb);
   if (s_fb.cam_fb_p)
   {
-    esp_camera_fb_return(s_fb.cam_fb_p);
+    cameraHandler->releaseFrame(s_fb.cam_fb_p);
     s_fb.cam_fb_p = nullptr;
   }
   s_frame_inflight = false;
@@ -183,6 +271,14 @@ esp_err_t UVCStreamManager::setup()
     return ESP_FAIL;
   }
 
+  s_stream_setup_queue = xQueueCreate(1, sizeof(StreamSetup));
+  if (s_stream_setup_queue == nullptr ||
+      xTaskCreate(UVCStreamHelpers::stream_setup_task, "UVCStreamSetupTask", 4096, nullptr, 1, nullptr) != pdPASS)
+  {
+    ESP_LOGE(UVC_STREAM_TAG, "Starting the UVC stream setup task failed");
+    return ESP_FAIL;
+  }
+
   uvc_device_config_t config = {
       .uvc_buffer = uvc_buffer,
       .uvc_buffer_size = UVCStreamManager::UVC_MAX_FRAMESIZE_SIZE,
@@ -5,7 +5,9 @@
 #include "esp_mac.h"
 #include "esp_camera.h"
 #include <CameraManager.hpp>
+#include <IlluminationSync.hpp>
 #include <StateManager.hpp>
+#include <main_globals.hpp>
 #include "esp_log.h"
 #include "usb_device_uvc.h"
 #include "freertos/FreeRTOS.h"
@@ -15,6 +17,8 @@
 // in order to update the frame settings
 extern std::shared_ptr<CameraManager> cameraHandler;
 extern std::shared_ptr<ProjectConfig> deviceConfig;
+// tags every frame with the LED state it was captured under
+extern std::shared_ptr<IlluminationSync> illuminationSync;
 
 #ifdef __cplusplus
 extern "C"
@@ -44,10 +48,15 @@ namespace UVCStreamHelpers
   // single storage is defined in UVCStream.cpp
   extern fb_t s_fb;
 
+  // JPEG comment segment carrying the frame's LED state, UVC payload headers have no room for it
+  size_t build_frame_tag(const camera_fb_t *fb, uint8_t *out, size_t size);
+
   static esp_err_t camera_start_cb(uvc_format_t format, int width, int height, int rate, void *cb_ctx);
   static void camera_stop_cb(void *cb_ctx);
   static uvc_fb_t *camera_fb_get_cb(void *cb_ctx);
   static void camera_fb_return_cb(uvc_fb_t *fb, void *cb_ctx);
+  // applies what camera_start_cb negotiated, off the TinyUSB task
+  void stream_setup_task(void *arg);
 }
 
 class UVCStreamManager
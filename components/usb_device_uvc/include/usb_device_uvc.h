@@ -32,6 +32,8 @@ typedef struct {
     size_t height;              /*!< Height of the image frame in pixels */
     uvc_format_t format;        /*!< Format of the frame data */
     struct timeval timestamp;   /*!< Timestamp since boot of the frame */
+    const uint8_t *segment;     /*!< Optional JPEG segment inserted right after the SOI marker, NULL for none */
+    size_t segment_len;         /*!< Length of the segment in bytes, marker included */
 } uvc_fb_t;
 
 /**
@@ -17,6 +17,7 @@
 #endif
 #include "tusb.h"
 #include "usb_device_uvc.h"
+#include "TraceRecorder.h"
 
 static const char *TAG = "usbd_uvc";
 
@@ -104,6 +105,20 @@ void tud_resume_cb(void)
 //--------------------------------------------------------------------+
 // USB Video
 //--------------------------------------------------------------------+
+static uint32_t uvc_copy_frame(uint8_t *dst, const uvc_fb_t *pic)
+{
+    // the extra segment goes between SOI and the rest of the JPEG, decoders skip what they don't know
+    if (pic->segment == NULL || pic->segment_len == 0 || pic->len < 2)
+    {
+        memcpy(dst, pic->buf, pic->len);
+        return pic->len;
+    }
+    memcpy(dst, pic->buf, 2);
+    memcpy(dst + 2, pic->segment, pic->segment_len);
+    memcpy(dst + 2 + pic->segment_len, pic->buf + 2, pic->len - 2);
+    return pic->len + pic->segment_len;
+}
+
 static void video_task(void *arg)
 {
     uint32_t start_ms = 0;
@@ -152,7 +167,9 @@ static void video_task(void *arg)
 
         start_ms += s_uvc_device.interval_ms[0];
         ESP_LOGD(TAG, "frame %" PRIu32 " taking picture...", frame_num);
+        TRACE_BEGIN(TRACE_UVC_FB_GET, 0);
         pic = s_uvc_device.user_config[0].fb_get_cb(s_uvc_device.user_config[0].cb_ctx);
+        TRACE_END(TRACE_UVC_FB_GET, pic ? pic->len : 0);
         if (pic)
         {
             ESP_LOGD(TAG, "Picture taken! Its size was: %zu bytes", pic->len);
@@ -163,16 +180,18 @@ static void video_task(void *arg)
             continue;
         }
 
-        if (pic->len > uvc_buffer_size)
+        if (pic->len + pic->segment_len > uvc_buffer_size)
         {
             ESP_LOGW(TAG, "frame size is too big, dropping frame");
             s_uvc_device.user_config[0].fb_return_cb(pic, s_uvc_device.user_config[0].cb_ctx);
             continue;
         }
-        frame_len = pic->len;
-        memcpy(uvc_buffer, pic->buf, frame_len);
+        TRACE_BEGIN(TRACE_UVC_COPY, 0);
+        frame_len = uvc_copy_frame(uvc_buffer, pic);
+        TRACE_END(TRACE_UVC_COPY, frame_len);
         s_uvc_device.user_config[0].fb_return_cb(pic, s_uvc_device.user_config[0].cb_ctx);
         tx_busy = 1;
+        TRACE_BEGIN(TRACE_UVC_XFER, frame_len);
         tud_video_n_frame_xfer(0, 0, (void *)uvc_buffer, frame_len);
         ESP_LOGD(TAG, "frame %" PRIu32 " transfer start, size %" PRIu32, frame_num, frame_len);
     }
@@ -227,7 +246,9 @@ static void video_task2(void *arg)
 
         start_ms += s_uvc_device.interval_ms[1];
         ESP_LOGD(TAG, "frame %" PRIu32 " taking picture...", frame_num);
+        TRACE_BEGIN(TRACE_UVC_FB_GET, 1);
         pic = s_uvc_device.user_config[1].fb_get_cb(s_uvc_device.user_config[1].cb_ctx);
+        TRACE_END(TRACE_UVC_FB_GET, pic ? pic->len : 0);
         if (pic)
         {
             ESP_LOGD(TAG, "Picture taken! Its size was: %zu bytes", pic->len);
@@ -238,16 +259,18 @@ static void video_task2(void *arg)
             continue;
         }
 
-        if (pic->len > uvc_buffer_size)
+        if (pic->len + pic->segment_len > uvc_buffer_size)
         {
             ESP_LOGW(TAG, "frame size is too big, dropping frame");
             s_uvc_device.user_config[1].fb_return_cb(pic, s_uvc_device.user_config[1].cb_ctx);
             continue;
         }
-        frame_len = pic->len;
-        memcpy(uvc_buffer, pic->buf, frame_len);
+        TRACE_BEGIN(TRACE_UVC_COPY, 1);
+        frame_len = uvc_copy_frame(uvc_buffer, pic);
+        TRACE_END(TRACE_UVC_COPY, frame_len);
         s_uvc_device.user_config[1].fb_return_cb(pic, s_uvc_device.user_config[1].cb_ctx);
         tx_busy = 1;
+        TRACE_BEGIN(TRACE_UVC_XFER, frame_len);
         tud_video_n_frame_xfer(1, 0, (void *)uvc_buffer, frame_len);
         ESP_LOGD(TAG, "frame %" PRIu32 " transfer start, size %" PRIu32, frame_num, frame_len);
     }
@@ -258,6 +281,7 @@ void tud_video_frame_xfer_complete_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx
 {
     (void)ctl_idx;
     (void)stm_idx;
+    TRACE_END(TRACE_UVC_XFER, ctl_idx);
     xTaskNotifyGive(s_uvc_device.uvc_task_hdl[ctl_idx]);
 }
 
@@ -275,8 +299,10 @@ int tud_video_commit_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx,
     }
     s_uvc_device.interval_ms[ctl_idx] = parameters->dwFrameInterval / 10000;
     int frame_index = parameters->bFrameIndex - 1;
+    /* hand the negotiated rate to the camera so it can program the sensor timing, fall back to the table rate */
+    int rate = parameters->dwFrameInterval ? (int)(10000000 / parameters->dwFrameInterval) : UVC_FRAMES_INFO[ctl_idx][frame_index].rate;
     esp_err_t ret = s_uvc_device.user_config[ctl_idx].start_cb(s_uvc_device.format[ctl_idx], UVC_FRAMES_INFO[ctl_idx][frame_index].width,
-                                                               UVC_FRAMES_INFO[ctl_idx][frame_index].height, UVC_FRAMES_INFO[ctl_idx][frame_index].rate, s_uvc_device.user_config[ctl_idx].cb_ctx);
+                                                               UVC_FRAMES_INFO[ctl_idx][frame_index].height, rate, s_uvc_device.user_config[ctl_idx].cb_ctx);
 
     if (ret != ESP_OK)
     {
@@ -242,6 +242,7 @@ void WiFiManager::SetupAccessPoint()
 
 std::vector<WiFiNetwork> WiFiManager::ScanNetworks()
 {
+  std::lock_guard lock(this->radioMutex);
   wifi_mode_t current_mode;
   esp_err_t err = esp_wifi_get_mode(&current_mode);
 
@@ -314,6 +315,7 @@ WiFiState_e WiFiManager::GetCurrentWiFiState()
 
 void WiFiManager::TryConnectToStoredNetworks()
 {
+  std::lock_guard lock(this->radioMutex);
   ESP_LOGI(WIFI_MANAGER_TAG, "Manual WiFi connection attempt requested");
 
   // Check current WiFi mode
@@ -355,6 +357,7 @@ void WiFiManager::TryConnectToStoredNetworks()
 
 void WiFiManager::Begin()
 {
+  std::lock_guard lock(this->radioMutex);
   s_wifi_event_group = xEventGroupCreate();
 
   ESP_ERROR_CHECK(esp_netif_init());
@@ -405,3 +408,33 @@ void WiFiManager::Begin()
     this->SetupAccessPoint();
   }
 }
+
+void WiFiManager::Stop()
+{
+  std::lock_guard lock(this->radioMutex);
+  ESP_LOGI(WIFI_MANAGER_TAG, "Stopping WiFi");
+  // unregister first, otherwise the disconnect below kicks off a reconnect
+  esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id);
+  esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip);
+
+  esp_wifi_disconnect();
+  esp_wifi_stop();
+  // releases the driver's RX/TX buffers, the bulk of what the radio holds on to
+  esp_wifi_deinit();
+
+  // Begin() may have fallen back to AP mode, so either of these can exist
+  for (const auto *key : {"WIFI_STA_DEF", "WIFI_AP_DEF"})
+  {
+    if (esp_netif_t *netif = esp_netif_get_handle_from_ifkey(key); netif != nullptr)
+      esp_netif_destroy_default_wifi(netif);
+  }
+
+  if (s_wifi_event_group != nullptr)
+  {
+    vEventGroupDelete(s_wifi_event_group);
+    s_wifi_event_group = nullptr;
+  }
+
+  SystemEvent event = {EventSource::WIFI, WiFiState_e::WiFiState_Disconnected};
+  xQueueSend(this->eventQueue, &event, 10);
+}
@@ -5,6 +5,7 @@
 #include <string>
 #include <cstring>
 #include <algorithm>
+#include <mutex>
 #include <StateManager.hpp>
 #include <ProjectConfig.hpp>
 #include "WiFiScanner.hpp"
@@ -41,6 +42,9 @@ private:
 
   int8_t power;
 
+  // a scan switches the driver's mode around for seconds, it must not run into a connect, Begin() or Stop()
+  std::mutex radioMutex;
+
   void SetCredentials(const char *ssid, const char *password);
   void ConnectWithHardcodedCredentials();
   void ConnectWithStoredCredentials();
@@ -49,6 +53,8 @@ private:
 public:
   WiFiManager(std::shared_ptr<ProjectConfig> deviceConfig, QueueHandle_t eventQueue, StateManager *stateManager);
   void Begin();
+  // tears the driver and its netifs down, the default event loop and netif stack stay up
+  void Stop();
   std::vector<WiFiNetwork> ScanNetworks();
   WiFiState_e GetCurrentWiFiState();
   void TryConnectToStoredNetworks();
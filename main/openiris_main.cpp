@@ -1,3 +1,4 @@
+#include <atomic>
 #include <cstdio>
 #include <string>
 #include "freertos/FreeRTOS.h"
@@ -6,6 +7,7 @@
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_system.h"
 #include "sdkconfig.h"
 #include "nvs_flash.h"
 
@@ -14,8 +16,11 @@
 #include <ProjectConfig.hpp>
 #include <StateManager.hpp>
 #include <LEDManager.hpp>
+#include <LEDCurrentRegulator.hpp>
 #include <MDNSManager.hpp>
 #include <CameraManager.hpp>
+#include <ExposureController.hpp>
+#include <IlluminationSync.hpp>
 #include <WebSocketLogger.hpp>
 #include <StreamServer.hpp>
 #include <CommandManager.hpp>
@@ -23,6 +28,8 @@
 #include <RestAPI.hpp>
 #include <main_globals.hpp>
 #include <MonitoringManager.hpp>
+#include <TraceRecorder.h>
+#include <BootProfiler.hpp>
 
 #ifdef CONFIG_GENERAL_INCLUDE_UVC_MODE
 #include <UVCStream.hpp>
@@ -45,7 +52,8 @@ TaskHandle_t serialManagerHandle;
 esp_timer_handle_t timerHandle = nullptr;
 QueueHandle_t eventQueue = xQueueCreate(10, sizeof(SystemEvent));
 QueueHandle_t ledStateQueue = xQueueCreate(10, sizeof(uint32_t));
-QueueHandle_t cdcMessageQueue = xQueueCreate(3, sizeof(cdc_command_packet_t));
+// deep enough for a burst of pipelined requests while the CDC task is busy queueing the previous ones
+QueueHandle_t cdcMessageQueue = xQueueCreate(8, sizeof(cdc_command_packet_t));
 
 auto *stateManager = new StateManager(eventQueue, ledStateQueue);
 auto dependencyRegistry = std::make_shared<DependencyRegistry>();
@@ -69,10 +77,79 @@ UVCStreamManager uvcStream;
 
 auto ledManager = std::make_shared<LEDManager>(BLINK_GPIO, CONFIG_LED_C_PIN_GPIO, ledStateQueue, deviceConfig);
 std::shared_ptr<MonitoringManager> monitoringManager = std::make_shared<MonitoringManager>();
+auto ledCurrentRegulator = std::make_shared<LEDCurrentRegulator>(ledManager);
+auto exposureController = std::make_shared<ExposureController>(cameraHandler, ledManager, deviceConfig);
+auto illuminationSync = std::make_shared<IlluminationSync>(cameraHandler, ledManager, monitoringManager, deviceConfig);
 auto *serialManager = new SerialManager(commandManager, &timerHandle);
 
 void startWiFiMode();
+void stopWiFiMode();
 void startWiredMode(bool shouldCloseSerialManager);
+void startAutoModeStream();
+
+// what's actually up right now, the saved mode only says what the next start brings up.
+// Written from app_main and the esp_timer task, read by the command tasks
+static std::atomic<bool> wifiTransportUp = false;
+// false during the setup window and in heartbeat mode, a mode switch then waits for launch_streaming()
+static std::atomic<bool> streamingLaunched = false;
+
+#if CONFIG_MONITORING_THERMAL
+// the camera side of a thermal step re-programs the sensor timing and may re-initialize the driver, both wait on
+// frames. The monitoring task only hands it over here, it has the LED current to sample meanwhile
+static QueueHandle_t thermalStateQueue = nullptr;
+
+static void applyThermalCameraLimits(ThermalState state)
+{
+    switch (state)
+    {
+    case ThermalState::Normal:
+        cameraHandler->setFrameRateCap(0);
+        cameraHandler->restoreXclk();
+        break;
+    case ThermalState::Warm:
+        cameraHandler->setFrameRateCap(CONFIG_MONITORING_THERMAL_WARM_FPS);
+        cameraHandler->restoreXclk();
+        break;
+    case ThermalState::Critical:
+        cameraHandler->setFrameRateCap(CONFIG_MONITORING_THERMAL_CRITICAL_FPS);
+        cameraHandler->throttleXclk(CONFIG_MONITORING_THERMAL_CRITICAL_XCLK_FREQ);
+        break;
+    }
+}
+
+static void HandleThermalCameraTask(void *pvParameter)
+{
+    // a state that comes in during camera bring-up waits for it, the driver isn't ours to touch before that
+    waitForCameraInit(portMAX_DELAY);
+
+    ThermalState state;
+    while (true)
+    {
+        // only the latest state is kept, steps that came in while one was being applied are skipped
+        if (xQueueReceive(thermalStateQueue, &state, portMAX_DELAY) == pdTRUE)
+        {
+            applyThermalCameraLimits(state);
+        }
+    }
+}
+
+// runs on the monitoring task whenever the thermal state changes
+static void applyThermalState(ThermalState state)
+{
+    // a duty change, cheap enough to do right away
+    switch (state)
+    {
+    case ThermalState::Normal:
+    case ThermalState::Warm:
+        ledManager->setExternalLEDDutyLimit(100);
+        break;
+    case ThermalState::Critical:
+        ledManager->setExternalLEDDutyLimit(CONFIG_MONITORING_THERMAL_CRITICAL_LED_DUTY_LIMIT);
+        break;
+    }
+    xQueueOverwrite(thermalStateQueue, &state);
+}
+#endif
 
 static void initNVSStorage()
 {
@@ -85,6 +162,23 @@ static void initNVSStorage()
     ESP_ERROR_CHECK(ret);
 }
 
+static void initCamera()
+{
+    BootProfiler::ScopedPhase phase("camera_init");
+    if (cameraHandler->setupCamera())
+    {
+        exposureController->start();
+        illuminationSync->start();
+    }
+    setCameraInitDone();
+}
+
+static void HandleCameraInitTask(void *pvParameter)
+{
+    initCamera();
+    vTaskDelete(nullptr);
+}
+
 int websocket_logger(const char *format, va_list args)
 {
     webSocketLogger.log_message(format, args);
@@ -93,12 +187,9 @@ int websocket_logger(const char *format, va_list args)
 
 void launch_streaming()
 {
-    // Note, when switching and later right away activating UVC mode when we were previously in WiFi or Setup mode, the WiFi
-    // utilities will still be running since we've launched them with startAutoMode() -> startWiFiMode()
-    // we could add detection of this case, but it's probably not worth it since the next start of the device literally won't launch them
-    // and we're telling folks to just reboot the device anyway
-    // same case goes for when switching from UVC to WiFi
-
+    // setup mode already brought Wi-Fi up, startWiredMode() tears it down before taking over the USB port
+    // and startWiFiMode() only starts what isn't running yet
+    streamingLaunched = true;
     StreamingMode deviceMode = deviceConfig->getDeviceMode();
     // if we've changed the mode from setup to something else, we can clean up serial manager
     // either the API endpoints or CDC will take care of further configuration
@@ -114,6 +205,7 @@ void launch_streaming()
     {
         // we're still in setup, the user didn't select anything yet, let's give a bit of time for them to make a choice
         ESP_LOGI("[MAIN]", "No mode was selected, staying in SETUP mode. WiFi streaming will be enabled still. \nPlease select another mode if you'd like.");
+        startAutoModeStream();
     }
     else
     {
@@ -168,13 +260,24 @@ void startWiredMode(bool shouldCloseSerialManager)
     deviceMode = StreamingMode::WIFI;
     startWiFiMode();
 #else
+    if (getUsbHandoverDone())
+    {
+        ESP_LOGI("[MAIN]", "UVC streaming is already running.");
+        return;
+    }
+
     ESP_LOGI("[MAIN]", "Starting UVC streaming mode.");
-    if (shouldCloseSerialManager)
+    // the radio and the web servers have nothing left to do once the USB port is ours
+    stopWiFiMode();
+    if (shouldCloseSerialManager && serialManagerHandle != nullptr)
     {
         ESP_LOGI("[MAIN]", "Closing serial manager task.");
-        vTaskDelete(serialManagerHandle);
+        // not deleted from under it, it could be holding the lock the replies are written under
+        serialManager->stop_reading();
+        serialManagerHandle = nullptr;
     }
 
+    const int handoverPhase = BootProfiler::begin("usb_handover");
     ESP_LOGI("[MAIN]", "Shutting down serial manager, CDC will take over in a bit.");
     serialManager->shutdown();
 
@@ -182,10 +285,13 @@ void startWiredMode(bool shouldCloseSerialManager)
     // Leaving a small gap for the host to see COM disappear
     vTaskDelay(pdMS_TO_TICKS(200));
     setUsbHandoverDone(true);
+    BootProfiler::end(handoverPhase);
 
     ESP_LOGI("[MAIN]", "Setting up UVC Streamer");
 
+    const int uvcPhase = BootProfiler::begin("uvc_setup");
     esp_err_t ret = uvcStream.setup();
+    BootProfiler::end(uvcPhase);
     if (ret != ESP_OK)
     {
         ESP_LOGE("[MAIN]", "Failed to initialize UVC: %s", esp_err_to_name(ret));
@@ -212,26 +318,116 @@ void startWiFiMode()
 {
     ESP_LOGI("[MAIN]", "Starting WiFi streaming mode.");
 #ifdef CONFIG_GENERAL_ENABLE_WIRELESS
-    wifiManager->Begin();
-    mdnsManager.start();
-    restAPI->begin();
+    // setup mode brings the network up first, leaving only the stream for when a mode is picked
+    if (!wifiTransportUp)
+    {
+        {
+            BootProfiler::ScopedPhase phase("wifi_connect");
+            wifiManager->Begin();
+        }
+        {
+            BootProfiler::ScopedPhase phase("mdns_rest_start");
+            mdnsManager.start();
+            restAPI->begin();
+        }
+        xTaskCreate(
+            HandleRestAPIPollTask,
+            "HandleRestAPIPollTask",
+            // /metrics formats floats with vsnprintf, which wants more stack than the JSON routes did
+            1024 * 4,
+            restAPI,
+            1, // it's the rest API, we only serve commands over it so we don't really need a higher priority
+            nullptr);
+        wifiTransportUp = true;
+    }
     StreamingMode mode = deviceConfig->getDeviceMode();
     if (mode == StreamingMode::WIFI)
     {
+        // the stream handler only gets registered with a working camera
+        {
+            BootProfiler::ScopedPhase phase("wait_camera");
+            waitForCameraInit(portMAX_DELAY);
+        }
+        BootProfiler::ScopedPhase phase("stream_server_start");
         streamServer.startStreamServer();
     }
-    xTaskCreate(
-        HandleRestAPIPollTask,
-        "HandleRestAPIPollTask",
-        1024 * 2,
-        restAPI,
-        1, // it's the rest API, we only serve commands over it so we don't really need a higher priority
-        nullptr);
 #else
     ESP_LOGW("[MAIN]", "Wireless is disabled by configuration; skipping WiFi/mDNS/REST startup.");
 #endif
 }
 
+// the reverse of startWiFiMode(), frees the httpd and mongoose buffers and the Wi-Fi driver.
+// The event loop and netif stack stay up, nothing else needs them gone
+void stopWiFiMode()
+{
+#ifdef CONFIG_GENERAL_ENABLE_WIRELESS
+    if (!wifiTransportUp)
+        return;
+
+    BootProfiler::ScopedPhase phase("wifi_teardown");
+    ESP_LOGI("[MAIN]", "Stopping WiFi streaming mode.");
+    streamServer.stopStreamServer();
+    restAPI->stop();
+    mdnsManager.stop();
+    wifiManager->Stop();
+    wifiTransportUp = false;
+#endif
+}
+
+// setup/auto mode streams over Wi-Fi once we're on a network, in AP mode there's nobody to stream to yet
+void startAutoModeStream()
+{
+#ifdef CONFIG_GENERAL_ENABLE_WIRELESS
+    if (stateManager->GetWifiState() != WiFiState_e::WiFiState_Connected)
+    {
+        ESP_LOGI("[MAIN]", "Not connected to a network, not streaming in SETUP mode");
+        return;
+    }
+
+    waitForCameraInit(portMAX_DELAY);
+    streamServer.startStreamServer();
+#endif
+}
+
+ModeSwitchKind plan_mode_switch()
+{
+    // the setup window or heartbeat mode, launch_streaming() reads the saved mode whenever it runs
+    if (!streamingLaunched)
+        return ModeSwitchKind::OnStart;
+    // TinyUSB has no deinit and carries the command channel by now, there's no clean way back to usb_serial_jtag
+    if (getUsbHandoverDone() && deviceConfig->getDeviceMode() != StreamingMode::UVC)
+        return ModeSwitchKind::Reboot;
+    return ModeSwitchKind::Hot;
+}
+
+// runs on the esp_timer task so the command that asked for it gets its reply out first
+void apply_mode_switch()
+{
+    const StreamingMode mode = deviceConfig->getDeviceMode();
+    switch (plan_mode_switch())
+    {
+    case ModeSwitchKind::OnStart:
+        return;
+    case ModeSwitchKind::Reboot:
+        ESP_LOGI("[MAIN]", "Leaving UVC mode needs a restart, rebooting into mode %d", (int)mode);
+        esp_restart();
+        return;
+    case ModeSwitchKind::Hot:
+        break;
+    }
+
+    // with fast start the setup window may still be open, it would launch the saved mode a second time
+    if (timerHandle != nullptr)
+        esp_timer_stop(timerHandle);
+
+    const int64_t start = esp_timer_get_time();
+    // the new transport takes over from whatever is running, each start tears down or skips what it has to
+    launch_streaming();
+    const int64_t elapsed = esp_timer_get_time() - start;
+    setLastModeSwitchUs(elapsed);
+    ESP_LOGI("[MAIN]", "Switched to mode %d in %lld ms", (int)mode, elapsed / 1000);
+}
+
 void startSetupMode()
 {
     // If we're in SETUP mode - Device starts with a 20-second delay before deciding on what to do
@@ -258,6 +454,7 @@ void startSetupMode()
 
 extern "C" void app_main(void)
 {
+    const int appMainPhase = BootProfiler::begin("app_main");
     dependencyRegistry->registerService<ProjectConfig>(DependencyType::project_config, deviceConfig);
     dependencyRegistry->registerService<CameraManager>(DependencyType::camera_manager, cameraHandler);
     // Register WiFiManager only when wireless is enabled to avoid exposing WiFi commands in no-wireless builds
@@ -266,16 +463,47 @@ extern "C" void app_main(void)
 #endif
     dependencyRegistry->registerService<LEDManager>(DependencyType::led_manager, ledManager);
     dependencyRegistry->registerService<MonitoringManager>(DependencyType::monitoring_manager, monitoringManager);
+    dependencyRegistry->registerService<ExposureController>(DependencyType::exposure_controller, exposureController);
+    dependencyRegistry->registerService<IlluminationSync>(DependencyType::illumination_sync, illuminationSync);
+    dependencyRegistry->registerService<LEDCurrentRegulator>(DependencyType::led_current_regulator, ledCurrentRegulator);
+    dependencyRegistry->registerService<CommandJobs>(DependencyType::command_jobs, commandManager->getJobs());
+    dependencyRegistry->registerService<CommandExecutor>(DependencyType::command_executor, commandManager->getExecutor());
+    dependencyRegistry->registerService<TelemetrySubscription>(DependencyType::telemetry, commandManager->getTelemetry());
 
     // add endpoint to check firmware version
     // setup CI and building for other boards
 
     // esp_log_set_vprintf(&websocket_logger);
     Logo::printASCII();
-    initNVSStorage();
-    deviceConfig->load();
-    ledManager->setup();
-    monitoringManager->setup();
+    // before anything that records, a no-op unless CONFIG_GENERAL_TRACE is set
+    trace_init();
+    {
+        BootProfiler::ScopedPhase phase("nvs_config");
+        initNVSStorage();
+        deviceConfig->load();
+    }
+    {
+        BootProfiler::ScopedPhase phase("led_monitoring_setup");
+        ledManager->setup();
+        monitoringManager->setup();
+    }
+#if CONFIG_MONITORING_THERMAL
+    thermalStateQueue = xQueueCreate(1, sizeof(ThermalState));
+    xTaskCreate(
+        HandleThermalCameraTask,
+        "ThermalCameraTask",
+        // same as the camera init task, a re-initialization at a throttled clock runs the driver's init
+        1024 * 4,
+        nullptr,
+        1,
+        nullptr);
+    monitoringManager->setThermalCallback(applyThermalState);
+#endif
+#if CONFIG_MONITORING_LED_CURRENT
+    ledCurrentRegulator->setTarget(deviceConfig->getDeviceConfig().led_current_ma);
+    monitoringManager->setCurrentCallback([](const int32_t filtered_ma, const int32_t sample_ma)
+                                          { ledCurrentRegulator->update(filtered_ma, sample_ma); });
+#endif
     monitoringManager->start();
 
     xTaskCreate(
@@ -295,10 +523,24 @@ extern "C" void app_main(void)
         3,
         nullptr);
 
-    cameraHandler->setupCamera();
+#if CONFIG_GENERAL_PARALLEL_STARTUP
+    // camera bring-up takes most of a second, overlap it with the serial setup and the Wi-Fi association
+    // or USB enumeration below. Its own core, the Wi-Fi stack lives on core 0
+    xTaskCreatePinnedToCore(
+        HandleCameraInitTask,
+        "CameraInitTask",
+        1024 * 4,
+        nullptr,
+        2,
+        nullptr,
+        1);
+#else
+    initCamera();
+#endif
 
     // let's keep the serial manager running for the duration of the setup
     // we'll clean it up later if need be
+    const int serialPhase = BootProfiler::begin("serial_setup");
     serialManager->setup();
     xTaskCreate(
         HandleSerialManagerTask,
@@ -307,6 +549,7 @@ extern "C" void app_main(void)
         serialManager,
         1,
         &serialManagerHandle);
+    BootProfiler::end(serialPhase);
 
     StreamingMode mode = deviceConfig->getDeviceMode();
     if (mode == StreamingMode::UVC)
@@ -316,11 +559,13 @@ extern "C" void app_main(void)
 
         // todo this would be the perfect place to introduce random delays
         // to workaround windows usb bug
+        streamingLaunched = true;
         startWiredMode(true);
     }
     else if (mode == StreamingMode::WIFI)
     {
         // in Wifi mode we only need the wireless communication stuff, but the serial manager has to remain alive
+        streamingLaunched = true;
         startWiFiMode();
     }
     else
@@ -328,6 +573,13 @@ extern "C" void app_main(void)
         // since we're in setup mode, we have to have wireless functionality on,
         // so we can do wifi scanning, test connection etc
         startWiFiMode();
+#if CONFIG_GENERAL_FAST_START
+        // stream right away, the setup window below stays open for commands on top of it
+        // rather than keeping the tracker blind until it runs out. A mode switch meanwhile applies right away too
+        streamingLaunched = true;
+        startAutoModeStream();
+#endif
         startSetupMode();
     }
+    BootProfiler::end(appMainPhase);
 }
\ No newline at end of file
@@ -86,6 +86,7 @@ class OpenIrisDevice:
         self.debug_commands = debug_commands
         self.connection: serial.Serial | None = None
         self.connected = False
+        self.next_request_id = 1
 
     def __enter__(self):
         self.connected = self.__connect()
@@ -118,7 +119,16 @@ class OpenIrisDevice:
         except ValueError:
             return None
 
-    def __read_response(self, timeout: int | None = None) -> dict | None:
+    def __is_reply_to(self, message: dict, request_id: int) -> bool:
+        # telemetry frames and the replies to requests that timed out earlier aren't ours,
+        # firmware that predates ids doesn't echo them back though
+        if "telemetry" in message:
+            return False
+        return message.get("id", request_id) == request_id
+
+    def __read_response(
+        self, request_id: int, timeout: int | None = None
+    ) -> dict | None:
         # we can try and retrieve the response now.
         # it should be more or less immediate, but some commands may take longer
         # so we gotta timeout
@@ -134,29 +144,25 @@ class OpenIrisDevice:
                     print(f"Current buffer: {response_buffer}")
                     print("-" * 10)
 
-                # we can't rely on new lines to detect if we're done
-                # nor can we assume that we're always gonna get valid json response
-                # but we can assume that if we're to get a valid response, it's gonna be json
-                # so we can start actually building the buffer only when
-                # some part of the packet starts with "{", and start building from there
-                # we can assume that no further data will be returned, so we can validate
-                # right after receiving the last packet
-                if (not response_buffer and "{" in packet) or response_buffer:
-                    # assume we just started building the buffer and we've received the first packet
-
-                    # alternative approach in case this doesn't work - we're always sending a valid json
-                    # so we can start building the buffer from the first packet and keep trying to find the
-                    # starting and ending brackets, extract that part and validate, if the message is complete, return
-                    if not response_buffer:
-                        starting_idx = packet.find("{")
-                        response_buffer = packet[starting_idx:]
-                    else:
-                        response_buffer += packet
-
-                    # and once we get something, we can validate if it's a valid json
-                    if parsed_response := self.__check_if_response_is_complete(
-                        response_buffer
-                    ):
+                # every message ends with a new line, but logs may be mixed in
+                # and older firmware didn't always send one, so we only look at what
+                # starts with "{" and validate whatever we've got once nothing complete is left
+                response_buffer += packet
+                *lines, response_buffer = response_buffer.split("\n")
+                candidates = [(line, True) for line in lines]
+                candidates.append((response_buffer, False))
+                for line, is_complete in candidates:
+                    starting_idx = line.find("{")
+                    if starting_idx == -1:
+                        continue
+                    parsed_response = self.__check_if_response_is_complete(
+                        line[starting_idx:]
+                    )
+                    if parsed_response is None:
+                        continue
+                    if not is_complete:
+                        response_buffer = ""
+                    if self.__is_reply_to(parsed_response, request_id):
                         return parsed_response
             else:
                 time.sleep(0.1)
@@ -171,7 +177,10 @@ class OpenIrisDevice:
         if not self.connection or not self.connection.is_open:
             return {"error": "Device Not Connected"}
 
-        cmd_obj = {"commands": [{"command": command}]}
+        # the id lets us tell our reply apart from anything else the device sends
+        request_id = self.next_request_id
+        self.next_request_id += 1
+        cmd_obj = {"id": request_id, "commands": [{"command": command}]}
         if params:
             cmd_obj["commands"][0]["data"] = params
 
@@ -179,12 +188,10 @@ class OpenIrisDevice:
         # to signify we've finished sending the command
         cmd_str = json.dumps(cmd_obj) + "\n"
         try:
-            # clean it out first, just to be sure we're starting fresh
-            self.connection.reset_input_buffer()
             if self.debug or self.debug_commands:
                 print(f"Sending command: {cmd_str}")
             self.connection.write(cmd_str.encode())
-            response = self.__read_response(timeout)
+            response = self.__read_response(request_id, timeout)
 
             if self.debug:
                 print(f"Received response: {response}")
@@ -228,13 +235,39 @@ class WiFiScanner:
         print(
             f"🔍 Scanning for WiFi networks (this may take up to {timeout} seconds)..."
         )
-        response = self.device.send_command("scan_networks", timeout=timeout)
+        # the scan runs as a job on the device, we get its id back right away and wait for the result
+        response = self.device.send_command("scan_networks")
         if has_command_failed(response):
-            print(f"❌ Scan failed: {response['error']}")
+            print(f"❌ Scan failed: {get_command_error(response)}")
+            return
+
+        job_id = response["results"][0]["result"]["data"]["job_id"]
+        deadline = time.time() + timeout
+        job = None
+        while time.time() < deadline:
+            wait_ms = int(min(5, max(deadline - time.time(), 0)) * 1000)
+            response = self.device.send_command(
+                "get_job",
+                {"job_id": job_id, "wait_ms": wait_ms},
+                timeout=wait_ms // 1000 + 5,
+            )
+            if has_command_failed(response):
+                print(f"❌ Scan failed: {get_command_error(response)}")
+                return
+
+            job = response["results"][0]["result"]["data"]
+            if job["state"] in ("done", "failed"):
+                break
+
+        if not job or job["state"] not in ("done", "failed"):
+            print("❌ Scan failed: timed out waiting for the results")
+            return
+        if job["state"] == "failed":
+            print(f"❌ Scan failed: {job['result']['data']}")
             return
 
         channels_found = set()
-        networks = response["results"][0]["result"]["data"]["networks"]
+        networks = job["result"]["data"]["networks"]
 
         # after each scan, clear the network list to avoid duplication
         self.networks = []
@@ -263,6 +296,12 @@ def has_command_failed(result) -> bool:
     return "error" in result or result["results"][0]["result"]["status"] != "success"
 
 
+def get_command_error(result) -> str:
+    if "error" in result:
+        return result["error"]
+    return result["results"][0]["result"]["data"]
+
+
 def get_device_mode(device: OpenIrisDevice) -> dict:
     command_result = device.send_command("get_device_mode")
     if has_command_failed(command_result):
@@ -402,7 +441,13 @@ def switch_device_mode_command(device: OpenIrisDevice, *args, **kwargs):
         return
 
     print(f"✅ Device mode switched to '{mode}' successfully!")
-    print("🔄 Please restart the device for changes to take effect")
+    switch = command_result["results"][0]["result"]["data"]["switch"]
+    if switch == "hot":
+        print("⚡ Applying now, no restart needed")
+    elif switch == "reboot":
+        print("🔄 The device is restarting to apply the change")
+    else:
+        print("🔄 The new mode applies once streaming starts")
 
 
 def set_led_duty_cycle(device: OpenIrisDevice, *args, **kwargs):